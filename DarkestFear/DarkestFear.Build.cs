@@ -9,5 +9,7 @@ public class DarkestFear : ModuleRules
 		PCHUsage = PCHUsageMode.UseExplicitOrSharedPCHs;
 
 		PublicDependencyModuleNames.AddRange(new string[] { "Core", "CoreUObject", "Engine", "InputCore", "HeadMountedDisplay" });
+
+		PrivateDependencyModuleNames.AddRange(new string[] { "NavigationSystem", "AssetRegistry", "SynthBenchmark", "ImageWrapper", "RHI", "RenderCore" });
 	}
 }
@@ -1,7 +1,22 @@
 // Copyright Epic Games, Inc. All Rights Reserved.
 
 #include "DarkestFear.h"
+#include "DarkestFearFrameArena.h"
+#include "DarkestFearScalability.h"
 #include "Modules/ModuleManager.h"
 
-IMPLEMENT_PRIMARY_GAME_MODULE( FDefaultGameModuleImpl, DarkestFear, "DarkestFear" );
- 
\ No newline at end of file
+void FDarkestFearModule::StartupModule()
+{
+    FDarkestFearAllocCounter::Startup();
+    FDarkestFearFrameArena::Startup();
+    FDarkestFearScalability::Startup();
+}
+
+void FDarkestFearModule::ShutdownModule()
+{
+    FDarkestFearScalability::Shutdown();
+    FDarkestFearFrameArena::Shutdown();
+    FDarkestFearAllocCounter::Shutdown();
+}
+
+IMPLEMENT_PRIMARY_GAME_MODULE( FDarkestFearModule, DarkestFear, "DarkestFear" );
@@ -3,3 +3,11 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "Modules/ModuleManager.h"
+
+class FDarkestFearModule : public FDefaultGameModuleImpl
+{
+public:
+    virtual void StartupModule() override;
+    virtual void ShutdownModule() override;
+};
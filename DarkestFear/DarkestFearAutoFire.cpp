@@ -0,0 +1,201 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DarkestFearAutoFire.h"
+
+#include "DarkestFearCharacter.h"
+#include "DarkestFearFrameArena.h"
+#include "DarkestFearProjectile.h"
+#include "Engine/World.h"
+#include "GameFramework/PlayerController.h"
+#include "HAL/IConsoleManager.h"
+
+void FDarkestFearAutoFire::PullTrigger()
+{
+    bTriggerHeld = true;
+
+    if (!bFiring)
+    {
+        bFiring = true;
+        bPulled = true;
+    }
+}
+
+void FDarkestFearAutoFire::ReleaseTrigger()
+{
+    bTriggerHeld = false;
+}
+
+int32 FDarkestFearAutoFire::Advance(float DeltaTime, TArray<float>& OutShotAges)
+{
+    DeltaTime = FMath::Max(DeltaTime, 0.f);
+
+    if (!bFiring)
+    {
+        TimeToNextShot = FMath::Max(TimeToNextShot - DeltaTime, 0.f);
+        return 0;
+    }
+
+    // The pull was only read this frame, so its first shot can't be due any earlier than the end of it
+    if (bPulled)
+    {
+        TimeToNextShot = FMath::Max(TimeToNextShot, DeltaTime);
+        bPulled = false;
+    }
+
+    int32 NumShots = 0;
+
+    if (FireRate <= 0.f)
+    {
+        OutShotAges.Add(DeltaTime - TimeToNextShot);
+        NumShots = 1;
+    }
+    else
+    {
+        const float Interval = 1.f / FireRate;
+
+        while (TimeToNextShot <= DeltaTime && NumShots < MaxShotsPerFrame)
+        {
+            OutShotAges.Add(DeltaTime - TimeToNextShot);
+            TimeToNextShot += Interval;
+            NumShots++;
+        }
+
+        // Whatever a hitch still owes is skipped
+        TimeToNextShot = FMath::Max(TimeToNextShot, DeltaTime);
+    }
+
+    TimeToNextShot -= DeltaTime;
+
+    // Semi-automatic fire is done with its one shot, automatic fire once the trigger is let go
+    if (!bTriggerHeld || FireRate <= 0.f)
+        bFiring = false;
+
+    return NumShots;
+}
+
+int32 FDarkestFearShotBudget::Consume(double Now, float FireRate, int32 Requested)
+{
+    const float Rate = FireRate > 0.f ? FireRate : SemiAutomaticRate;
+    const float MaxAllowance = 1.f + Rate * BurstSeconds;
+
+    if (Allowance < 0.f)
+        Allowance = MaxAllowance;
+    else
+        Allowance = FMath::Min(Allowance + float(FMath::Max(Now - LastTime, 0.0)) * Rate, MaxAllowance);
+
+    LastTime = Now;
+
+    const int32 Accepted = FMath::Clamp(FMath::FloorToInt(Allowance), 0, Requested);
+    Allowance -= Accepted;
+
+    return Accepted;
+}
+
+static FAutoConsoleCommandWithWorldArgsAndOutputDevice AutoFireBenchCommand(
+    TEXT("DarkestFear.AutoFireBench"),
+    TEXT("DarkestFear.AutoFireBench [Rates=20 50 100]: projectile spawn cost of 2 seconds of automatic fire at 30, 60 "
+         "and 144 fps, against firing at most one shot per frame"),
+    FConsoleCommandWithWorldArgsAndOutputDeviceDelegate::CreateLambda(
+        [](const TArray<FString>& Args, UWorld* World, FOutputDevice& Ar)
+        {
+            if (World == nullptr)
+                return;
+
+            TArray<float> FireRates;
+
+            for (const FString& Arg : Args)
+                FireRates.Add(FMath::Max(FCString::Atof(*Arg), 1.f));
+
+            if (FireRates.Num() == 0)
+                FireRates = {20.f, 50.f, 100.f};
+
+            // The player's projectile if there is one, it is what the game actually spawns
+            TSubclassOf<ADarkestFearProjectile> ProjectileClass = ADarkestFearProjectile::StaticClass();
+
+            if (const APlayerController* PlayerController = World->GetFirstPlayerController())
+            {
+                const ADarkestFearCharacter* Character = Cast<ADarkestFearCharacter>(PlayerController->GetPawn());
+
+                if (Character != nullptr && Character->ProjectileClass != nullptr)
+                    ProjectileClass = Character->ProjectileClass;
+            }
+
+            constexpr float Duration = 2.f;
+
+            TArray<float> Ages;
+            TArray<FDarkestFearShot> Shots;
+            TArray<ADarkestFearProjectile*> AllSpawned;
+            FDarkestFearFrameArena& Arena = FDarkestFearFrameArena::Get();
+
+            for (const float FireRate : FireRates)
+            {
+                for (const float FPS : {30.f, 60.f, 144.f})
+                {
+                    FDarkestFearAutoFire AutoFire;
+                    AutoFire.FireRate = FireRate;
+                    AutoFire.PullTrigger();
+
+                    const int32 NumFrames = FMath::RoundToInt(Duration * FPS);
+                    int32 NumShots = 0;
+                    int32 NumBatches = 0;
+                    double SpawnSeconds = 0.0;
+                    double MaxFrameSeconds = 0.0;
+
+                    for (int32 Frame = 0; Frame < NumFrames; Frame++)
+                    {
+                        Ages.Reset();
+
+                        if (AutoFire.Advance(1.f / FPS, Ages) == 0)
+                            continue;
+
+                        // Far above the level, side by side so they don't spawn into each other
+                        Shots.Reset();
+
+                        for (const float Age : Ages)
+                        {
+                            FDarkestFearShot& Shot = Shots.AddDefaulted_GetRef();
+                            Shot.ShotId = NumShots;
+                            Shot.Location = FVector(0.f, 20.f * NumShots, 100000.f);
+                            Shot.Direction = FVector::UpVector;
+                            Shot.Age = Age;
+
+                            NumShots++;
+                        }
+
+                        // Each simulated frame gives its arena memory back, like the end of a real frame would
+                        const FDarkestFearFrameArena::FMark Mark = Arena.GetMark();
+                        TArray<ADarkestFearProjectile*, FDarkestFearFrameAllocator> Spawned;
+
+                        const double StartTime = FPlatformTime::Seconds();
+                        ADarkestFearProjectile::SpawnBatch(World, ProjectileClass, nullptr, Shots, false, &Spawned);
+                        const double FrameSeconds = FPlatformTime::Seconds() - StartTime;
+
+                        SpawnSeconds += FrameSeconds;
+                        MaxFrameSeconds = FMath::Max(MaxFrameSeconds, FrameSeconds);
+                        NumBatches++;
+
+                        AllSpawned.Append(Spawned);
+                        Spawned.Empty();
+                        Arena.PopMark(Mark);
+                    }
+
+                    for (ADarkestFearProjectile* Projectile : AllSpawned)
+                    {
+                        if (Projectile != nullptr)
+                            Projectile->Destroy();
+                    }
+
+                    AllSpawned.Reset();
+
+                    // One shot per frame at most is what firing from input events alone would give
+                    Ar.Logf(TEXT("%3.0f shots/s at %3.0f fps: %4d shots (%d at one per frame), %d batches and fire RPCs"),
+                            FireRate, FPS, NumShots, FMath::Min(NumShots, NumFrames), NumBatches);
+                    Ar.Logf(TEXT("  spawn %.3f ms/frame, max %.3f ms, %.1f us/shot"),
+                            SpawnSeconds * 1000.0 / NumFrames, MaxFrameSeconds * 1000.0,
+                            SpawnSeconds * 1e6 / FMath::Max(NumShots, 1));
+                }
+            }
+
+            CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS);
+        }));
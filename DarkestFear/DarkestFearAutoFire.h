@@ -0,0 +1,104 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/NetSerialization.h"
+
+#include "DarkestFearAutoFire.generated.h"
+
+/** One projectile of a frame's batch of shots */
+USTRUCT()
+struct DARKESTFEAR_API FDarkestFearShot
+{
+    GENERATED_BODY()
+
+    /** Shared by the predicted, authoritative and remote copies of the shot */
+    UPROPERTY()
+    uint16 ShotId = 0;
+
+    /** Where the muzzle was and which way it pointed when the shot was due */
+    UPROPERTY()
+    FVector_NetQuantize10 Location;
+
+    UPROPERTY()
+    FVector_NetQuantizeNormal Direction;
+
+    /** Seconds between the shot and the end of the frame that fired it */
+    UPROPERTY()
+    float Age = 0.f;
+};
+
+/**
+ * Trigger timing of automatic fire, independent of the frame rate. While the trigger is held a shot is due every
+ * 1 / FireRate seconds from the pull, and Advance hands out every shot due during the frame it covers with how long
+ * before the end of that frame it was due. The caller fires them as one batch, each placed where it would be had it
+ * really been fired at its own time, so 30 and 144 fps fire the same shots at the same spacing.
+ *
+ * Releasing the trigger does not reset the time to the next shot, so pulling faster than FireRate fires no faster.
+ * Plain data, it needs no world and can be driven headless.
+ *
+ * Console commands:
+ *   DarkestFear.AutoFireBench [Rates=20 50 100]  Cost of spawning each frame's batch of projectiles
+ *
+ * Shot counts and spacing at 30, 60 and 144 fps, and the server's FDarkestFearShotBudget against them, are checked by
+ * the DarkestFear.AutoFire automation tests.
+ */
+class DARKESTFEAR_API FDarkestFearAutoFire
+{
+public:
+    /** Shots per second while the trigger is held, 0 fires a single shot per pull */
+    float FireRate = 0.f;
+
+    /** The first shot is due at the end of the next Advance at the earliest */
+    void PullTrigger();
+
+    /** Shots due until the end of the next Advance still fire */
+    void ReleaseTrigger();
+
+    bool IsFiring() const { return bFiring; }
+
+    /**
+     * Advances by a frame of DeltaTime ending now. Appends the age of every shot due during it to OutShotAges,
+     * oldest first, and returns how many there were
+     */
+    int32 Advance(float DeltaTime, TArray<float>& OutShotAges);
+
+    /** Shots a single frame fires at most. A hitch owing more skips them rather than bursting them out at once */
+    static constexpr int32 MaxShotsPerFrame = 32;
+
+    /** Oldest shot age a server accepts from a client */
+    static constexpr float MaxShotAge = 0.25f;
+
+private:
+    /** From the end of the last Advance, never negative */
+    float TimeToNextShot = 0.f;
+
+    bool bTriggerHeld = false;
+    bool bFiring = false;
+
+    /** Pulled since the last Advance */
+    bool bPulled = false;
+};
+
+/**
+ * The server's check that a client fires no faster than its fire rate. Shots accrue at FireRate per second (at
+ * SemiAutomaticRate for single shots) up to a burst of BurstSeconds worth, so batches bunched together by the
+ * network still go through while a modified client can't fire more than that on top of the rate.
+ */
+class DARKESTFEAR_API FDarkestFearShotBudget
+{
+public:
+    /** How many of Requested shots arriving at Now may be fired, the first ones of the batch */
+    int32 Consume(double Now, float FireRate, int32 Requested);
+
+    /** Pulls per second allowed for single shots, faster than anyone clicks */
+    static constexpr float SemiAutomaticRate = 15.f;
+
+    static constexpr float BurstSeconds = FDarkestFearAutoFire::MaxShotAge;
+
+private:
+    /** Shots that may still be fired, negative until the first batch */
+    float Allowance = -1.f;
+    double LastTime = 0.0;
+};
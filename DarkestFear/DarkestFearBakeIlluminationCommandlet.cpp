@@ -0,0 +1,318 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DarkestFearBakeIlluminationCommandlet.h"
+
+#include "DarkestFearIllumination.h"
+#include "EngineUtils.h"
+#include "Async/ParallelFor.h"
+#include "Components/DirectionalLightComponent.h"
+#include "Components/PointLightComponent.h"
+#include "Components/SkyLightComponent.h"
+#include "Components/SpotLightComponent.h"
+#include "Engine/LevelBounds.h"
+#include "Engine/World.h"
+#include "Misc/FileHelper.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogDarkestFearBakeIllumination, Log, All);
+
+namespace
+{
+    // Directional and sky light visibility traces end this far away
+    constexpr float InfiniteTraceLength = 100000.f;
+
+    // Local light visibility traces end this far before the light
+    constexpr float LightClearance = 20.f;
+
+    // Bricks that vary less than this (absolute, or relative to their brightest sample) are stored as one value
+    constexpr float UniformTolerance = .01f;
+    constexpr float UniformRelativeTolerance = .02f;
+}
+
+UDarkestFearBakeIlluminationCommandlet::UDarkestFearBakeIlluminationCommandlet()
+{
+    IsClient = false;
+    IsServer = false;
+    IsEditor = true;
+    LogToConsole = true;
+}
+
+int32 UDarkestFearBakeIlluminationCommandlet::Main(const FString& Params)
+{
+    FString Maps;
+    float CellSize = 100.f;
+
+    if (!FParse::Value(*Params, TEXT("Map="), Maps))
+    {
+        UE_LOG(LogDarkestFearBakeIllumination, Error, TEXT("Missing -Map=<map>[+<map>...]"));
+        return 1;
+    }
+
+    FParse::Value(*Params, TEXT("CellSize="), CellSize);
+    CellSize = FMath::Max(CellSize, 10.f);
+
+    TArray<FString> MapList;
+    Maps.ParseIntoArray(MapList, TEXT("+"));
+
+    int32 NumFailed = 0;
+
+    for (const FString& Map : MapList)
+    {
+        if (!BakeMap(Map, CellSize))
+            NumFailed++;
+    }
+
+    return NumFailed > 0 ? 1 : 0;
+}
+
+bool UDarkestFearBakeIlluminationCommandlet::BakeMap(const FString& Map, float CellSize)
+{
+    UPackage* Package = LoadPackage(nullptr, *Map, LOAD_None);
+    UWorld* World = Package != nullptr ? UWorld::FindWorldInPackage(Package) : nullptr;
+
+    if (World == nullptr)
+    {
+        UE_LOG(LogDarkestFearBakeIllumination, Error, TEXT("Could not load map %s"), *Map);
+        return false;
+    }
+
+    // Only collision is needed, for the visibility traces
+    World->WorldType = EWorldType::Editor;
+    World->AddToRoot();
+
+    if (!World->bIsWorldInitialized)
+    {
+        UWorld::InitializationValues IVS;
+        IVS.RequiresHitProxies(false)
+           .ShouldSimulatePhysics(false)
+           .EnableTraceCollision(true)
+           .CreateNavigation(false)
+           .CreateAISystem(false)
+           .AllowAudioPlayback(false)
+           .CreatePhysicsScene(true);
+
+        World->InitWorld(IVS);
+        World->PersistentLevel->UpdateModelComponents();
+        World->UpdateWorldComponents(true, false);
+    }
+
+    const double StartTime = FPlatformTime::Seconds();
+
+    TArray<FBakeLight> Lights;
+    GatherLights(World, Lights);
+
+    constexpr int32 BrickCells = FDarkestFearIlluminationHeader::BrickCells;
+    constexpr int32 SamplesPerAxis = FDarkestFearIlluminationHeader::BrickSamplesPerAxis;
+    constexpr int32 BrickSamples = FDarkestFearIlluminationHeader::BrickSamples;
+
+    const FBox Bounds = ALevelBounds::CalculateLevelBounds(World->PersistentLevel).ExpandBy(CellSize);
+    const float BrickSize = CellSize * BrickCells;
+    const FVector Size = Bounds.GetSize();
+
+    FDarkestFearIlluminationHeader Header;
+    Header.Magic = FDarkestFearIlluminationHeader::FileMagic;
+    Header.Version = FDarkestFearIlluminationHeader::FileVersion;
+    Header.Origin = Bounds.Min;
+    Header.CellSize = CellSize;
+    Header.NumBricks = FIntVector(FMath::Max(FMath::CeilToInt(Size.X / BrickSize), 1),
+                                  FMath::Max(FMath::CeilToInt(Size.Y / BrickSize), 1),
+                                  FMath::Max(FMath::CeilToInt(Size.Z / BrickSize), 1));
+
+    const int32 NumBricks = Header.NumBricks.X * Header.NumBricks.Y * Header.NumBricks.Z;
+
+    // Every brick is sampled independently, borders included, so bricks never wait on each other
+    TArray<FFloat16> Samples;
+    Samples.SetNum(NumBricks * BrickSamples);
+
+    TArray<uint32> Index;
+    Index.SetNum(NumBricks);
+
+    ParallelFor(NumBricks, [&](int32 BrickNumber)
+    {
+        const FIntVector Brick(BrickNumber % Header.NumBricks.X, (BrickNumber / Header.NumBricks.X) % Header.NumBricks.Y,
+                               BrickNumber / (Header.NumBricks.X * Header.NumBricks.Y));
+        const FVector BrickOrigin = Header.Origin + FVector(Brick) * BrickSize;
+
+        FFloat16* BrickData = Samples.GetData() + BrickNumber * BrickSamples;
+        float Min = MAX_flt;
+        float Max = 0.f;
+        float Sum = 0.f;
+
+        for (int32 Z = 0; Z < SamplesPerAxis; Z++)
+        {
+            for (int32 Y = 0; Y < SamplesPerAxis; Y++)
+            {
+                for (int32 X = 0; X < SamplesPerAxis; X++)
+                {
+                    const float Value = SampleIllumination(World, Lights, BrickOrigin + FVector(X, Y, Z) * CellSize);
+
+                    BrickData[(Z * SamplesPerAxis + Y) * SamplesPerAxis + X] = Value;
+                    Min = FMath::Min(Min, Value);
+                    Max = FMath::Max(Max, Value);
+                    Sum += Value;
+                }
+            }
+        }
+
+        if (Max - Min <= FMath::Max(UniformTolerance, Max * UniformRelativeTolerance))
+        {
+            const FFloat16 Uniform(Sum / BrickSamples);
+            Index[BrickNumber] = FDarkestFearIlluminationHeader::UniformFlag | Uniform.Encoded;
+        }
+        else
+        {
+            Index[BrickNumber] = 0;
+        }
+    });
+
+    // Only varying bricks make it to the file, numbered in brick order
+    TArray<FFloat16> StoredSamples;
+    Header.NumStoredBricks = 0;
+
+    for (int32 BrickNumber = 0; BrickNumber < NumBricks; BrickNumber++)
+    {
+        if (Index[BrickNumber] & FDarkestFearIlluminationHeader::UniformFlag)
+            continue;
+
+        Index[BrickNumber] = Header.NumStoredBricks++;
+        StoredSamples.Append(Samples.GetData() + BrickNumber * BrickSamples, BrickSamples);
+    }
+
+    TArray<uint8> File;
+    File.Append(reinterpret_cast<const uint8*>(&Header), sizeof(Header));
+    File.Append(reinterpret_cast<const uint8*>(Index.GetData()), Index.Num() * Index.GetTypeSize());
+    File.Append(reinterpret_cast<const uint8*>(StoredSamples.GetData()), StoredSamples.Num() * StoredSamples.GetTypeSize());
+
+    const FString Path = FDarkestFearIllumination::GetGridPath(Map);
+    const bool bSaved = FFileHelper::SaveArrayToFile(File, *Path);
+    const double BakeSeconds = FPlatformTime::Seconds() - StartTime;
+    const int64 NumSamples = int64(NumBricks) * BrickSamples;
+
+    if (bSaved)
+    {
+        UE_LOG(LogDarkestFearBakeIllumination, Display,
+               TEXT("%s: %d lights, %dx%dx%d bricks, %d stored (%.1f%%), %.1f KB (%.1f KB dense) in %.2f s, %.0f samples/s -> %s"),
+               *Map, Lights.Num(), Header.NumBricks.X, Header.NumBricks.Y, Header.NumBricks.Z, Header.NumStoredBricks,
+               100.f * Header.NumStoredBricks / NumBricks, File.Num() / 1024.0, NumSamples * sizeof(FFloat16) / 1024.0,
+               BakeSeconds, NumSamples / FMath::Max(BakeSeconds, 1e-9), *Path);
+    }
+    else
+    {
+        UE_LOG(LogDarkestFearBakeIllumination, Error, TEXT("Could not write %s"), *Path);
+    }
+
+    World->DestroyWorld(false);
+    World->RemoveFromRoot();
+    CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS);
+
+    return bSaved;
+}
+
+void UDarkestFearBakeIlluminationCommandlet::GatherLights(UWorld* World, TArray<FBakeLight>& OutLights)
+{
+    for (TActorIterator<AActor> It(World); It; ++It)
+    {
+        TInlineComponentArray<ULightComponentBase*> Components(*It);
+
+        for (ULightComponentBase* Component : Components)
+        {
+            // Movable lights can change at runtime, they are not part of the level's ambient lighting
+            if (!Component->IsVisible() || Component->Mobility == EComponentMobility::Movable)
+                continue;
+
+            FBakeLight Light;
+            Light.Position = Component->GetComponentLocation();
+            Light.Direction = Component->GetForwardVector();
+            Light.Radius = 0.f;
+            Light.CosInner = -1.f;
+            Light.CosOuter = -1.f;
+            Light.bCastShadows = Component->CastShadows;
+
+            if (const USkyLightComponent* SkyLight = Cast<USkyLightComponent>(Component))
+            {
+                Light.Type = FBakeLight::EType::Sky;
+                Light.Brightness = SkyLight->Intensity;
+            }
+            else if (const UDirectionalLightComponent* DirectionalLight = Cast<UDirectionalLightComponent>(Component))
+            {
+                Light.Type = FBakeLight::EType::Directional;
+                Light.Brightness = DirectionalLight->ComputeLightBrightness();
+            }
+            else if (const UPointLightComponent* PointLight = Cast<UPointLightComponent>(Component))
+            {
+                Light.Type = FBakeLight::EType::Local;
+                Light.Brightness = PointLight->ComputeLightBrightness();
+                Light.Radius = PointLight->AttenuationRadius;
+
+                if (const USpotLightComponent* SpotLight = Cast<USpotLightComponent>(Component))
+                {
+                    Light.CosInner = FMath::Cos(FMath::DegreesToRadians(SpotLight->InnerConeAngle));
+                    Light.CosOuter = FMath::Cos(FMath::DegreesToRadians(SpotLight->OuterConeAngle));
+                }
+            }
+            else
+            {
+                continue;
+            }
+
+            OutLights.Add(Light);
+        }
+    }
+}
+
+float UDarkestFearBakeIlluminationCommandlet::SampleIllumination(UWorld* World, const TArray<FBakeLight>& Lights,
+                                                                 const FVector& Location)
+{
+    static const FCollisionQueryParams Params(SCENE_QUERY_STAT(DarkestFearBakeIllumination), false);
+
+    float Illumination = 0.f;
+
+    for (const FBakeLight& Light : Lights)
+    {
+        float Contribution = 0.f;
+        FVector TraceEnd;
+
+        switch (Light.Type)
+        {
+        case FBakeLight::EType::Local:
+            {
+                const FVector FromLight = Location - Light.Position;
+                const float Distance = FromLight.Size();
+
+                Contribution = Light.Brightness * FDarkestFearIllumination::DistanceFalloff(Distance, Light.Radius);
+
+                if (Light.CosOuter > -1.f)
+                {
+                    const float CosAngle = FVector::DotProduct(FromLight.GetSafeNormal(), Light.Direction);
+                    Contribution *= FDarkestFearIllumination::ConeFalloff(CosAngle, Light.CosInner, Light.CosOuter);
+                }
+
+                // Stop short of the light, it usually sits inside its own lamp mesh
+                TraceEnd = Light.Position + FromLight.GetSafeNormal() * FMath::Min(LightClearance, Distance);
+                break;
+            }
+
+        case FBakeLight::EType::Directional:
+            Contribution = Light.Brightness;
+            TraceEnd = Location - Light.Direction * InfiniteTraceLength;
+            break;
+
+        case FBakeLight::EType::Sky:
+            // Open sky above or not, good enough for ambient light
+            Contribution = Light.Brightness;
+            TraceEnd = Location + FVector::UpVector * InfiniteTraceLength;
+            break;
+        }
+
+        // Lights out of reach skip the trace, which is where nearly all the bake time goes
+        if (Contribution <= KINDA_SMALL_NUMBER)
+            continue;
+
+        if (Light.bCastShadows && World->LineTraceTestByChannel(Location, TraceEnd, ECC_Visibility, Params))
+            continue;
+
+        Illumination += Contribution;
+    }
+
+    return Illumination;
+}
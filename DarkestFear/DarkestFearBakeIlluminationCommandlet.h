@@ -0,0 +1,52 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+
+#include "DarkestFearBakeIlluminationCommandlet.generated.h"
+
+/**
+ * Bakes the ambient illumination grid of one or more maps, see UDarkestFearIlluminationSubsystem for the runtime
+ * side and FDarkestFearIlluminationHeader for the file layout.
+ *
+ * Every grid sample adds up the static and stationary lights of the persistent level (point, spot, directional
+ * and sky), each shadowed with a single visibility trace. Logs bake time, sample throughput and file size per map.
+ *
+ * Usage: -run=DarkestFearBakeIllumination -Map=<map>[+<map>...] [-CellSize=100]
+ */
+UCLASS()
+class UDarkestFearBakeIlluminationCommandlet : public UCommandlet
+{
+    GENERATED_BODY()
+
+public:
+    UDarkestFearBakeIlluminationCommandlet();
+
+    virtual int32 Main(const FString& Params) override;
+
+private:
+    struct FBakeLight
+    {
+        enum class EType : uint8
+        {
+            Local,
+            Directional,
+            Sky
+        };
+
+        EType Type;
+        FVector Position;
+        FVector Direction;
+        float Radius;
+        float Brightness;
+        float CosInner;
+        float CosOuter;
+        bool bCastShadows;
+    };
+
+    static bool BakeMap(const FString& Map, float CellSize);
+    static void GatherLights(class UWorld* World, TArray<FBakeLight>& OutLights);
+    static float SampleIllumination(class UWorld* World, const TArray<FBakeLight>& Lights, const FVector& Location);
+};
@@ -0,0 +1,197 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DarkestFearBotComponent.h"
+
+#include "DarkestFearCharacter.h"
+#include "EngineUtils.h"
+#include "Item.h"
+#include "Camera/CameraComponent.h"
+#include "Misc/CommandLine.h"
+
+UDarkestFearBotComponent::UDarkestFearBotComponent()
+{
+    PrimaryComponentTick.bCanEverTick = true;
+
+    DecisionInterval = FVector2D(.5f, 2.f);
+    ItemSearchRadius = 2000.f;
+    PickUpTimeout = 5.f;
+
+    CurrentAction = EDarkestFearBotAction::Wander;
+    TimeToNextDecision = 0.f;
+    MoveForwardValue = 0.f;
+    MoveRightValue = 0.f;
+    TurnValue = 0.f;
+    ShotsLeft = 0;
+    PickUpTimeLeft = 0.f;
+    bInReach = false;
+}
+
+void UDarkestFearBotComponent::BeginPlay()
+{
+    Super::BeginPlay();
+
+    int32 Seed = 0;
+    FParse::Value(FCommandLine::Get(), TEXT("BotSeed="), Seed);
+    Random.Initialize(Seed);
+}
+
+ADarkestFearCharacter* UDarkestFearBotComponent::GetCharacter() const
+{
+    return Cast<ADarkestFearCharacter>(GetOwner());
+}
+
+void UDarkestFearBotComponent::Act(EDarkestFearInput Input, float Value)
+{
+    if (ADarkestFearCharacter* Character = GetCharacter())
+        Character->DispatchInput(Input, Value);
+}
+
+void UDarkestFearBotComponent::TickComponent(float DeltaTime, ELevelTick TickType,
+                                             FActorComponentTickFunction* ThisTickFunction)
+{
+    Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+    ADarkestFearCharacter* Character = GetCharacter();
+
+    if (Character == nullptr || !Character->IsLocallyControlled())
+        return;
+
+    if (TargetItem.IsValid())
+        ApproachTargetItem(DeltaTime);
+
+    // Axes are held like a real player would
+    Act(EDarkestFearInput::MoveForward, MoveForwardValue);
+    Act(EDarkestFearInput::MoveRight, MoveRightValue);
+    Act(EDarkestFearInput::TurnRate, TurnValue);
+
+    if (ShotsLeft > 0)
+    {
+        // A tap, fired at the character's fire rate at most
+        Act(EDarkestFearInput::Fire);
+        Act(EDarkestFearInput::StopFire);
+        ShotsLeft--;
+    }
+
+    TimeToNextDecision -= DeltaTime;
+
+    // A pickup under way is finished or given up on before the next decision
+    if (TimeToNextDecision <= 0.f && !TargetItem.IsValid())
+    {
+        Decide();
+        TimeToNextDecision = Random.FRandRange(DecisionInterval.X, DecisionInterval.Y);
+    }
+}
+
+void UDarkestFearBotComponent::Decide()
+{
+    ADarkestFearCharacter* Character = GetCharacter();
+
+    // A placement started last decision is always finished before doing anything else
+    if (CurrentAction == EDarkestFearBotAction::Place)
+    {
+        Act(EDarkestFearInput::FinishPlace);
+    }
+
+    CurrentAction = static_cast<EDarkestFearBotAction>(Random.RandRange(0, static_cast<int32>(EDarkestFearBotAction::Fire)));
+
+    MoveForwardValue = 0.f;
+    MoveRightValue = 0.f;
+    TurnValue = 0.f;
+
+    switch (CurrentAction)
+    {
+    case EDarkestFearBotAction::Wander:
+        MoveForwardValue = Random.FRandRange(-1.f, 1.f);
+        MoveRightValue = Random.FRandRange(-1.f, 1.f);
+        TurnValue = Random.FRandRange(-1.f, 1.f);
+        break;
+
+    case EDarkestFearBotAction::PickUp:
+        TargetItem = FindNearestItem();
+        PickUpTimeLeft = PickUpTimeout;
+        bInReach = false;
+        break;
+
+    case EDarkestFearBotAction::CycleItem:
+        Act(static_cast<EDarkestFearInput>(static_cast<int32>(EDarkestFearInput::UseItemSlot0) + Random.RandRange(0, 2)));
+        break;
+
+    case EDarkestFearBotAction::Place:
+        if (Character->ActiveItem != nullptr)
+        {
+            // Look down a little so the placement trace finds the floor
+            if (AController* Controller = Character->GetController())
+                Controller->SetControlRotation(FRotator(-45.f, Controller->GetControlRotation().Yaw, 0.f));
+
+            Act(EDarkestFearInput::BeginPlace);
+            Act(Random.RandBool() ? EDarkestFearInput::MouseWheelUp : EDarkestFearInput::MouseWheelDown);
+        }
+        break;
+
+    case EDarkestFearBotAction::UseItem:
+        Act(EDarkestFearInput::UseActiveItem);
+        break;
+
+    case EDarkestFearBotAction::Fire:
+        ShotsLeft = Random.RandRange(1, 5);
+        TurnValue = Random.FRandRange(-.25f, .25f);
+        break;
+    }
+}
+
+AItem* UDarkestFearBotComponent::FindNearestItem() const
+{
+    const FVector ViewLocation = GetCharacter()->GetFirstPersonCameraComponent()->GetComponentLocation();
+    AItem* Nearest = nullptr;
+    float NearestDistSquared = FMath::Square(ItemSearchRadius);
+
+    for (TActorIterator<AItem> It(GetWorld()); It; ++It)
+    {
+        const float DistSquared = FVector::DistSquared(It->GetActorLocation(), ViewLocation);
+
+        if (It->bCanPickup && It->GetAttachParentActor() == nullptr && DistSquared < NearestDistSquared)
+        {
+            Nearest = *It;
+            NearestDistSquared = DistSquared;
+        }
+    }
+
+    return Nearest;
+}
+
+void UDarkestFearBotComponent::ApproachTargetItem(float DeltaTime)
+{
+    ADarkestFearCharacter* Character = GetCharacter();
+    AController* Controller = Character->GetController();
+    const AItem* Item = TargetItem.Get();
+
+    PickUpTimeLeft -= DeltaTime;
+
+    // Somebody else got there first, or it can't be reached
+    if (Controller == nullptr || !Item->bCanPickup || Item->GetAttachParentActor() != nullptr || PickUpTimeLeft <= 0.f)
+    {
+        TargetItem = nullptr;
+        MoveForwardValue = 0.f;
+        return;
+    }
+
+    // The camera was aimed at the item in reach last tick, so this tick's use trace hits it
+    if (bInReach)
+    {
+        Act(EDarkestFearInput::PickUpItem);
+        TargetItem = nullptr;
+        MoveForwardValue = 0.f;
+        return;
+    }
+
+    const FVector ViewLocation = Character->GetFirstPersonCameraComponent()->GetComponentLocation();
+    const FVector ToItem = Item->GetActorLocation() - ViewLocation;
+
+    Controller->SetControlRotation(ToItem.Rotation());
+
+    // Items on the floor are most of the trace below the camera already. The trace hits their near side, short of
+    // the origin, so a small margin is enough
+    bInReach = ToItem.Size() < Character->UseLineDistance * .95f;
+    MoveForwardValue = bInReach ? 0.f : 1.f;
+}
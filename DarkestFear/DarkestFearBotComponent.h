@@ -0,0 +1,85 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/ActorComponent.h"
+#include "InputRecorder.h"
+
+#include "DarkestFearBotComponent.generated.h"
+
+UENUM()
+enum class EDarkestFearBotAction : uint8
+{
+    Wander,
+    PickUp,
+    CycleItem,
+    Place,
+    UseItem,
+    Fire
+};
+
+/**
+ * Scripted player used by load tests. Added to the locally controlled character when the client runs with
+ * -DarkestFearBot, it plays like a very restless player: wanders, picks items up, cycles and places them, uses
+ * them and fires. Everything goes through ADarkestFearCharacter::DispatchInput, exactly like real input.
+ *
+ * Picking up walks to the item first: the use trace only reaches UseLineDistance, and a control rotation set now
+ * only aims the camera from the next frame on, so the pickup is pressed on a later tick once in range.
+ *
+ * -BotSeed=<n> makes the behaviour reproducible per bot.
+ */
+UCLASS()
+class DARKESTFEAR_API UDarkestFearBotComponent : public UActorComponent
+{
+    GENERATED_BODY()
+
+public:
+    UDarkestFearBotComponent();
+
+    /** Seconds between decisions, a random value in this range is picked every time */
+    UPROPERTY(EditAnywhere, Category="Bot")
+    FVector2D DecisionInterval;
+
+    /** How far the bot looks for items to pick up */
+    UPROPERTY(EditAnywhere, Category="Bot")
+    float ItemSearchRadius;
+
+    /** Seconds the bot walks towards an item before giving up on it */
+    UPROPERTY(EditAnywhere, Category="Bot")
+    float PickUpTimeout;
+
+    virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+
+protected:
+    virtual void BeginPlay() override;
+
+private:
+    FRandomStream Random;
+    EDarkestFearBotAction CurrentAction;
+    float TimeToNextDecision;
+
+    // Wander state, applied every tick as if the axes were held
+    float MoveForwardValue;
+    float MoveRightValue;
+    float TurnValue;
+
+    // Fire bursts a few shots across ticks
+    int32 ShotsLeft;
+
+    // Item being walked to, picked up once it is within reach
+    TWeakObjectPtr<class AItem> TargetItem;
+    float PickUpTimeLeft;
+    bool bInReach;
+
+    class ADarkestFearCharacter* GetCharacter() const;
+
+    void Decide();
+    void Act(EDarkestFearInput Input, float Value = 1.f);
+
+    /** Closest item in ItemSearchRadius nobody holds, nullptr when there is none */
+    class AItem* FindNearestItem() const;
+
+    /** Aims and walks at TargetItem, pressing pickup on the tick after it came within reach */
+    void ApproachTargetItem(float DeltaTime);
+};
@@ -5,6 +5,7 @@
 
 #include "DarkestFearProjectile.h"
 #include "DrawDebugHelpers.h"
+#include "Animation/AnimInstance.h"
 #include "Camera/CameraComponent.h"
 #include "Components/CapsuleComponent.h"
 #include "Components/InputComponent.h"
@@ -13,10 +14,32 @@
 #include "Kismet/GameplayStatics.h"
 #include "MotionControllerComponent.h"
 #include "XRMotionControllerBase.h" // for FXRMotionControllerBase::RightHandSourceId
+#include "DarkestFearBotComponent.h"
+#include "DarkestFearEvents.h"
+#include "DarkestFearFrameArena.h"
+#include "DarkestFearMemory.h"
+#include "DarkestFearScalability.h"
+#include "DarkestFearSceneQuery.h"
+#include "Engine/GameInstance.h"
 #include "Item.h"
+#include "ItemLagCompensation.h"
+#include "GameFramework/PlayerState.h"
+#include "HAL/IConsoleManager.h"
 
 DEFINE_LOG_CATEGORY_STATIC(LogFPChar, Warning, All);
 
+static TAutoConsoleVariable<int32> CVarShowPlacementDebug(
+    TEXT("DarkestFear.ShowPlacementDebug"),
+    0,
+    TEXT("Show the location the placement ghost is facing on screen"));
+
+// Built once, the use line is traced every frame while placing
+static const FCollisionQueryParams& GetUseTraceParams()
+{
+    static const FCollisionQueryParams Params(SCENE_QUERY_STAT(DarkestFearUseTrace));
+    return Params;
+}
+
 //////////////////////////////////////////////////////////////////////////
 // ADarkestFearCharacter
 
@@ -38,6 +61,18 @@ ADarkestFearCharacter::ADarkestFearCharacter()
     BaseTurnRate = 45.f;
     BaseLookUpRate = 45.f;
 
+    // Default offset from the character location for projectiles to spawn
+    GunOffset = FVector(100.0f, 0.0f, 10.0f);
+    MaxShotOriginError = 150.f;
+    FireRate = 0.f;
+    NextShotId = 0;
+    LastMuzzleLocation = FVector::ZeroVector;
+    LastAim = FQuat::Identity;
+    LastMuzzleFrame = 0;
+    NextPredictionKey = 0;
+    InvCursor = 0;
+    PlacementQueryHandle = MAX_uint64;
+
     // Create a CameraComponent	
     FirstPersonCameraComponent = CreateDefaultSubobject<UCameraComponent>(TEXT("FirstPersonCamera"));
     FirstPersonCameraComponent->SetupAttachment(GetCapsuleComponent());
@@ -53,15 +88,14 @@ ADarkestFearCharacter::ADarkestFearCharacter()
     Mesh1P->SetRelativeRotation(FRotator(1.9f, -19.19f, 5.2f));
     Mesh1P->SetRelativeLocation(FVector(-0.5f, -4.4f, -155.7f));
 
-    // Create VR Controllers.
-    R_MotionController = CreateDefaultSubobject<UMotionControllerComponent>(TEXT("R_MotionController"));
-    R_MotionController->MotionSource = FXRMotionControllerBase::RightHandSourceId;
-    R_MotionController->SetupAttachment(RootComponent);
-    L_MotionController = CreateDefaultSubobject<UMotionControllerComponent>(TEXT("L_MotionController"));
-    L_MotionController->SetupAttachment(RootComponent);
-
-    // Create Ghosting Mesh
-    ActiveItemGhost = CreateDefaultSubobject<UStaticMeshComponent>(TEXT("ItemGhosting"));
+    /*
+     * VR Controllers and the item ghosting mesh are NOT default subobjects: most characters never use them,
+     * and every component costs registration, transform updates and memory (multiplied per player on a server).
+     * Motion controllers are created in BeginPlay when an HMD is active, the ghost on the first OnBeginPlace.
+     */
+    R_MotionController = nullptr;
+    L_MotionController = nullptr;
+    ActiveItemGhost = nullptr;
 
     // Uncomment the following line to turn motion controllers on by default:
     //bUsingMotionControllers = true;
@@ -72,7 +106,10 @@ void ADarkestFearCharacter::BeginPlay()
     // Call the base class  
     Super::BeginPlay();
 
-    ActiveItemGhost->SetCollisionProfileName(UCollisionProfile::NoCollision_ProfileName);
+    if (!IsRunningDedicatedServer() && IsLocallyControlled() && UHeadMountedDisplayFunctionLibrary::IsHeadMountedDisplayEnabled())
+    {
+        CreateMotionControllers();
+    }
 
     // Show or hide the two versions of the gun based on whether or not we're using motion controllers.
     if (bUsingMotionControllers)
@@ -85,8 +122,75 @@ void ADarkestFearCharacter::BeginPlay()
     }
 }
 
+void ADarkestFearCharacter::CreateMotionControllers()
+{
+    if (R_MotionController == nullptr)
+    {
+        R_MotionController = NewObject<UMotionControllerComponent>(this, TEXT("R_MotionController"));
+        R_MotionController->MotionSource = FXRMotionControllerBase::RightHandSourceId;
+        R_MotionController->SetupAttachment(RootComponent);
+        R_MotionController->RegisterComponent();
+    }
+
+    if (L_MotionController == nullptr)
+    {
+        L_MotionController = NewObject<UMotionControllerComponent>(this, TEXT("L_MotionController"));
+        L_MotionController->SetupAttachment(RootComponent);
+        L_MotionController->RegisterComponent();
+    }
+}
+
+UStaticMeshComponent* ADarkestFearCharacter::GetOrCreateItemGhost()
+{
+    if (ActiveItemGhost == nullptr)
+    {
+        DARKESTFEAR_LLM_SCOPE(STAT_DarkestFearPlacementGhostLLM);
+
+        ActiveItemGhost = NewObject<UStaticMeshComponent>(this, TEXT("ItemGhosting"));
+        ActiveItemGhost->SetCollisionProfileName(UCollisionProfile::NoCollision_ProfileName);
+        ActiveItemGhost->SetGenerateOverlapEvents(false);
+        ActiveItemGhost->SetCastShadow(false);
+        ActiveItemGhost->SetHiddenInGame(true);
+        ActiveItemGhost->RegisterComponent();
+    }
+
+    return ActiveItemGhost;
+}
+
+FInputRecorder* ADarkestFearCharacter::GetInputRecorder() const
+{
+    // Bots and other players' characters are never recorded
+    if (!IsLocallyControlled() || !IsPlayerControlled())
+        return nullptr;
+
+    const UGameInstance* GameInstance = GetGameInstance();
+    UDarkestFearInputRecorderSubsystem* Recording = GameInstance ? GameInstance->GetSubsystem<UDarkestFearInputRecorderSubsystem>() : nullptr;
+
+    return Recording ? &Recording->GetRecorder() : nullptr;
+}
+
 void ADarkestFearCharacter::Tick(float DeltaTime)
 {
+    if (FInputRecorder* InputRecorder = GetInputRecorder())
+    {
+        if (InputRecorder->IsReplaying())
+        {
+            InputRecorder->GetReplayedInputs(ReplayedInputs);
+
+            for (const FRecordedInput& Replayed : ReplayedInputs)
+            {
+                DispatchInput(Replayed.Input, Replayed.Value);
+            }
+        }
+
+        InputRecorder->AdvanceFrame();
+    }
+
+    if (IsLocallyControlled())
+    {
+        FireShots(DeltaTime);
+    }
+
     if (bIsPlacing)
     {
         ADarkestFearCharacter::DisplayPlacementPivot();
@@ -101,32 +205,43 @@ void ADarkestFearCharacter::SetupPlayerInputComponent(class UInputComponent* Pla
     // set up gameplay key bindings
     check(PlayerInputComponent);
 
+    // Load test clients are driven by a bot instead of a player
+    if (FParse::Param(FCommandLine::Get(), TEXT("DarkestFearBot")) && FindComponentByClass<UDarkestFearBotComponent>() == nullptr)
+    {
+        UDarkestFearBotComponent* Bot = NewObject<UDarkestFearBotComponent>(this, TEXT("Bot"));
+        Bot->RegisterComponent();
+    }
+
+    // Every gameplay binding goes through DispatchInput so it can be recorded and replayed
+
     // Bind jump events
-    PlayerInputComponent->BindAction("Jump", IE_Pressed, this, &ACharacter::Jump);
-    PlayerInputComponent->BindAction("Jump", IE_Released, this, &ACharacter::StopJumping);
+    BindRecordedAction(PlayerInputComponent, "Jump", IE_Pressed, EDarkestFearInput::Jump);
+    BindRecordedAction(PlayerInputComponent, "Jump", IE_Released, EDarkestFearInput::StopJumping);
 
     // Bind fire event
-    PlayerInputComponent->BindAction("PrimaryUse", IE_Pressed, this, &ADarkestFearCharacter::OnPrimaryUse);
-    PlayerInputComponent->BindAction("SecondaryUse", IE_Pressed, this, &ADarkestFearCharacter::OnSecondaryUse);
+    BindRecordedAction(PlayerInputComponent, "PrimaryUse", IE_Pressed, EDarkestFearInput::PrimaryUse);
+    BindRecordedAction(PlayerInputComponent, "SecondaryUse", IE_Pressed, EDarkestFearInput::SecondaryUse);
+    BindRecordedAction(PlayerInputComponent, "Fire", IE_Pressed, EDarkestFearInput::Fire);
+    BindRecordedAction(PlayerInputComponent, "Fire", IE_Released, EDarkestFearInput::StopFire);
 
     // Bind to Pick Up Item use event
-    PlayerInputComponent->BindAction("PickUpItem", IE_Pressed, this, &ADarkestFearCharacter::PickUpItem);
+    BindRecordedAction(PlayerInputComponent, "PickUpItem", IE_Pressed, EDarkestFearInput::PickUpItem);
 
     // Bind to Select Item Slot @ InvCursor
-    PlayerInputComponent->BindAction("UseItemSlot0", IE_Pressed, this, &ADarkestFearCharacter::OnUseSlot0);
-    PlayerInputComponent->BindAction("UseItemSlot1", IE_Pressed, this, &ADarkestFearCharacter::OnUseSlot1);
-    PlayerInputComponent->BindAction("UseItemSlot2", IE_Pressed, this, &ADarkestFearCharacter::OnUseSlot2);
+    BindRecordedAction(PlayerInputComponent, "UseItemSlot0", IE_Pressed, EDarkestFearInput::UseItemSlot0);
+    BindRecordedAction(PlayerInputComponent, "UseItemSlot1", IE_Pressed, EDarkestFearInput::UseItemSlot1);
+    BindRecordedAction(PlayerInputComponent, "UseItemSlot2", IE_Pressed, EDarkestFearInput::UseItemSlot2);
 
     // Bind to Active item use event
-    PlayerInputComponent->BindAction("UseActiveItem", IE_Pressed, this, &ADarkestFearCharacter::OnUseActiveItem);
+    BindRecordedAction(PlayerInputComponent, "UseActiveItem", IE_Pressed, EDarkestFearInput::UseActiveItem);
 
     // Drop/put item action
-    PlayerInputComponent->BindAction("PlaceItem", IE_Pressed, this, &ADarkestFearCharacter::OnBeginPlace);
-    PlayerInputComponent->BindAction("PlaceItem", IE_Released, this, &ADarkestFearCharacter::OnFinishPlace);
+    BindRecordedAction(PlayerInputComponent, "PlaceItem", IE_Pressed, EDarkestFearInput::BeginPlace);
+    BindRecordedAction(PlayerInputComponent, "PlaceItem", IE_Released, EDarkestFearInput::FinishPlace);
 
     // Mouse Wheel Action
-    PlayerInputComponent->BindAction("MouseWheelUp", IE_Pressed, this, &ADarkestFearCharacter::OnMouseWheelUp);
-    PlayerInputComponent->BindAction("MouseWheelDown", IE_Pressed, this, &ADarkestFearCharacter::OnMouseWheelDown);
+    BindRecordedAction(PlayerInputComponent, "MouseWheelUp", IE_Pressed, EDarkestFearInput::MouseWheelUp);
+    BindRecordedAction(PlayerInputComponent, "MouseWheelDown", IE_Pressed, EDarkestFearInput::MouseWheelDown);
 
     // Enable touchscreen input
     EnableTouchscreenMovement(PlayerInputComponent);
@@ -134,16 +249,77 @@ void ADarkestFearCharacter::SetupPlayerInputComponent(class UInputComponent* Pla
     PlayerInputComponent->BindAction("ResetVR", IE_Pressed, this, &ADarkestFearCharacter::OnResetVR);
 
     // Bind movement events
-    PlayerInputComponent->BindAxis("MoveForward", this, &ADarkestFearCharacter::MoveForward);
-    PlayerInputComponent->BindAxis("MoveRight", this, &ADarkestFearCharacter::MoveRight);
+    BindRecordedAxis(PlayerInputComponent, "MoveForward", EDarkestFearInput::MoveForward);
+    BindRecordedAxis(PlayerInputComponent, "MoveRight", EDarkestFearInput::MoveRight);
 
     // We have 2 versions of the rotation bindings to handle different kinds of devices differently
     // "turn" handles devices that provide an absolute delta, such as a mouse.
     // "turnrate" is for devices that we choose to treat as a rate of change, such as an analog joystick
-    PlayerInputComponent->BindAxis("Turn", this, &APawn::AddControllerYawInput);
-    PlayerInputComponent->BindAxis("TurnRate", this, &ADarkestFearCharacter::TurnAtRate);
-    PlayerInputComponent->BindAxis("LookUp", this, &APawn::AddControllerPitchInput);
-    PlayerInputComponent->BindAxis("LookUpRate", this, &ADarkestFearCharacter::LookUpAtRate);
+    BindRecordedAxis(PlayerInputComponent, "Turn", EDarkestFearInput::Turn);
+    BindRecordedAxis(PlayerInputComponent, "TurnRate", EDarkestFearInput::TurnRate);
+    BindRecordedAxis(PlayerInputComponent, "LookUp", EDarkestFearInput::LookUp);
+    BindRecordedAxis(PlayerInputComponent, "LookUpRate", EDarkestFearInput::LookUpRate);
+}
+
+void ADarkestFearCharacter::BindRecordedAction(UInputComponent* PlayerInputComponent, FName ActionName,
+                                               EInputEvent KeyEvent, EDarkestFearInput Input)
+{
+    FInputActionBinding Binding(ActionName, KeyEvent);
+    Binding.ActionDelegate.GetDelegateForManualSet().BindUObject(this, &ADarkestFearCharacter::OnLiveInput, 1.f, Input);
+    PlayerInputComponent->AddActionBinding(Binding);
+}
+
+void ADarkestFearCharacter::BindRecordedAxis(UInputComponent* PlayerInputComponent, FName AxisName,
+                                             EDarkestFearInput Input)
+{
+    FInputAxisBinding Binding(AxisName);
+    Binding.AxisDelegate.GetDelegateForManualSet().BindUObject(this, &ADarkestFearCharacter::OnLiveInput, Input);
+    PlayerInputComponent->AxisBindings.Add(Binding);
+}
+
+void ADarkestFearCharacter::OnLiveInput(float Value, EDarkestFearInput Input)
+{
+    // While replaying, the recording is the only source of input
+    FInputRecorder* InputRecorder = GetInputRecorder();
+
+    if (InputRecorder != nullptr)
+    {
+        if (InputRecorder->IsReplaying())
+            return;
+
+        InputRecorder->Record(Input, Value);
+    }
+
+    DispatchInput(Input, Value);
+}
+
+void ADarkestFearCharacter::DispatchInput(EDarkestFearInput Input, float Value)
+{
+    switch (Input)
+    {
+    case EDarkestFearInput::Jump: Jump(); break;
+    case EDarkestFearInput::StopJumping: StopJumping(); break;
+    case EDarkestFearInput::PrimaryUse: OnPrimaryUse(); break;
+    case EDarkestFearInput::SecondaryUse: OnSecondaryUse(); break;
+    case EDarkestFearInput::Fire: OnFire(); break;
+    case EDarkestFearInput::StopFire: OnStopFire(); break;
+    case EDarkestFearInput::PickUpItem: PickUpItem(); break;
+    case EDarkestFearInput::UseItemSlot0: OnUseSlot0(); break;
+    case EDarkestFearInput::UseItemSlot1: OnUseSlot1(); break;
+    case EDarkestFearInput::UseItemSlot2: OnUseSlot2(); break;
+    case EDarkestFearInput::UseActiveItem: OnUseActiveItem(); break;
+    case EDarkestFearInput::BeginPlace: OnBeginPlace(); break;
+    case EDarkestFearInput::FinishPlace: OnFinishPlace(); break;
+    case EDarkestFearInput::MouseWheelUp: OnMouseWheelUp(); break;
+    case EDarkestFearInput::MouseWheelDown: OnMouseWheelDown(); break;
+    case EDarkestFearInput::MoveForward: MoveForward(Value); break;
+    case EDarkestFearInput::MoveRight: MoveRight(Value); break;
+    case EDarkestFearInput::Turn: AddControllerYawInput(Value); break;
+    case EDarkestFearInput::TurnRate: TurnAtRate(Value); break;
+    case EDarkestFearInput::LookUp: AddControllerPitchInput(Value); break;
+    case EDarkestFearInput::LookUpRate: LookUpAtRate(Value); break;
+    default: break;
+    }
 }
 
 void ADarkestFearCharacter::OnPrimaryUse()
@@ -152,7 +328,13 @@ void ADarkestFearCharacter::OnPrimaryUse()
 
     if (Item != nullptr)
     {
+        if (!HasAuthority())
+            ServerPrimaryUse(AddPrediction(EItemPrediction::Use, Item), Item,
+                             FirstPersonCameraComponent->GetComponentLocation(),
+                             FirstPersonCameraComponent->GetForwardVector());
+
         Item->Use(this);
+        UDarkestFearEventSubsystem::PushItemEvent(EDarkestFearItemEvent::Used, Item, this);
     }
     else
     {
@@ -168,6 +350,7 @@ void ADarkestFearCharacter::OnSecondaryUse()
     if (Item != nullptr)
     {
         Item->AlternateUse(this);
+        UDarkestFearEventSubsystem::PushItemEvent(EDarkestFearItemEvent::AlternateUsed, Item, this);
     }
     else
     {
@@ -176,19 +359,223 @@ void ADarkestFearCharacter::OnSecondaryUse()
     }
 }
 
+void ADarkestFearCharacter::OnFire()
+{
+    if (ProjectileClass == nullptr)
+        return;
+
+    AutoFire.FireRate = FireRate;
+    AutoFire.PullTrigger();
+}
+
+void ADarkestFearCharacter::OnStopFire()
+{
+    AutoFire.ReleaseTrigger();
+}
+
+void ADarkestFearCharacter::FireShots(float DeltaTime)
+{
+    DARKESTFEAR_ALLOC_SCOPE(Fire);
+
+    const FQuat Aim = GetControlRotation().Quaternion();
+    const FVector MuzzleLocation = GetActorLocation() + Aim.RotateVector(GunOffset);
+
+    // Without last frame's muzzle, every shot leaves from the current one
+    if (LastMuzzleFrame + 1 != GFrameCounter)
+    {
+        LastMuzzleLocation = MuzzleLocation;
+        LastAim = Aim;
+    }
+
+    ShotAges.Reset();
+
+    if (AutoFire.Advance(DeltaTime, ShotAges) > 0 && ProjectileClass != nullptr)
+    {
+        Shots.Reset();
+
+        for (const float Age : ShotAges)
+        {
+            const float Alpha = DeltaTime > 0.f ? 1.f - Age / DeltaTime : 1.f;
+
+            FDarkestFearShot& Shot = Shots.AddDefaulted_GetRef();
+            Shot.ShotId = NextShotId++;
+            Shot.Location = FMath::Lerp(LastMuzzleLocation, MuzzleLocation, Alpha);
+            Shot.Direction = FQuat::Slerp(LastAim, Aim, Alpha).GetForwardVector();
+            Shot.Age = Age;
+        }
+
+        if (HasAuthority())
+        {
+            DARKESTFEAR_ALLOC_EXCLUDE();
+            ADarkestFearProjectile::SpawnBatch(GetWorld(), ProjectileClass, this, Shots, false);
+            MulticastShotsFired(Shots);
+        }
+        else
+        {
+            // Forget predictions whose projectile already died without hearing back from the server
+            for (auto It = PredictedProjectiles.CreateIterator(); It; ++It)
+            {
+                if (!It->Value.IsValid())
+                    It.RemoveCurrent();
+            }
+
+            // Only needed until the predictions are registered below
+            TArray<ADarkestFearProjectile*, FDarkestFearFrameAllocator> SpawnedProjectiles;
+
+            {
+                // Spawning actors is the engine's business, the counted part is everything around it
+                DARKESTFEAR_ALLOC_EXCLUDE();
+                ADarkestFearProjectile::SpawnBatch(GetWorld(), ProjectileClass, this, Shots, true, &SpawnedProjectiles);
+            }
+
+            for (int32 Index = 0; Index < Shots.Num(); Index++)
+            {
+                if (SpawnedProjectiles[Index] != nullptr)
+                    PredictedProjectiles.Add(Shots[Index].ShotId, SpawnedProjectiles[Index]);
+            }
+
+            DARKESTFEAR_ALLOC_EXCLUDE();
+            ServerFire(Shots);
+        }
+
+        // However many shots the frame fired, they sound and animate once
+        DARKESTFEAR_ALLOC_EXCLUDE();
+        PlayFireEffects();
+    }
+
+    LastMuzzleLocation = MuzzleLocation;
+    LastAim = Aim;
+    LastMuzzleFrame = GFrameCounter;
+}
+
+void ADarkestFearCharacter::PlayFireEffects()
+{
+    if (FireSound != nullptr)
+    {
+        UGameplayStatics::PlaySoundAtLocation(this, FireSound, GetActorLocation());
+    }
+
+    if (FireAnimation != nullptr)
+    {
+        UAnimInstance* AnimInstance = Mesh1P->GetAnimInstance();
+
+        if (AnimInstance != nullptr)
+            AnimInstance->Montage_Play(FireAnimation, 1.f);
+    }
+}
+
+bool ADarkestFearCharacter::ServerFire_Validate(const TArray<FDarkestFearShot>& ClientShots)
+{
+    if (ClientShots.Num() > FDarkestFearAutoFire::MaxShotsPerFrame)
+        return false;
+
+    for (const FDarkestFearShot& Shot : ClientShots)
+    {
+        if (Shot.Location.ContainsNaN() || Shot.Direction.ContainsNaN() || FMath::IsNaN(Shot.Age))
+            return false;
+    }
+
+    return true;
+}
+
+void ADarkestFearCharacter::ServerFire_Implementation(const TArray<FDarkestFearShot>& ClientShots)
+{
+    Shots.Reset();
+    RejectedShotIds.Reset();
+
+    // Whatever the client's batches add up to, no more than FireRate goes through. The rest is rolled back
+    const int32 NumAllowed = ShotBudget.Consume(GetWorld()->GetTimeSeconds(), FireRate, ClientShots.Num());
+
+    for (int32 Index = NumAllowed; Index < ClientShots.Num(); Index++)
+        RejectedShotIds.Add(ClientShots[Index].ShotId);
+
+    for (const FDarkestFearShot& ClientShot : MakeArrayView(ClientShots.GetData(), NumAllowed))
+    {
+        // Aim and timing are the client's, but the origin is always our own. Shots from too far away are refused outright
+        const FRotator SpawnRotation = ClientShot.Direction.Rotation();
+        const FVector SpawnLocation = GetActorLocation() + SpawnRotation.RotateVector(GunOffset);
+
+        if (FVector::DistSquared(SpawnLocation, ClientShot.Location) > FMath::Square(MaxShotOriginError))
+        {
+            RejectedShotIds.Add(ClientShot.ShotId);
+            continue;
+        }
+
+        FDarkestFearShot& Shot = Shots.Add_GetRef(ClientShot);
+        Shot.Location = SpawnLocation;
+        Shot.Age = FMath::Clamp(ClientShot.Age, 0.f, FDarkestFearAutoFire::MaxShotAge);
+    }
+
+    if (RejectedShotIds.Num() > 0)
+        ClientRejectShots(RejectedShotIds);
+
+    if (Shots.Num() == 0)
+        return;
+
+    ADarkestFearProjectile::SpawnBatch(GetWorld(), ProjectileClass, this, Shots, false);
+    ClientConfirmShots(Shots);
+    MulticastShotsFired(Shots);
+}
+
+void ADarkestFearCharacter::ClientConfirmShots_Implementation(const TArray<FDarkestFearShot>& ConfirmedShots)
+{
+    for (const FDarkestFearShot& Shot : ConfirmedShots)
+    {
+        TWeakObjectPtr<ADarkestFearProjectile> Predicted;
+
+        if (PredictedProjectiles.RemoveAndCopyValue(Shot.ShotId, Predicted) && Predicted.IsValid())
+        {
+            Predicted->CorrectTowards(Shot.Location, Shot.Direction);
+        }
+    }
+}
+
+void ADarkestFearCharacter::ClientRejectShots_Implementation(const TArray<uint16>& ShotIds)
+{
+    for (const uint16 ShotId : ShotIds)
+    {
+        TWeakObjectPtr<ADarkestFearProjectile> Predicted;
+
+        if (PredictedProjectiles.RemoveAndCopyValue(ShotId, Predicted) && Predicted.IsValid())
+        {
+            Predicted->Destroy();
+        }
+    }
+}
+
+void ADarkestFearCharacter::MulticastShotsFired_Implementation(const TArray<FDarkestFearShot>& FiredShots)
+{
+    // The server already has the real projectiles and the owner its predictions
+    if (HasAuthority() || IsLocallyControlled() || FiredShots.Num() == 0)
+        return;
+
+    ADarkestFearProjectile::SpawnBatch(GetWorld(), ProjectileClass, this, FiredShots, true);
+
+    if (FireSound != nullptr)
+    {
+        UGameplayStatics::PlaySoundAtLocation(this, FireSound, FiredShots.Last().Location);
+    }
+}
+
 void ADarkestFearCharacter::PickUpItem()
 {
+    DARKESTFEAR_ALLOC_SCOPE(PickUp);
+
     AItem* Item = Cast<AItem>(ADarkestFearCharacter::TraceLine().GetActor());
 
     if (Item != nullptr)
     {
-        AItem* PickedUpItem = Item->Pickup(this);
-
-        if (PickedUpItem != nullptr)
+        // The prediction has to see the item where it was before it goes into the hand
+        if (!HasAuthority() && Item->bCanPickup)
         {
-            Inventory.Emplace(PickedUpItem);
-            SetActiveItem(Inventory.Num() - 1);
+            const uint16 Key = AddPrediction(EItemPrediction::PickUp, Item);
+
+            DARKESTFEAR_ALLOC_EXCLUDE();
+            ServerPickUpItem(Key, Item, FirstPersonCameraComponent->GetComponentLocation(),
+                             FirstPersonCameraComponent->GetForwardVector());
         }
+
+        ApplyPickUp(Item);
     }
     else
     {
@@ -197,12 +584,233 @@ void ADarkestFearCharacter::PickUpItem()
     }
 }
 
+bool ADarkestFearCharacter::ApplyPickUp(AItem* Item)
+{
+    AItem* PickedUpItem;
+
+    {
+        // Attaching to the hand goes through the engine's attachment and overlap updates
+        DARKESTFEAR_ALLOC_EXCLUDE();
+        PickedUpItem = Item->Pickup(this);
+    }
+
+    if (PickedUpItem == nullptr)
+        return false;
+
+    DARKESTFEAR_LLM_SCOPE(STAT_DarkestFearInventoryLLM);
+
+    Inventory.Emplace(PickedUpItem);
+    SetActiveItem(Inventory.Num() - 1);
+
+    return true;
+}
+
+bool ADarkestFearCharacter::IsRemoteInteractionValid(AItem* Item, const FVector& Start, const FVector& Direction)
+{
+    // Somebody else got to it first
+    if (Item == nullptr || Item->GetAttachParentActor() != nullptr)
+        return false;
+
+    // The trace has to start at our camera, only the item positions are judged in the client's past
+    if (FVector::DistSquared(Start, FirstPersonCameraComponent->GetComponentLocation()) > FMath::Square(MaxShotOriginError))
+        return false;
+
+    UItemLagCompensationSubsystem* LagCompensation = GetWorld()->GetSubsystem<UItemLagCompensationSubsystem>();
+
+    if (LagCompensation == nullptr)
+        return false;
+
+    // ExactPing is a round trip: the request took half of it to arrive, and what the client saw was half old
+    const float RewindSeconds = GetPlayerState() != nullptr ? GetPlayerState()->ExactPing * 0.001f : 0.f;
+
+    return LagCompensation->ValidateTrace(Item, Start, Start + Direction * UseLineDistance, RewindSeconds);
+}
+
+bool ADarkestFearCharacter::ServerPickUpItem_Validate(uint16 Key, AItem* Item, FVector_NetQuantize10 Start,
+                                                      FVector_NetQuantizeNormal Direction)
+{
+    return !Start.ContainsNaN() && !Direction.ContainsNaN();
+}
+
+void ADarkestFearCharacter::ServerPickUpItem_Implementation(uint16 Key, AItem* Item, FVector_NetQuantize10 Start,
+                                                            FVector_NetQuantizeNormal Direction)
+{
+    const bool bAccepted = IsRemoteInteractionValid(Item, Start, Direction) && ApplyPickUp(Item);
+
+    if (bAccepted)
+        FItemPredictionStats::Get().PickUps++;
+
+    ResolvePrediction(Key, bAccepted);
+}
+
+bool ADarkestFearCharacter::ServerPrimaryUse_Validate(uint16 Key, AItem* Item, FVector_NetQuantize10 Start,
+                                                      FVector_NetQuantizeNormal Direction)
+{
+    return !Start.ContainsNaN() && !Direction.ContainsNaN();
+}
+
+void ADarkestFearCharacter::ServerPrimaryUse_Implementation(uint16 Key, AItem* Item, FVector_NetQuantize10 Start,
+                                                            FVector_NetQuantizeNormal Direction)
+{
+    const bool bAccepted = IsRemoteInteractionValid(Item, Start, Direction);
+
+    if (bAccepted)
+    {
+        Item->Use(this);
+        UDarkestFearEventSubsystem::PushItemEvent(EDarkestFearItemEvent::Used, Item, this);
+    }
+
+    ResolvePrediction(Key, bAccepted);
+}
+
+bool ADarkestFearCharacter::ServerUseActiveItem_Validate(uint16 Key, AItem* Item)
+{
+    return true;
+}
+
+void ADarkestFearCharacter::ServerUseActiveItem_Implementation(uint16 Key, AItem* Item)
+{
+    // Slot selection is local, any item we hold can be the client's active one
+    const bool bAccepted = Item != nullptr && Inventory.Contains(Item);
+
+    if (bAccepted)
+    {
+        Item->Use(this);
+        UDarkestFearEventSubsystem::PushItemEvent(EDarkestFearItemEvent::Used, Item, this);
+    }
+
+    ResolvePrediction(Key, bAccepted);
+}
+
+bool ADarkestFearCharacter::ServerPlaceItem_Validate(uint16 Key, AItem* Item, FVector_NetQuantize10 Location,
+                                                     FRotator Rotation)
+{
+    return !Location.ContainsNaN() && !Rotation.ContainsNaN();
+}
+
+void ADarkestFearCharacter::ServerPlaceItem_Implementation(uint16 Key, AItem* Item, FVector_NetQuantize10 Location,
+                                                           FRotator Rotation)
+{
+    const float MaxDistance = UseLineDistance + MaxShotOriginError;
+    const bool bAccepted = Item != nullptr && Inventory.Contains(Item) &&
+        FVector::DistSquared(Location, FirstPersonCameraComponent->GetComponentLocation()) <= FMath::Square(MaxDistance);
+
+    if (bAccepted)
+        ApplyPlace(Item, Location, Rotation);
+
+    ResolvePrediction(Key, bAccepted);
+}
+
+uint16 ADarkestFearCharacter::AddPrediction(EItemPrediction Type, AItem* Item)
+{
+    FItemPredictionStats::Get().Predicted++;
+
+    PendingPredictions.Add({NextPredictionKey, Type, Item, Item->GetActorTransform(), ActiveItem});
+    return NextPredictionKey++;
+}
+
+void ADarkestFearCharacter::RollbackPrediction(const FItemPrediction& Prediction)
+{
+    AItem* Item = Prediction.Item.Get();
+
+    if (Item == nullptr)
+        return;
+
+    switch (Prediction.Type)
+    {
+    case EItemPrediction::PickUp:
+        // Back where it was found
+        Inventory.Remove(Item);
+        Item->DetachFromActor(FDetachmentTransformRules::KeepWorldTransform);
+        Item->SetActorTransform(Prediction.ItemTransform);
+        Item->SetActorHiddenInGame(false);
+        Item->OnPlaced();
+        RestoreActiveItem(Prediction.PreviousActiveItem.Get());
+        break;
+
+    case EItemPrediction::Use:
+        Item->UndoUse(this);
+        break;
+
+    case EItemPrediction::Place:
+        // Back in the hand it was placed from
+        if (Item->Pickup(this) != nullptr)
+            Inventory.Emplace(Item);
+
+        RestoreActiveItem(Prediction.PreviousActiveItem.Get());
+        break;
+    }
+
+    UDarkestFearEventSubsystem::PushItemEvent(EDarkestFearItemEvent::RolledBack, Item, this);
+}
+
+void ADarkestFearCharacter::ResolvePrediction(uint16 Key, bool bAccepted)
+{
+    if (bAccepted)
+    {
+        FItemPredictionStats::Get().Accepted++;
+        ClientConfirmPrediction(Key);
+    }
+    else
+    {
+        FItemPredictionStats::Get().Rejected++;
+        ClientRejectPrediction(Key);
+    }
+}
+
+void ADarkestFearCharacter::ClientConfirmPrediction_Implementation(uint16 Key)
+{
+    const int32 Index = PendingPredictions.IndexOfByPredicate([Key](const FItemPrediction& Prediction)
+    {
+        return Prediction.Key == Key;
+    });
+
+    // Not found when it was already rolled back because an earlier action on the same item was rejected
+    if (Index != INDEX_NONE)
+    {
+        FItemPredictionStats::Get().Confirmed++;
+        PendingPredictions.RemoveAt(Index);
+    }
+}
+
+void ADarkestFearCharacter::ClientRejectPrediction_Implementation(uint16 Key)
+{
+    const int32 Index = PendingPredictions.IndexOfByPredicate([Key](const FItemPrediction& Prediction)
+    {
+        return Prediction.Key == Key;
+    });
+
+    if (Index == INDEX_NONE)
+        return;
+
+    const double StartTime = FPlatformTime::Seconds();
+    const TWeakObjectPtr<AItem> Item = PendingPredictions[Index].Item;
+
+    // Newest first, so every rollback starts from the state its prediction left behind
+    for (int32 Later = PendingPredictions.Num() - 1; Later >= Index; Later--)
+    {
+        if (Later == Index || PendingPredictions[Later].Item == Item)
+        {
+            RollbackPrediction(PendingPredictions[Later]);
+            PendingPredictions.RemoveAt(Later);
+        }
+    }
+
+    const double RollbackSeconds = FPlatformTime::Seconds() - StartTime;
+
+    FItemPredictionStats& Stats = FItemPredictionStats::Get();
+    Stats.RolledBack++;
+    Stats.RollbackSeconds += RollbackSeconds;
+    Stats.MaxRollbackSeconds = FMath::Max(Stats.MaxRollbackSeconds, RollbackSeconds);
+}
+
 void ADarkestFearCharacter::OnBeginPlace()
 {
     bIsPlacing = true;
 
     if (ActiveItem != nullptr)
     {
+        GetOrCreateItemGhost();
         ActiveItemGhost->SetStaticMesh(ActiveItem->MeshComponent->GetStaticMesh());
         ActiveItemGhost->SetWorldScale3D(FVector(0.05f, 0.05f, 0.05f));
         ActiveItemGhost->SetRelativeScale3D(FVector(0.05f, 0.05f, 0.05f));
@@ -220,37 +828,61 @@ void ADarkestFearCharacter::OnBeginPlace()
 
 void ADarkestFearCharacter::DisplayPlacementPivot()
 {
-    if (ActiveItem == nullptr)
+    DARKESTFEAR_ALLOC_SCOPE(Placement);
+
+    if (ActiveItem == nullptr || ActiveItemGhost == nullptr)
         return;
 
-    FString HitPointInfo;
-    const FHitResult HitResult = ADarkestFearCharacter::TraceLine();
+    // The ghost only needs the answer by the end of the frame, so the trace joins the batched scene queries
+    UDarkestFearSceneQuerySubsystem* SceneQuery = GetWorld()->GetSubsystem<UDarkestFearSceneQuerySubsystem>();
+
+    if (SceneQuery == nullptr)
+    {
+        OnPlacementPivotTraced(TraceLine());
+        return;
+    }
+
+    // Last frame's trace is read back by handle: binding a callback every frame would allocate every frame
+    if (const FDarkestFearQueryResult* Result = SceneQuery->GetResult(PlacementQueryHandle))
+        OnPlacementPivotTraced(Result->Hit);
+
+    FVector StartPoint;
+    FVector EndPoint;
+    GetUseLine(StartPoint, EndPoint);
+
+    PlacementQueryHandle = SceneQuery->LineTrace(StartPoint, EndPoint, ECC_Visibility, GetUseTraceParams());
+}
+
+void ADarkestFearCharacter::OnPlacementPivotTraced(const FHitResult& HitResult)
+{
+    // Placement may have ended between submitting the trace and getting its result
+    if (!bIsPlacing || ActiveItem == nullptr || ActiveItemGhost == nullptr)
+        return;
 
     if (HitResult.Location.IsZero())
     {
-        HitPointInfo = "Nothing";
         ActiveItemGhost->SetHiddenInGame(true);
     }
     else
     {
         ActiveItemGhost->SetHiddenInGame(false);
-        HitPointInfo = TEXT(
-            "X: " + FString::FromInt(HitResult.Location.X) +
-            ", Y: " + FString::FromInt(HitResult.Location.Y) +
-            " , Z: " + FString::FromInt(HitResult.Location.Z));
-
-        if (ActiveItemGhost != nullptr)
-        {
-            ActiveItemGhost->SetWorldTransform(FTransform(HitResult.Location));
-            ActiveItemGhost->SetWorldRotation(GhostMeshPivotRotation);
-        }
+        ActiveItemGhost->SetWorldTransform(FTransform(HitResult.Location));
+        ActiveItemGhost->SetWorldRotation(GhostMeshPivotRotation);
     }
 
+    if (CVarShowPlacementDebug.GetValueOnGameThread() == 0)
+        return;
 
-    GEngine->AddOnScreenDebugMessage(-1, GetWorld()->GetDeltaSeconds(), FColor::Yellow,
-                                     FString::Printf(TEXT("You are facing: %s"),
-                                                     *HitPointInfo
-                                     ));
+    // AddOnScreenDebugMessage copies the text into an FString anyway, the cvar above is what keeps the formatting
+    // off the heap on every placement frame
+    const FString Message = HitResult.Location.IsZero()
+                                ? FString(TEXT("You are facing: Nothing"))
+                                : FString::Printf(TEXT("You are facing: X: %d, Y: %d, Z: %d"),
+                                                  FMath::TruncToInt(HitResult.Location.X),
+                                                  FMath::TruncToInt(HitResult.Location.Y),
+                                                  FMath::TruncToInt(HitResult.Location.Z));
+
+    GEngine->AddOnScreenDebugMessage(-1, GetWorld()->GetDeltaSeconds(), FColor::Yellow, Message);
 }
 
 void ADarkestFearCharacter::OnFinishPlace()
@@ -262,28 +894,42 @@ void ADarkestFearCharacter::OnFinishPlace()
     {
         if (ActiveItem != nullptr)
         {
-            ActiveItem->DetachFromActor(FDetachmentTransformRules::KeepWorldTransform);
-            // ActiveItem->SetActorLocation(HitResult.Location); // TODO: Must be able to change rotation on mousewheel
-            ActiveItem->SetActorTransform(
-                FTransform(FVector(HitResult.Location.X, HitResult.Location.Y, HitResult.Location.Z)));
-            ActiveItem->SetActorRotation(GhostMeshPivotRotation - ActiveItem->MeshComponent->GetRelativeRotation());
+            // TODO: Must be able to change rotation on mousewheel
+            const FRotator Rotation = GhostMeshPivotRotation - ActiveItem->MeshComponent->GetRelativeRotation();
 
-            ActiveItemGhost->SetHiddenInGame(true);
+            if (!HasAuthority())
+                ServerPlaceItem(AddPrediction(EItemPrediction::Place, ActiveItem), ActiveItem, HitResult.Location, Rotation);
 
-            Inventory.Remove(ActiveItem);
+            ApplyPlace(ActiveItem, HitResult.Location, Rotation);
 
-            if (Inventory.Num() != 0)
-                SetActiveItem(Inventory.Num() - 1);
-            else
-                ActiveItem = nullptr;
+            if (ActiveItemGhost != nullptr)
+                ActiveItemGhost->SetHiddenInGame(true);
         }
     }
-    else
+    else if (ActiveItemGhost != nullptr)
     {
         ActiveItemGhost->SetHiddenInGame(true);
     }
 }
 
+void ADarkestFearCharacter::ApplyPlace(AItem* Item, const FVector& Location, const FRotator& Rotation)
+{
+    Item->DetachFromActor(FDetachmentTransformRules::KeepWorldTransform);
+    Item->SetActorTransform(FTransform(Rotation, Location));
+    Item->OnPlaced();
+
+    Inventory.Remove(Item);
+    UDarkestFearEventSubsystem::PushItemEvent(EDarkestFearItemEvent::Placed, Item, this);
+
+    if (ActiveItem != Item)
+        return;
+
+    if (Inventory.Num() != 0)
+        SetActiveItem(Inventory.Num() - 1);
+    else
+        ActiveItem = nullptr;
+}
+
 void ADarkestFearCharacter::OnMouseWheelUp()
 {
     GhostMeshPivotRotation.Add(0.0f, -10.f, 0.0f);
@@ -300,6 +946,7 @@ void ADarkestFearCharacter::SetActiveItem(int8 Slot)
     {
         ActiveItem = Inventory[Slot];
         InvCursor = Slot;
+        UDarkestFearEventSubsystem::PushItemEvent(EDarkestFearItemEvent::Equipped, ActiveItem, this, Slot);
         // todo: Adicionar um struct ao Item contendo um int8 chamado SlottedIn ao invés de usar uma variável cursor??
 
         for (int i = 0; i < Inventory.Num(); i++)
@@ -312,6 +959,29 @@ void ADarkestFearCharacter::SetActiveItem(int8 Slot)
     }
 }
 
+void ADarkestFearCharacter::AdoptInventory(const TArray<AItem*>& Items, int8 ActiveSlot)
+{
+    for (AItem* Item : Items)
+    {
+        if (Item != nullptr && Item->Pickup(this) != nullptr)
+            Inventory.Emplace(Item);
+    }
+
+    SetActiveItem(FMath::Min<int8>(ActiveSlot, Inventory.Num() - 1));
+}
+
+void ADarkestFearCharacter::RestoreActiveItem(AItem* Item)
+{
+    const int32 Slot = Inventory.Find(Item);
+
+    if (Slot != INDEX_NONE)
+        SetActiveItem(Slot);
+    else if (Inventory.Num() != 0)
+        SetActiveItem(Inventory.Num() - 1);
+    else
+        ActiveItem = nullptr;
+}
+
 void ADarkestFearCharacter::OnUseSlot0()
 {
     SetActiveItem(0);
@@ -329,8 +999,14 @@ void ADarkestFearCharacter::OnUseSlot2()
 
 void ADarkestFearCharacter::OnUseActiveItem()
 {
-    if (ActiveItem != nullptr)
-        ActiveItem->Use(this);
+    if (ActiveItem == nullptr)
+        return;
+
+    if (!HasAuthority())
+        ServerUseActiveItem(AddPrediction(EItemPrediction::Use, ActiveItem), ActiveItem);
+
+    ActiveItem->Use(this);
+    UDarkestFearEventSubsystem::PushItemEvent(EDarkestFearItemEvent::Used, ActiveItem, this);
 }
 
 void ADarkestFearCharacter::OnResetVR()
@@ -346,7 +1022,8 @@ void ADarkestFearCharacter::BeginTouch(const ETouchIndex::Type FingerIndex, cons
     }
     if ((FingerIndex == TouchItem.FingerIndex) && (TouchItem.bMoved == false))
     {
-        OnPrimaryUse();
+        // A tap is the touch screen's PrimaryUse, recorded and replayed like the bound one
+        OnLiveInput(1.f, EDarkestFearInput::PrimaryUse);
     }
     TouchItem.bIsPressed = true;
     TouchItem.FingerIndex = FingerIndex;
@@ -451,13 +1128,18 @@ bool ADarkestFearCharacter::EnableTouchscreenMovement(class UInputComponent* Pla
 }
 
 
+void ADarkestFearCharacter::GetUseLine(FVector& OutStart, FVector& OutEnd) const
+{
+    OutStart = GetFirstPersonCameraComponent()->GetComponentLocation();
+    OutEnd = (GetFirstPersonCameraComponent()->GetForwardVector() * UseLineDistance) + OutStart;
+}
+
 FHitResult ADarkestFearCharacter::TraceLine()
 {
     FHitResult OutHit;
-    const FVector StartPoint = GetFirstPersonCameraComponent()->GetComponentLocation();
-    const FVector ForwardVec = GetFirstPersonCameraComponent()->GetForwardVector();
-    const FVector EndPoint = ((ForwardVec * UseLineDistance) + StartPoint);
-    FCollisionQueryParams CollisionQueryParams;
+    FVector StartPoint;
+    FVector EndPoint;
+    GetUseLine(StartPoint, EndPoint);
 
     // DrawDebugLine(GetWorld(), StartPoint, EndPoint, FColor, false, 1, 0, 1);
 
@@ -466,7 +1148,27 @@ FHitResult ADarkestFearCharacter::TraceLine()
         StartPoint,
         EndPoint,
         ECC_Visibility,
-        CollisionQueryParams);
+        GetUseTraceParams());
 
     return OutHit;
 }
+
+FItemPredictionStats& FItemPredictionStats::Get()
+{
+    static FItemPredictionStats Stats;
+    return Stats;
+}
+
+static FAutoConsoleCommandWithOutputDevice PredictionStatsCommand(
+    TEXT("DarkestFear.PredictionStats"),
+    TEXT("Logs how many predicted pickups, uses and placements were confirmed or rolled back, and what rollbacks cost"),
+    FConsoleCommandWithOutputDeviceDelegate::CreateLambda([](FOutputDevice& Ar)
+    {
+        const FItemPredictionStats& Stats = FItemPredictionStats::Get();
+
+        Ar.Logf(TEXT("Client: %d predicted, %d confirmed, %d rolled back (%.2f%% mispredicted), rollback avg %.3f ms, max %.3f ms"),
+                Stats.Predicted, Stats.Confirmed, Stats.RolledBack, 100.f * Stats.RolledBack / FMath::Max(Stats.Predicted, 1),
+                Stats.RolledBack > 0 ? Stats.RollbackSeconds * 1000.0 / Stats.RolledBack : 0.0, Stats.MaxRollbackSeconds * 1000.0);
+        Ar.Logf(TEXT("Server: %d accepted, %d rejected (%.2f%%), %d pickups"), Stats.Accepted, Stats.Rejected,
+                100.f * Stats.Rejected / FMath::Max(Stats.Accepted + Stats.Rejected, 1), Stats.PickUps);
+    }));
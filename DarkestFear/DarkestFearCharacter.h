@@ -6,10 +6,35 @@
 
 
 #include "GameFramework/Character.h"
+#include "DarkestFearAutoFire.h"
+#include "InputRecorder.h"
 #include "DarkestFearCharacter.generated.h"
 
 class UInputComponent;
 
+/**
+ * Counters of the client-predicted inventory actions. Clients count predictions and rollbacks, the server counts
+ * the verdicts it sends. See DarkestFear.PredictionStats
+ */
+struct FItemPredictionStats
+{
+    // Client side
+    int32 Predicted = 0;
+    int32 Confirmed = 0;
+    int32 RolledBack = 0;
+    double RollbackSeconds = 0.0;
+    double MaxRollbackSeconds = 0.0;
+
+    // Server side
+    int32 Accepted = 0;
+    int32 Rejected = 0;
+
+    /** Accepted pickups, the items that really changed hands */
+    int32 PickUps = 0;
+
+    static FItemPredictionStats& Get();
+};
+
 UCLASS(config=Game)
 class ADarkestFearCharacter : public ACharacter
 {
@@ -23,12 +48,12 @@ class ADarkestFearCharacter : public ACharacter
     UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = Camera, meta = (AllowPrivateAccess = "true"))
     class UCameraComponent* FirstPersonCameraComponent;
 
-    /** Motion controller (right hand) */
-    UPROPERTY(VisibleAnywhere, BlueprintReadOnly, meta = (AllowPrivateAccess = "true"))
+    /** Motion controller (right hand). Only created when an HMD is enabled */
+    UPROPERTY(Transient, VisibleInstanceOnly, BlueprintReadOnly, meta = (AllowPrivateAccess = "true"))
     class UMotionControllerComponent* R_MotionController;
 
-    /** Motion controller (left hand) */
-    UPROPERTY(VisibleAnywhere, BlueprintReadOnly, meta = (AllowPrivateAccess = "true"))
+    /** Motion controller (left hand). Only created when an HMD is enabled */
+    UPROPERTY(Transient, VisibleInstanceOnly, BlueprintReadOnly, meta = (AllowPrivateAccess = "true"))
     class UMotionControllerComponent* L_MotionController;
 
 public:
@@ -73,6 +98,14 @@ public:
     UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Gameplay)
     class UAnimMontage* FireAnimation;
 
+    /** Shots per second while Fire is held, 0 fires a single shot per press. Fire sound and animation play once a frame */
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category=Projectile)
+    float FireRate;
+
+    /** How far a client's shot or use trace origin may be from the server's view of the character before it is rejected */
+    UPROPERTY(EditDefaultsOnly, Category=Projectile)
+    float MaxShotOriginError;
+
     /** Whether to use motion controller location for aiming. */
     UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Gameplay)
     uint32 bUsingMotionControllers : 1;
@@ -81,8 +114,8 @@ public:
     UPROPERTY(EditInstanceOnly, Category="General")
     TArray<class AItem*> Inventory;
 
-    /** Player has a ghost mesh used as a pivot for item placement */
-    UPROPERTY(EditAnywhere)
+    /** Player has a ghost mesh used as a pivot for item placement. Created on first placement, then reused */
+    UPROPERTY(Transient, VisibleInstanceOnly)
     UStaticMeshComponent* ActiveItemGhost;
 
     // DEBUG TESTING
@@ -94,6 +127,12 @@ public:
 
 protected:
 
+    /** Creates and registers both motion controllers. Only called when an HMD is active */
+    void CreateMotionControllers();
+
+    /** Returns the placement ghost mesh, creating it the first time placement starts */
+    UStaticMeshComponent* GetOrCreateItemGhost();
+
     /** Resets HMD orientation and position in VR. */
     void OnResetVR();
 
@@ -143,8 +182,22 @@ protected:
 
     // Secondary Use Action
     void OnSecondaryUse();
+
+    /** Pulls the trigger, shots are fired from Tick by FireShots */
+    void OnFire();
+
+    /** Releases the trigger */
+    void OnStopFire();
     // End of APawn interface
 
+    /** Binds an action/axis mapping so it is routed through DispatchInput and can be recorded */
+    void BindRecordedAction(UInputComponent* PlayerInputComponent, FName ActionName, EInputEvent KeyEvent,
+                            EDarkestFearInput Input);
+    void BindRecordedAxis(UInputComponent* PlayerInputComponent, FName AxisName, EDarkestFearInput Input);
+
+    /** Receives player input, recording it before dispatching */
+    void OnLiveInput(float Value, EDarkestFearInput Input);
+
     /* 
      * Configures input for touchscreen devices if there is a valid touch interface for doing so 
      *
@@ -159,6 +212,15 @@ public:
     /** Returns FirstPersonCameraComponent subobject **/
     FORCEINLINE class UCameraComponent* GetFirstPersonCameraComponent() const { return FirstPersonCameraComponent; }
 
+    /** Runs the handler of a live, replayed or bot input */
+    void DispatchInput(EDarkestFearInput Input, float Value);
+
+    /** Inventory slot of ActiveItem */
+    int8 GetActiveSlot() const { return InvCursor; }
+
+    /** Puts items that travelled with the player from the previous map back in the hand, see ADarkestFearPlayerController */
+    void AdoptInventory(const TArray<class AItem*>& Items, int8 ActiveSlot);
+
 private:
     // Tells us if the player is performing a place item action
     bool bIsPlacing;
@@ -173,12 +235,128 @@ private:
 
     FHitResult TraceLine();
 
+    // Camera-forward segment used by every use/pickup/placement trace
+    void GetUseLine(FVector& OutStart, FVector& OutEnd) const;
+
+    // The game's input recorder if this is the local player's character, see -RecordInput / -ReplayInput
+    FInputRecorder* GetInputRecorder() const;
+
+    // Reused every replayed frame
+    TArray<FRecordedInput> ReplayedInputs;
+
+    // Next shot ID handed out by OnFire, used to match predicted and authoritative projectiles
+    uint16 NextShotId;
+
+    // Locally predicted projectiles waiting for the server to confirm or reject them
+    TMap<uint16, TWeakObjectPtr<class ADarkestFearProjectile>> PredictedProjectiles;
+
+    // Trigger timing of OnFire/OnStopFire, advanced every frame by FireShots
+    FDarkestFearAutoFire AutoFire;
+
+    // Muzzle at the end of the last frame, shots due during this one are placed between it and the current one
+    FVector LastMuzzleLocation;
+    FQuat LastAim;
+    uint64 LastMuzzleFrame;
+
+    // Server side: keeps what the owning client fires within FireRate
+    FDarkestFearShotBudget ShotBudget;
+
+    // Reused every frame that fires. Shots and RejectedShotIds are what the fire RPCs send, so they stay plain arrays
+    TArray<float> ShotAges;
+    TArray<FDarkestFearShot> Shots;
+    TArray<uint16> RejectedShotIds;
+
+    // Fires every shot due this frame as one batch: one spawn pass, one RPC, one sound and animation
+    void FireShots(float DeltaTime);
+    void PlayFireEffects();
+
+    UFUNCTION(Server, Reliable, WithValidation)
+    void ServerFire(const TArray<FDarkestFearShot>& ClientShots);
+
+    UFUNCTION(Client, Unreliable)
+    void ClientConfirmShots(const TArray<FDarkestFearShot>& ConfirmedShots);
+
+    // Every shot of a ServerFire batch the server refused, in one reliable RPC
+    UFUNCTION(Client, Reliable)
+    void ClientRejectShots(const TArray<uint16>& ShotIds);
+
+    // Lets simulated proxies show shots fired by other players
+    UFUNCTION(NetMulticast, Unreliable)
+    void MulticastShotsFired(const TArray<FDarkestFearShot>& FiredShots);
+
     // Sets the currently equipped/active item based on a cursor/selector integer
     void SetActiveItem(int8 Slot);
 
+    // Makes Item active again if it is still in the inventory, otherwise the last item
+    void RestoreActiveItem(class AItem* Item);
+
     // Reserved action for picking up a pickupable item
     void PickUpItem();
 
+    // Moves an item into the inventory and makes it active. Returns false if the item can't be picked up
+    bool ApplyPickUp(class AItem* Item);
+
+    // Puts an inventory item down in the world
+    void ApplyPlace(class AItem* Item, const FVector& Location, const FRotator& Rotation);
+
+    /*
+     * Clients apply pickups, uses and placements right away and tag each with a prediction key. The server answers
+     * every key with a confirmation or a rejection; a rejected action is rolled back together with every later
+     * pending action on the same item, since those were predicted on top of it.
+     */
+    enum class EItemPrediction : uint8
+    {
+        PickUp,
+        Use,
+        Place
+    };
+
+    struct FItemPrediction
+    {
+        uint16 Key;
+        EItemPrediction Type;
+        TWeakObjectPtr<class AItem> Item;
+
+        // Item transform before a predicted pickup, so a rejected one can put it back
+        FTransform ItemTransform;
+
+        // Active item before the prediction
+        TWeakObjectPtr<class AItem> PreviousActiveItem;
+    };
+
+    // Next key handed out by AddPrediction
+    uint16 NextPredictionKey;
+
+    // Predictions waiting for the server's verdict, oldest first
+    TArray<FItemPrediction> PendingPredictions;
+
+    uint16 AddPrediction(EItemPrediction Type, class AItem* Item);
+    void RollbackPrediction(const FItemPrediction& Prediction);
+
+    // Counts and sends the server's verdict on a client's prediction
+    void ResolvePrediction(uint16 Key, bool bAccepted);
+
+    UFUNCTION(Client, Reliable)
+    void ClientConfirmPrediction(uint16 Key);
+
+    UFUNCTION(Client, Reliable)
+    void ClientRejectPrediction(uint16 Key);
+
+    // Server side check of a client's pickup/use trace, with items rewound to what the client saw
+    bool IsRemoteInteractionValid(class AItem* Item, const FVector& Start, const FVector& Direction);
+
+    UFUNCTION(Server, Reliable, WithValidation)
+    void ServerPickUpItem(uint16 Key, class AItem* Item, FVector_NetQuantize10 Start, FVector_NetQuantizeNormal Direction);
+
+    UFUNCTION(Server, Reliable, WithValidation)
+    void ServerPrimaryUse(uint16 Key, class AItem* Item, FVector_NetQuantize10 Start, FVector_NetQuantizeNormal Direction);
+
+    UFUNCTION(Server, Reliable, WithValidation)
+    void ServerUseActiveItem(uint16 Key, class AItem* Item);
+
+    UFUNCTION(Server, Reliable, WithValidation)
+    void ServerPlaceItem(uint16 Key, class AItem* Item, FVector_NetQuantize10 Location, FRotator Rotation);
+
     // Slots we can set and activate when selecting ActiveItem
     void OnUseSlot0();
     void OnUseSlot1();
@@ -187,6 +365,10 @@ private:
     // Place item action
     void OnBeginPlace();
     void DisplayPlacementPivot();
+    void OnPlacementPivotTraced(const FHitResult& HitResult);
+
+    // FDarkestFearQueryHandle of the placement trace submitted last frame, read back the next one
+    uint64 PlacementQueryHandle;
     void OnFinishPlace();
 
     // Mouse Wheel Action
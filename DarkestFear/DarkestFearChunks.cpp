@@ -0,0 +1,319 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DarkestFearChunks.h"
+
+#include "Item.h"
+#include "AssetRegistry/IAssetRegistry.h"
+#include "Engine/GameInstance.h"
+#include "Engine/World.h"
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/CoreDelegates.h"
+#include "Misc/Paths.h"
+#include "UObject/UObjectGlobals.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogDarkestFearChunks, Log, All);
+
+UDarkestFearChunkSettings::UDarkestFearChunkSettings()
+{
+    const auto AddRule = [this](const TCHAR* PathPrefix, int32 ChunkId, TArray<int32> Dependencies)
+    {
+        FDarkestFearChunkRule& Rule = Rules.AddDefaulted_GetRef();
+        Rule.PathPrefix = PathPrefix;
+        Rule.ChunkId = ChunkId;
+        Rule.Dependencies = MoveTemp(Dependencies);
+    };
+
+    // Item families, each with its meshes, sounds and capture materials
+    AddRule(TEXT("/Game/Items/Flashlight/"), 10, {});
+    AddRule(TEXT("/Game/Items/Phone/"), 11, {});
+
+    // Levels, with the item families they place
+    AddRule(TEXT("/Game/FirstPersonCPP/Maps/"), 20, {10, 11});
+
+    OnDemandDirectory = TEXT("Chunks");
+}
+
+const FDarkestFearChunkRule* UDarkestFearChunkSettings::FindRule(const FString& PackagePath) const
+{
+    const FDarkestFearChunkRule* Found = nullptr;
+
+    for (const FDarkestFearChunkRule& Rule : Rules)
+    {
+        if (PackagePath.StartsWith(Rule.PathPrefix) && (Found == nullptr || Rule.PathPrefix.Len() > Found->PathPrefix.Len()))
+            Found = &Rule;
+    }
+
+    return Found;
+}
+
+const FDarkestFearChunkRule* UDarkestFearChunkSettings::FindRule(int32 ChunkId) const
+{
+    return Rules.FindByPredicate([ChunkId](const FDarkestFearChunkRule& Rule) { return Rule.ChunkId == ChunkId; });
+}
+
+#if WITH_EDITOR
+bool UDarkestFearAssetManager::GetPackageChunkIds(FName PackageName, const ITargetPlatform* TargetPlatform,
+                                                  const TArray<int32>& ExistingChunkList, TArray<int32>& OutChunkList,
+                                                  TArray<int32>* OutOverrideChunkList) const
+{
+    const FDarkestFearChunkRule* Rule = GetDefault<UDarkestFearChunkSettings>()->FindRule(PackageName.ToString());
+
+    if (Rule == nullptr)
+        return Super::GetPackageChunkIds(PackageName, TargetPlatform, ExistingChunkList, OutChunkList, OutOverrideChunkList);
+
+    // Only in its own chunk, not also in the chunks of whatever references it
+    OutChunkList.Reset();
+    OutChunkList.Add(Rule->ChunkId);
+
+    if (OutOverrideChunkList != nullptr)
+    {
+        OutOverrideChunkList->Reset();
+        OutOverrideChunkList->Add(Rule->ChunkId);
+    }
+
+    return true;
+}
+
+void UDarkestFearAssetManager::PostInitialAssetScan()
+{
+    Super::PostInitialAssetScan();
+
+    for (const FDarkestFearChunkRule& Rule : GetDefault<UDarkestFearChunkSettings>()->Rules)
+    {
+        FString Path = Rule.PathPrefix;
+        Path.RemoveFromEnd(TEXT("/"));
+
+        TArray<FAssetData> Assets;
+        GetAssetRegistry().GetAssetsByPath(FName(*Path), Assets, true);
+
+        TSet<FName> Packages;
+
+        for (const FAssetData& Asset : Assets)
+            Packages.Add(Asset.PackageName);
+
+        // A folder that moved or never existed would cook an empty chunk, and a map depending on it would mount nothing
+        if (Packages.Num() == 0)
+        {
+            UE_LOG(LogDarkestFearChunks, Error, TEXT("Chunk rule %s matches no content, chunk %d will be empty. "
+                   "Fix the path in DarkestFearChunkSettings"), *Rule.PathPrefix, Rule.ChunkId);
+        }
+        else
+        {
+            UE_LOG(LogDarkestFearChunks, Display, TEXT("Chunk rule %s: %d packages into chunk %d"), *Rule.PathPrefix,
+                   Packages.Num(), Rule.ChunkId);
+        }
+    }
+}
+#endif
+
+void UDarkestFearChunkSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+    Super::Initialize(Collection);
+
+    FindChunks(FPaths::ProjectContentDir() / TEXT("Paks"), true);
+    FindChunks(FPaths::ProjectDir() / GetDefault<UDarkestFearChunkSettings>()->OnDemandDirectory, false);
+
+    PreLoadMapHandle = FCoreUObjectDelegates::PreLoadMap.AddUObject(this, &UDarkestFearChunkSubsystem::OnPreLoadMap);
+}
+
+void UDarkestFearChunkSubsystem::Deinitialize()
+{
+    FCoreUObjectDelegates::PreLoadMap.Remove(PreLoadMapHandle);
+
+    Super::Deinitialize();
+}
+
+void UDarkestFearChunkSubsystem::FindChunks(const FString& Directory, bool bStartup)
+{
+    TArray<FString> PakFiles;
+    IFileManager::Get().FindFiles(PakFiles, *(Directory / TEXT("pakchunk*.pak")), true, false);
+
+    for (const FString& PakFile : PakFiles)
+    {
+        // pakchunk<Id>-<Platform>.pak, patches and optional paks of a chunk count towards the same chunk
+        const FString BaseName = FPaths::GetBaseFilename(PakFile);
+        const int32 ChunkId = FCString::Atoi(*BaseName + FCString::Strlen(TEXT("pakchunk")));
+
+        FChunk& Chunk = Chunks.FindOrAdd(ChunkId);
+        Chunk.ChunkId = ChunkId;
+        Chunk.bStartup = bStartup;
+        Chunk.bMounted = bStartup;
+
+        // The first pak found is the one mounted, the rest only add to the size
+        if (Chunk.PakPath.IsEmpty() && !BaseName.EndsWith(TEXT("_P")))
+            Chunk.PakPath = Directory / PakFile;
+
+        for (const TCHAR* Extension : {TEXT(".pak"), TEXT(".utoc"), TEXT(".ucas")})
+        {
+            const int64 Size = IFileManager::Get().FileSize(*(Directory / BaseName + Extension));
+
+            if (Size > 0)
+                Chunk.Bytes += Size;
+        }
+    }
+}
+
+bool UDarkestFearChunkSubsystem::MountChunk(int32 ChunkId)
+{
+    TSet<int32> Visited;
+    return MountChunk(ChunkId, Visited);
+}
+
+bool UDarkestFearChunkSubsystem::MountChunk(int32 ChunkId, TSet<int32>& Visited)
+{
+    bool bAlreadyVisited = false;
+    Visited.Add(ChunkId, &bAlreadyVisited);
+
+    // Chunk 0 is the startup pak
+    if (ChunkId == 0 || bAlreadyVisited)
+        return true;
+
+    bool bAvailable = true;
+
+    if (const FDarkestFearChunkRule* Rule = GetDefault<UDarkestFearChunkSettings>()->FindRule(ChunkId))
+    {
+        for (const int32 Dependency : Rule->Dependencies)
+            bAvailable &= MountChunk(Dependency, Visited);
+    }
+
+    FChunk* Chunk = Chunks.Find(ChunkId);
+
+    if (Chunk == nullptr)
+    {
+        // Without cooked data all content is loose, there is nothing to mount
+        if (!FPlatformProperties::RequiresCookedData())
+            return bAvailable;
+
+        UE_LOG(LogDarkestFearChunks, Warning, TEXT("Chunk %d was not staged, its content will fail to load"), ChunkId);
+        return false;
+    }
+
+    if (Chunk->bMounted)
+        return bAvailable;
+
+    if (Chunk->PakPath.IsEmpty() || !FCoreDelegates::MountPak.IsBound())
+    {
+        UE_LOG(LogDarkestFearChunks, Warning, TEXT("Cannot mount chunk %d, the game is not running from pak files"), ChunkId);
+        return false;
+    }
+
+    const uint64 UsedBefore = FPlatformMemory::GetStats().UsedPhysical;
+    const double StartTime = FPlatformTime::Seconds();
+
+    Chunk->bMounted = FCoreDelegates::MountPak.Execute(Chunk->PakPath, OnDemandPakOrder) != nullptr;
+    Chunk->MountSeconds = FPlatformTime::Seconds() - StartTime;
+    Chunk->ResidentBytes = int64(FPlatformMemory::GetStats().UsedPhysical) - int64(UsedBefore);
+
+    if (!Chunk->bMounted)
+    {
+        UE_LOG(LogDarkestFearChunks, Error, TEXT("Mounting chunk %d from %s failed"), ChunkId, *Chunk->PakPath);
+        return false;
+    }
+
+    UE_LOG(LogDarkestFearChunks, Display, TEXT("Mounted chunk %d (%.1f MB) in %.2f ms"), ChunkId,
+           Chunk->Bytes / (1024.0 * 1024.0), Chunk->MountSeconds * 1000.0);
+
+    return bAvailable;
+}
+
+bool UDarkestFearChunkSubsystem::PrepareContent(const FString& PackagePath)
+{
+    const FDarkestFearChunkRule* Rule = GetDefault<UDarkestFearChunkSettings>()->FindRule(PackagePath);
+    return Rule == nullptr || MountChunk(Rule->ChunkId);
+}
+
+TSharedPtr<FStreamableHandle> UDarkestFearChunkSubsystem::RequestItemClass(const TSoftClassPtr<AItem>& ItemClass,
+                                                                           FStreamableDelegate OnLoaded)
+{
+    PrepareContent(ItemClass.GetLongPackageName());
+
+    return UAssetManager::GetStreamableManager().RequestAsyncLoad(ItemClass.ToSoftObjectPath(), MoveTemp(OnLoaded));
+}
+
+bool UDarkestFearChunkSubsystem::IsChunkMounted(int32 ChunkId) const
+{
+    const FChunk* Chunk = Chunks.Find(ChunkId);
+    return ChunkId == 0 || (Chunk != nullptr && Chunk->bMounted);
+}
+
+void UDarkestFearChunkSubsystem::OnPreLoadMap(const FString& MapName)
+{
+    // The map and the item families it places have to be there before the package loads
+    PrepareContent(MapName);
+}
+
+void UDarkestFearChunkSubsystem::DumpChunks(FOutputDevice& Ar) const
+{
+    const UDarkestFearChunkSettings* Settings = GetDefault<UDarkestFearChunkSettings>();
+
+    TArray<int32> ChunkIds;
+    Chunks.GetKeys(ChunkIds);
+    ChunkIds.Sort();
+
+    int64 StartupBytes = 0;
+    int64 OnDemandBytes = 0;
+    int64 MountedBytes = 0;
+    double MountSeconds = 0.0;
+    int64 ResidentBytes = 0;
+
+    Ar.Logf(TEXT("Chunk        Size  Staged     Mounted  Mount ms  Resident MB  Content"));
+
+    for (const int32 ChunkId : ChunkIds)
+    {
+        const FChunk& Chunk = Chunks[ChunkId];
+        const FDarkestFearChunkRule* Rule = Settings->FindRule(ChunkId);
+
+        Ar.Logf(TEXT("%5d  %7.2f MB  %-9s  %-7s  %8.2f  %11.2f  %s"), ChunkId, Chunk.Bytes / (1024.0 * 1024.0),
+                Chunk.bStartup ? TEXT("startup") : TEXT("on demand"), Chunk.bMounted ? TEXT("yes") : TEXT("no"),
+                Chunk.MountSeconds * 1000.0, Chunk.ResidentBytes / (1024.0 * 1024.0),
+                Rule != nullptr ? *Rule->PathPrefix : ChunkId == 0 ? TEXT("everything else") : TEXT("?"));
+
+        (Chunk.bStartup ? StartupBytes : OnDemandBytes) += Chunk.Bytes;
+
+        if (Chunk.bMounted && !Chunk.bStartup)
+        {
+            MountedBytes += Chunk.Bytes;
+            MountSeconds += Chunk.MountSeconds;
+            ResidentBytes += Chunk.ResidentBytes;
+        }
+    }
+
+    Ar.Logf(TEXT("Startup paks %.1f MB, on demand %.1f MB of which %.1f MB mounted in %.2f ms for %+.2f MB resident"),
+            StartupBytes / (1024.0 * 1024.0), OnDemandBytes / (1024.0 * 1024.0), MountedBytes / (1024.0 * 1024.0),
+            MountSeconds * 1000.0, ResidentBytes / (1024.0 * 1024.0));
+    Ar.Logf(TEXT("Process resident %.1f MB, %.1f s since start"),
+            FPlatformMemory::GetStats().UsedPhysical / (1024.0 * 1024.0), FPlatformTime::Seconds() - GStartTime);
+}
+
+static UDarkestFearChunkSubsystem* GetChunkSubsystem(UWorld* World)
+{
+    UGameInstance* GameInstance = World != nullptr ? World->GetGameInstance() : nullptr;
+    return GameInstance != nullptr ? GameInstance->GetSubsystem<UDarkestFearChunkSubsystem>() : nullptr;
+}
+
+static FAutoConsoleCommandWithWorldArgsAndOutputDevice ChunkReportCommand(
+    TEXT("DarkestFear.ChunkReport"),
+    TEXT("Lists the pak chunks of the staged build with their size, mount time and resident memory"),
+    FConsoleCommandWithWorldArgsAndOutputDeviceDelegate::CreateLambda(
+        [](const TArray<FString>& Args, UWorld* World, FOutputDevice& Ar)
+        {
+            if (const UDarkestFearChunkSubsystem* ChunkSubsystem = GetChunkSubsystem(World))
+                ChunkSubsystem->DumpChunks(Ar);
+        }));
+
+static FAutoConsoleCommandWithWorldArgsAndOutputDevice MountChunkCommand(
+    TEXT("DarkestFear.MountChunk"),
+    TEXT("DarkestFear.MountChunk <ChunkId>: mounts a chunk and its dependencies now"),
+    FConsoleCommandWithWorldArgsAndOutputDeviceDelegate::CreateLambda(
+        [](const TArray<FString>& Args, UWorld* World, FOutputDevice& Ar)
+        {
+            UDarkestFearChunkSubsystem* ChunkSubsystem = GetChunkSubsystem(World);
+
+            if (ChunkSubsystem == nullptr || Args.Num() == 0)
+                return;
+
+            const int32 ChunkId = FCString::Atoi(*Args[0]);
+            Ar.Logf(TEXT("Chunk %d %s"), ChunkId, ChunkSubsystem->MountChunk(ChunkId) ? TEXT("mounted") : TEXT("not available"));
+        }));
@@ -0,0 +1,151 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/AssetManager.h"
+#include "Engine/StreamableManager.h"
+#include "Subsystems/GameInstanceSubsystem.h"
+#include "UObject/Object.h"
+
+#include "DarkestFearChunks.generated.h"
+
+/** Content under PathPrefix is cooked into its own pak chunk */
+USTRUCT()
+struct DARKESTFEAR_API FDarkestFearChunkRule
+{
+    GENERATED_BODY()
+
+    /** Long package path prefix, e.g. /Game/Items/Flashlight/ */
+    UPROPERTY(EditAnywhere, Category="Chunks")
+    FString PathPrefix;
+
+    UPROPERTY(EditAnywhere, Category="Chunks")
+    int32 ChunkId = 0;
+
+    /** Chunks mounted before this one, e.g. the item families a level places */
+    UPROPERTY(EditAnywhere, Category="Chunks")
+    TArray<int32> Dependencies;
+};
+
+/**
+ * Which content goes to which pak chunk, shared by the cook (UDarkestFearAssetManager) and the runtime
+ * (UDarkestFearChunkSubsystem) so both always agree. Everything no rule matches stays in chunk 0, which ships in
+ * the startup pak. Code defaults below can be overridden in the [/Script/DarkestFear.DarkestFearChunkSettings]
+ * section of DefaultGame.ini. The editor and the cook check every rule against the asset registry at startup and
+ * log an error for a rule that matches no content, so a moved folder doesn't silently leave an empty chunk.
+ *
+ * Cooking with the rules needs, in DefaultEngine.ini:
+ *   [/Script/Engine.Engine]
+ *   AssetManagerClassName=/Script/DarkestFear.DarkestFearAssetManager
+ * and in DefaultGame.ini:
+ *   [/Script/UnrealEd.ProjectPackagingSettings]
+ *   bGenerateChunks=True
+ *
+ * Chunks other than 0 must then be staged into OnDemandDirectory instead of Content/Paks, where the engine would
+ * mount them all at startup:
+ *   RunUAT BuildCookRun ... -stage -pak -iostore
+ *   move <Staged>/<Project>/Content/Paks/pakchunk[1-9]* <Staged>/<Project>/Chunks/
+ */
+UCLASS(config=Game, defaultconfig)
+class DARKESTFEAR_API UDarkestFearChunkSettings : public UObject
+{
+    GENERATED_BODY()
+
+public:
+    UDarkestFearChunkSettings();
+
+    UPROPERTY(config, EditAnywhere, Category="Chunks")
+    TArray<FDarkestFearChunkRule> Rules;
+
+    /** Where chunks mounted on demand are staged, relative to the project directory */
+    UPROPERTY(config, EditAnywhere, Category="Chunks")
+    FString OnDemandDirectory;
+
+    /** Rule of the chunk PackagePath is cooked into, the longest matching prefix. nullptr for chunk 0 */
+    const FDarkestFearChunkRule* FindRule(const FString& PackagePath) const;
+
+    const FDarkestFearChunkRule* FindRule(int32 ChunkId) const;
+};
+
+/** Puts the packages matched by UDarkestFearChunkSettings into their chunks when cooking */
+UCLASS()
+class DARKESTFEAR_API UDarkestFearAssetManager : public UAssetManager
+{
+    GENERATED_BODY()
+
+public:
+#if WITH_EDITOR
+    virtual bool GetPackageChunkIds(FName PackageName, const class ITargetPlatform* TargetPlatform,
+                                    const TArray<int32>& ExistingChunkList, TArray<int32>& OutChunkList,
+                                    TArray<int32>* OutOverrideChunkList = nullptr) const override;
+
+protected:
+    /** Logs the rules that match no packages, and how many each of the others does */
+    virtual void PostInitialAssetScan() override;
+#endif
+};
+
+/**
+ * Mounts pak chunks from the staged build's OnDemandDirectory the first time their content is needed: before a map
+ * in a chunk loads (PreLoadMap), and before an item class in a chunk is loaded through RequestItemClass. Mounting
+ * reads the pak index only, so it is a few milliseconds of game thread time, with no network involved.
+ *
+ * Items carried between maps travel as live actors and never load their class again. Items a map places, or a
+ * server replicates to its clients, are covered by the map rule's Dependencies, which are mounted with the map.
+ * Anything that spawns items from a class path goes through RequestItemClass, as DarkestFear.ItemSpawnBench does.
+ *
+ * Console commands:
+ *   DarkestFear.ChunkReport      Every chunk of the staged build: size, mounted, mount time, resident memory
+ *   DarkestFear.MountChunk <Id>  Mounts a chunk and its dependencies now
+ */
+UCLASS()
+class DARKESTFEAR_API UDarkestFearChunkSubsystem : public UGameInstanceSubsystem
+{
+    GENERATED_BODY()
+
+public:
+    virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+    virtual void Deinitialize() override;
+
+    /** Mounts the chunk and its dependencies. True if all of them are available */
+    bool MountChunk(int32 ChunkId);
+
+    /** Mounts whatever chunk PackagePath is cooked into */
+    bool PrepareContent(const FString& PackagePath);
+
+    /** Mounts the chunk of ItemClass, then loads it asynchronously */
+    TSharedPtr<FStreamableHandle> RequestItemClass(const TSoftClassPtr<class AItem>& ItemClass,
+                                                   FStreamableDelegate OnLoaded = FStreamableDelegate());
+
+    bool IsChunkMounted(int32 ChunkId) const;
+
+    void DumpChunks(FOutputDevice& Ar) const;
+
+    /** Pak order of on-demand chunks, the same as paks the engine finds in Content/Paks */
+    static constexpr int32 OnDemandPakOrder = 4;
+
+private:
+    struct FChunk
+    {
+        int32 ChunkId = 0;
+
+        /** .pak, with .utoc and .ucas next to it in IoStore builds */
+        FString PakPath;
+        int64 Bytes = 0;
+
+        /** Mounted by the engine at startup rather than on demand */
+        bool bStartup = false;
+        bool bMounted = false;
+
+        double MountSeconds = 0.0;
+        int64 ResidentBytes = 0;
+    };
+
+    TMap<int32, FChunk> Chunks;
+    FDelegateHandle PreLoadMapHandle;
+
+    void FindChunks(const FString& Directory, bool bStartup);
+    bool MountChunk(int32 ChunkId, TSet<int32>& Visited);
+    void OnPreLoadMap(const FString& MapName);
+};
@@ -0,0 +1,210 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DarkestFearEvents.h"
+
+#include "DarkestFearCharacter.h"
+#include "Item.h"
+#include "Async/ParallelFor.h"
+#include "HAL/IConsoleManager.h"
+#include "UObject/StrongObjectPtr.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogDarkestFearEvents, Log, All);
+
+DECLARE_CYCLE_STAT(TEXT("DarkestFear Item Event Drain"), STAT_DarkestFearItemEventDrain, STATGROUP_Game);
+
+void UDarkestFearEventSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+    Super::Initialize(Collection);
+
+    // Allocated once, pushing never allocates
+    for (FEventBuffer& Buffer : Buffers)
+        Buffer.Events.SetNum(Capacity);
+}
+
+void UDarkestFearEventSubsystem::Push(const FDarkestFearItemEventData& Event)
+{
+    for (;;)
+    {
+        const int32 BufferIndex = ActiveBuffer.Load();
+        FEventBuffer& Buffer = Buffers[BufferIndex];
+
+        // Announce the write first, then make sure Drain has not swapped this buffer out in the meantime
+        ++Buffer.NumWriting;
+
+        if (ActiveBuffer.Load() != BufferIndex)
+        {
+            --Buffer.NumWriting;
+            continue;
+        }
+
+        const int32 Index = Buffer.NumReserved++;
+
+        if (Index < Capacity)
+            Buffer.Events[Index] = Event;
+        else
+            ++NumDropped;
+
+        --Buffer.NumWriting;
+        return;
+    }
+}
+
+void UDarkestFearEventSubsystem::PushItemEvent(EDarkestFearItemEvent Type, AItem* Item,
+                                               ADarkestFearCharacter* Character, int8 Slot)
+{
+    const AActor* Context = Item != nullptr ? static_cast<AActor*>(Item) : Character;
+    UWorld* World = Context != nullptr ? Context->GetWorld() : nullptr;
+    UDarkestFearEventSubsystem* Events = World != nullptr ? World->GetSubsystem<UDarkestFearEventSubsystem>() : nullptr;
+
+    if (Events != nullptr)
+        Events->Push({Type, Slot, Item, Character, Context->GetActorLocation()});
+}
+
+void UDarkestFearEventSubsystem::Drain()
+{
+    check(IsInGameThread());
+    SCOPE_CYCLE_COUNTER(STAT_DarkestFearItemEventDrain);
+
+    // New events go to the other buffer from here on, only writes already started can still land in this one
+    const int32 BufferIndex = ActiveBuffer.Load();
+    ActiveBuffer.Store(1 - BufferIndex);
+
+    FEventBuffer& Buffer = Buffers[BufferIndex];
+
+    while (Buffer.NumWriting.Load() > 0)
+        FPlatformProcess::Yield();
+
+    const int32 NumEvents = FMath::Min(Buffer.NumReserved.Load(), Capacity);
+
+    // Subscribers may push while handling the batch, those events go to the next one
+    if (NumEvents > 0)
+        OnItemEvents.Broadcast(TArrayView<const FDarkestFearItemEventData>(Buffer.Events.GetData(), NumEvents));
+
+    Buffer.NumReserved.Store(0);
+
+    const int32 Dropped = NumDropped.Exchange(0);
+
+    if (Dropped > 0)
+        UE_LOG(LogDarkestFearEvents, Warning, TEXT("Dropped %d item events, more than %d in one frame"), Dropped, Capacity);
+}
+
+void UDarkestFearEventSubsystem::Tick(float DeltaTime)
+{
+    Drain();
+}
+
+bool UDarkestFearEventSubsystem::IsTickable() const
+{
+    return !IsTemplate();
+}
+
+TStatId UDarkestFearEventSubsystem::GetStatId() const
+{
+    RETURN_QUICK_DECLARE_CYCLE_STAT(UDarkestFearEventSubsystem, STATGROUP_Tickables);
+}
+
+void UDarkestFearEventBenchListener::OnItemEvent(EDarkestFearItemEvent Type, AItem* Item,
+                                                 ADarkestFearCharacter* Character)
+{
+    if (Type == EDarkestFearItemEvent::Used)
+        NumReceived++;
+}
+
+void UDarkestFearEventBenchListener::OnItemEvents(TArrayView<const FDarkestFearItemEventData> Events)
+{
+    // Same work per event as the dynamic listener
+    for (const FDarkestFearItemEventData& Event : Events)
+    {
+        if (Event.Type == EDarkestFearItemEvent::Used)
+            NumReceived++;
+    }
+}
+
+static FAutoConsoleCommandWithWorldArgsAndOutputDevice EventBusBenchCommand(
+    TEXT("DarkestFear.EventBusBench"),
+    TEXT("DarkestFear.EventBusBench [Events=1000000] [Subscribers=16]: events per second through dynamic multicast "
+         "delegates and through the item event bus"),
+    FConsoleCommandWithWorldArgsAndOutputDeviceDelegate::CreateLambda(
+        [](const TArray<FString>& Args, UWorld* World, FOutputDevice& Ar)
+        {
+            UDarkestFearEventSubsystem* Events = World ? World->GetSubsystem<UDarkestFearEventSubsystem>() : nullptr;
+
+            if (Events == nullptr)
+                return;
+
+            const int32 NumEvents = Args.Num() > 0 ? FMath::Max(FCString::Atoi(*Args[0]), 1) : 1000000;
+            const int32 NumSubscribers = Args.Num() > 1 ? FMath::Max(FCString::Atoi(*Args[1]), 1) : 16;
+
+            TArray<TStrongObjectPtr<UDarkestFearEventBenchListener>> Listeners;
+            FDarkestFearItemEventDynamic DynamicDelegate;
+            TArray<FDelegateHandle> Handles;
+
+            for (int32 Index = 0; Index < NumSubscribers; Index++)
+            {
+                Listeners.Emplace(NewObject<UDarkestFearEventBenchListener>());
+                DynamicDelegate.AddDynamic(Listeners.Last().Get(), &UDarkestFearEventBenchListener::OnItemEvent);
+                Handles.Add(Events->OnItemEvents.AddUObject(Listeners.Last().Get(), &UDarkestFearEventBenchListener::OnItemEvents));
+            }
+
+            const FDarkestFearItemEventData Event = {EDarkestFearItemEvent::Used, INDEX_NONE, nullptr, nullptr, FVector::ZeroVector};
+
+            // Whatever real events are queued should not be counted
+            Events->Drain();
+
+            double StartTime = FPlatformTime::Seconds();
+
+            for (int32 Index = 0; Index < NumEvents; Index++)
+                DynamicDelegate.Broadcast(Event.Type, nullptr, nullptr);
+
+            const double DynamicSeconds = FPlatformTime::Seconds() - StartTime;
+
+            // Drained every Capacity events, like a frame full of them
+            StartTime = FPlatformTime::Seconds();
+
+            for (int32 Index = 0; Index < NumEvents; Index++)
+            {
+                Events->Push(Event);
+
+                if ((Index + 1) % UDarkestFearEventSubsystem::Capacity == 0)
+                    Events->Drain();
+            }
+
+            Events->Drain();
+
+            const double BusSeconds = FPlatformTime::Seconds() - StartTime;
+
+            // Same, with every worker pushing at once
+            StartTime = FPlatformTime::Seconds();
+
+            for (int32 First = 0; First < NumEvents; First += UDarkestFearEventSubsystem::Capacity)
+            {
+                const int32 NumInFrame = FMath::Min(UDarkestFearEventSubsystem::Capacity, NumEvents - First);
+
+                ParallelFor(NumInFrame, [Events, &Event](int32 Index)
+                {
+                    Events->Push(Event);
+                });
+
+                Events->Drain();
+            }
+
+            const double ParallelSeconds = FPlatformTime::Seconds() - StartTime;
+
+            int64 NumReceived = 0;
+
+            for (int32 Index = 0; Index < NumSubscribers; Index++)
+            {
+                Events->OnItemEvents.Remove(Handles[Index]);
+                NumReceived += Listeners[Index]->NumReceived;
+            }
+
+            Ar.Logf(TEXT("%d events, %d subscribers (%lld deliveries, %lld expected)"), NumEvents, NumSubscribers,
+                    NumReceived, int64(NumEvents) * NumSubscribers * 3);
+            Ar.Logf(TEXT("  Dynamic multicast:     %8.2f ms  %6.2f M events/s"), DynamicSeconds * 1000.0,
+                    NumEvents / FMath::Max(DynamicSeconds, 1e-9) / 1e6);
+            Ar.Logf(TEXT("  Event bus:             %8.2f ms  %6.2f M events/s"), BusSeconds * 1000.0,
+                    NumEvents / FMath::Max(BusSeconds, 1e-9) / 1e6);
+            Ar.Logf(TEXT("  Event bus, parallel:   %8.2f ms  %6.2f M events/s"), ParallelSeconds * 1000.0,
+                    NumEvents / FMath::Max(ParallelSeconds, 1e-9) / 1e6);
+        }));
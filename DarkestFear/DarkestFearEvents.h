@@ -0,0 +1,115 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Templates/Atomic.h"
+#include "Tickable.h"
+
+#include "DarkestFearEvents.generated.h"
+
+UENUM(BlueprintType)
+enum class EDarkestFearItemEvent : uint8
+{
+    PickedUp,
+    Used,
+    AlternateUsed,
+    Equipped,
+    Placed,
+    // A predicted action the server rejected was undone, see ADarkestFearCharacter::RollbackPrediction
+    RolledBack
+};
+
+/** One item action. Plain data, so pushing it is a copy into a preallocated buffer */
+struct FDarkestFearItemEventData
+{
+    EDarkestFearItemEvent Type;
+
+    /** Inventory slot for Equipped, INDEX_NONE otherwise */
+    int8 Slot;
+
+    TWeakObjectPtr<class AItem> Item;
+    TWeakObjectPtr<class ADarkestFearCharacter> Character;
+
+    /** Item location when the event happened */
+    FVector Location;
+};
+
+DECLARE_MULTICAST_DELEGATE_OneParam(FDarkestFearItemEventBatch, TArrayView<const FDarkestFearItemEventData>);
+
+/** Per event delegate, only used by DarkestFear.EventBusBench as the baseline */
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_ThreeParams(FDarkestFearItemEventDynamic, EDarkestFearItemEvent, Type, class AItem*,
+                                               Item, class ADarkestFearCharacter*, Character);
+
+/**
+ * Item action event bus. Pickups, uses, equips and placements are pushed as POD events into a per-frame buffer and
+ * handed to subscribers once per frame, as one batch, on the game thread. Adding a consumer (audio, AI hearing, UI,
+ * telemetry, saves) costs one call per frame instead of one per event, and producers never wait for consumers.
+ *
+ * Push may be called from any thread without taking a lock: writers reserve a slot with an atomic increment into
+ * the active buffer, and the game thread swaps buffers before draining, waiting only for writes already in flight.
+ * A frame holds at most Capacity events, the rest are dropped and counted.
+ */
+UCLASS()
+class DARKESTFEAR_API UDarkestFearEventSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+    GENERATED_BODY()
+
+public:
+    virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+
+    /** Queues an event for this frame's batch. Safe from any thread */
+    void Push(const FDarkestFearItemEventData& Event);
+
+    /** Builds and queues an event, for gameplay code that has the actors at hand */
+    static void PushItemEvent(EDarkestFearItemEvent Type, class AItem* Item, class ADarkestFearCharacter* Character,
+                              int8 Slot = INDEX_NONE);
+
+    /** Hands every queued event to the subscribers now */
+    void Drain();
+
+    /** Subscribers receive all of a frame's events at once, on the game thread */
+    FDarkestFearItemEventBatch OnItemEvents;
+
+    /** Events a single frame can hold */
+    static constexpr int32 Capacity = 4096;
+
+    int32 GetNumDropped() const { return NumDropped; }
+
+    // FTickableGameObject
+    virtual void Tick(float DeltaTime) override;
+    virtual bool IsTickable() const override;
+    virtual TStatId GetStatId() const override;
+
+private:
+    struct FEventBuffer
+    {
+        TArray<FDarkestFearItemEventData> Events;
+
+        /** Slots handed out this frame, may go past Capacity */
+        TAtomic<int32> NumReserved{0};
+
+        /** Producers between reserving a slot and finishing the copy */
+        TAtomic<int32> NumWriting{0};
+    };
+
+    FEventBuffer Buffers[2];
+    TAtomic<int32> ActiveBuffer{0};
+    TAtomic<int32> NumDropped{0};
+};
+
+/** Listener for the dynamic delegate side of DarkestFear.EventBusBench */
+UCLASS()
+class UDarkestFearEventBenchListener : public UObject
+{
+    GENERATED_BODY()
+
+public:
+    int64 NumReceived = 0;
+
+    UFUNCTION()
+    void OnItemEvent(EDarkestFearItemEvent Type, class AItem* Item, class ADarkestFearCharacter* Character);
+
+    void OnItemEvents(TArrayView<const FDarkestFearItemEventData> Events);
+};
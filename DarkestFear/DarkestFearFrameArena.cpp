@@ -0,0 +1,440 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DarkestFearFrameArena.h"
+
+#include "HAL/IConsoleManager.h"
+#include "HAL/MallocAnsi.h"
+#include "Misc/CommandLine.h"
+#include "Misc/CoreDelegates.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogDarkestFearArena, Log, All);
+
+FDelegateHandle FDarkestFearFrameArena::EndFrameHandle;
+
+FDarkestFearFrameArena& FDarkestFearFrameArena::Get()
+{
+    check(IsInGameThread());
+
+    static FDarkestFearFrameArena Arena;
+    return Arena;
+}
+
+void FDarkestFearFrameArena::Startup()
+{
+    EndFrameHandle = FCoreDelegates::OnEndFrame.AddLambda([]()
+    {
+        Get().Reset();
+    });
+}
+
+void FDarkestFearFrameArena::Shutdown()
+{
+    FCoreDelegates::OnEndFrame.Remove(EndFrameHandle);
+}
+
+FDarkestFearFrameArena::~FDarkestFearFrameArena()
+{
+    for (const FBlock& Block : Blocks)
+        FMemory::Free(Block.Data);
+}
+
+void* FDarkestFearFrameArena::Allocate(SIZE_T Size, uint32 Alignment)
+{
+    // DEFAULT_ALIGNMENT is 0, which Align would turn into offset 0 of the block
+    if (Alignment == DEFAULT_ALIGNMENT)
+        Alignment = DefaultAlignment;
+
+    check(FMath::IsPowerOfTwo(Alignment));
+
+    for (;;)
+    {
+        if (Blocks.IsValidIndex(CurrentBlock))
+        {
+            const FBlock& Block = Blocks[CurrentBlock];
+
+            // Aligns the address rather than the offset, so alignments beyond the block's own hold too
+            const SIZE_T Offset = Align(Block.Data + BlockOffset, Alignment) - Block.Data;
+
+            if (Offset + Size <= Block.Size)
+            {
+                BytesUsed += Offset + Size - BlockOffset;
+                PeakBytesUsed = FMath::Max(PeakBytesUsed, BytesUsed);
+                BlockOffset = Offset + Size;
+
+                return Block.Data + Offset;
+            }
+
+            // The rest of this block stays unused until the reset
+            if (CurrentBlock + 1 < Blocks.Num())
+            {
+                CurrentBlock++;
+                BlockOffset = 0;
+                continue;
+            }
+        }
+
+        // Only happens until the busiest frame has been seen
+        const SIZE_T NewBlockSize = FMath::Max<SIZE_T>(BlockSize, Size + Alignment);
+        Blocks.Add({static_cast<uint8*>(FMemory::Malloc(NewBlockSize, DefaultAlignment)), NewBlockSize});
+        CurrentBlock = Blocks.Num() - 1;
+        BlockOffset = 0;
+    }
+}
+
+const TCHAR* FDarkestFearFrameArena::Printf(const TCHAR* Format, ...)
+{
+    constexpr int32 MaxLength = 512;
+
+    TCHAR* Buffer = static_cast<TCHAR*>(Allocate(MaxLength * sizeof(TCHAR), alignof(TCHAR)));
+
+    va_list Args;
+    va_start(Args, Format);
+    const int32 Length = FCString::GetVarArgs(Buffer, MaxLength, Format, Args);
+    va_end(Args);
+
+    if (Length < 0 || Length >= MaxLength)
+    {
+        Buffer[MaxLength - 1] = TEXT('\0');
+        return Buffer;
+    }
+
+    // Give back what the string did not use, it is still the last allocation
+    const SIZE_T Unused = (MaxLength - Length - 1) * sizeof(TCHAR);
+    BlockOffset -= Unused;
+    BytesUsed -= Unused;
+
+    return Buffer;
+}
+
+void FDarkestFearFrameArena::Reset()
+{
+    CurrentBlock = 0;
+    BlockOffset = 0;
+    BytesUsed = 0;
+}
+
+void FDarkestFearFrameArena::PopMark(const FMark& Mark)
+{
+    CurrentBlock = Mark.Block;
+    BlockOffset = Mark.Offset;
+    BytesUsed = Mark.BytesUsed;
+}
+
+SIZE_T FDarkestFearFrameArena::GetCapacity() const
+{
+    SIZE_T Capacity = 0;
+
+    for (const FBlock& Block : Blocks)
+        Capacity += Block.Size;
+
+    return Capacity;
+}
+
+namespace
+{
+    int32 FrameAllocations = 0;
+    int32 LastFrameAllocations = 0;
+    int64 TotalAllocations = 0;
+
+    // Allocations made inside FDarkestFearAllocScope::FExclude, taken off the enclosing scopes
+    int64 ExcludedAllocations = 0;
+
+    struct FScopeStats
+    {
+        int32 Calls = 0;
+        int32 CallsThatAllocated = 0;
+        int32 MaxAllocations = 0;
+        int64 Allocations = 0;
+    };
+
+    const TCHAR* const ScopeNames[] = {TEXT("Placement"), TEXT("PickUp"), TEXT("Fire")};
+    static_assert(UE_ARRAY_COUNT(ScopeNames) == int32(EDarkestFearAllocScope::Count), "A name for every scope");
+
+    // DarkestFear.AllocWatch state
+    int32 WatchFramesLeft = 0;
+    int32 WatchFrames = 0;
+    int32 WatchMax = 0;
+    int64 WatchTotal = 0;
+    int32 WatchFramesWithAllocations = 0;
+    FScopeStats WatchScopes[int32(EDarkestFearAllocScope::Count)];
+
+    FDelegateHandle AllocEndFrameHandle;
+
+#if !UE_BUILD_SHIPPING
+    /** Forwards everything to the real allocator, counting game thread allocations on the way */
+    class FCountingMalloc final : public FMalloc
+    {
+    public:
+        explicit FCountingMalloc(FMalloc* InInner)
+            : Inner(InInner)
+        {
+        }
+
+        FMalloc* Inner;
+
+        virtual void* Malloc(SIZE_T Count, uint32 Alignment) override
+        {
+            if (IsInGameThread())
+            {
+                FrameAllocations++;
+                TotalAllocations++;
+            }
+
+            return Inner->Malloc(Count, Alignment);
+        }
+
+        virtual void* Realloc(void* Original, SIZE_T Count, uint32 Alignment) override
+        {
+            // Growing or creating goes to the heap, shrinking to nothing is a free
+            if (Count > 0 && IsInGameThread())
+            {
+                FrameAllocations++;
+                TotalAllocations++;
+            }
+
+            return Inner->Realloc(Original, Count, Alignment);
+        }
+
+        virtual void Free(void* Original) override { Inner->Free(Original); }
+        virtual SIZE_T QuantizeSize(SIZE_T Count, uint32 Alignment) override { return Inner->QuantizeSize(Count, Alignment); }
+        virtual bool GetAllocationSize(void* Original, SIZE_T& SizeOut) override { return Inner->GetAllocationSize(Original, SizeOut); }
+        virtual void Trim(bool bTrimThreadCaches) override { Inner->Trim(bTrimThreadCaches); }
+        virtual void SetupTLSCachesOnCurrentThread() override { Inner->SetupTLSCachesOnCurrentThread(); }
+        virtual void ClearAndDisableTLSCachesOnCurrentThread() override { Inner->ClearAndDisableTLSCachesOnCurrentThread(); }
+        virtual void InitializeStatsMetadata() override { Inner->InitializeStatsMetadata(); }
+        virtual void UpdateStats() override { Inner->UpdateStats(); }
+        virtual void GetAllocatorStats(FGenericMemoryStats& OutStats) override { Inner->GetAllocatorStats(OutStats); }
+        virtual void DumpAllocatorStats(FOutputDevice& Ar) override { Inner->DumpAllocatorStats(Ar); }
+        virtual bool IsInternallyThreadSafe() const override { return Inner->IsInternallyThreadSafe(); }
+        virtual bool ValidateHeap() override { return Inner->ValidateHeap(); }
+        virtual const TCHAR* GetDescriptiveName() override { return Inner->GetDescriptiveName(); }
+    };
+
+    // Never deleted: memory allocated through it may still be freed through it after shutdown
+    FCountingMalloc* CountingMalloc = nullptr;
+#endif
+
+    void OnAllocCounterEndFrame()
+    {
+        LastFrameAllocations = FrameAllocations;
+        FrameAllocations = 0;
+
+        if (WatchFramesLeft <= 0)
+            return;
+
+        WatchFrames++;
+        WatchTotal += LastFrameAllocations;
+        WatchMax = FMath::Max(WatchMax, LastFrameAllocations);
+        WatchFramesWithAllocations += LastFrameAllocations > 0;
+
+        if (--WatchFramesLeft > 0)
+            return;
+
+        // Whole frames include the engine's own allocations, they are context rather than a failure
+        UE_LOG(LogDarkestFearArena, Display,
+               TEXT("%d of %d frames allocated on the game thread heap: avg %.1f, max %d allocations per frame"),
+               WatchFramesWithAllocations, WatchFrames, double(WatchTotal) / WatchFrames, WatchMax);
+
+        for (int32 Scope = 0; Scope < int32(EDarkestFearAllocScope::Count); Scope++)
+        {
+            const FScopeStats& Stats = WatchScopes[Scope];
+
+            if (Stats.CallsThatAllocated > 0)
+            {
+                UE_LOG(LogDarkestFearArena, Error, TEXT("%s allocated in %d of %d calls: %lld allocations, max %d per call"),
+                       ScopeNames[Scope], Stats.CallsThatAllocated, Stats.Calls, Stats.Allocations, Stats.MaxAllocations);
+            }
+            else
+            {
+                UE_LOG(LogDarkestFearArena, Display, TEXT("%s: no heap allocations in %d calls"), ScopeNames[Scope], Stats.Calls);
+            }
+        }
+    }
+}
+
+void FDarkestFearAllocCounter::Startup()
+{
+#if !UE_BUILD_SHIPPING
+    if (!FParse::Param(FCommandLine::Get(), TEXT("DarkestFearCountAllocs")))
+        return;
+
+    CountingMalloc = new FCountingMalloc(GMalloc);
+    GMalloc = CountingMalloc;
+
+    AllocEndFrameHandle = FCoreDelegates::OnEndFrame.AddStatic(&OnAllocCounterEndFrame);
+#endif
+}
+
+void FDarkestFearAllocCounter::Shutdown()
+{
+#if !UE_BUILD_SHIPPING
+    if (CountingMalloc == nullptr)
+        return;
+
+    FCoreDelegates::OnEndFrame.Remove(AllocEndFrameHandle);
+
+    if (GMalloc == CountingMalloc)
+        GMalloc = CountingMalloc->Inner;
+#endif
+}
+
+bool FDarkestFearAllocCounter::IsEnabled()
+{
+#if !UE_BUILD_SHIPPING
+    return CountingMalloc != nullptr && GMalloc == CountingMalloc;
+#else
+    return false;
+#endif
+}
+
+int32 FDarkestFearAllocCounter::GetFrameAllocations()
+{
+    return FrameAllocations;
+}
+
+int32 FDarkestFearAllocCounter::GetLastFrameAllocations()
+{
+    return LastFrameAllocations;
+}
+
+int64 FDarkestFearAllocCounter::GetTotalAllocations()
+{
+    return TotalAllocations;
+}
+
+FDarkestFearAllocScope::FDarkestFearAllocScope(EDarkestFearAllocScope InScope)
+    : Scope(InScope)
+    , StartAllocations(TotalAllocations)
+    , StartExcluded(ExcludedAllocations)
+{
+}
+
+FDarkestFearAllocScope::~FDarkestFearAllocScope()
+{
+    // Only while DarkestFear.AllocWatch is watching, and only the game thread is counted
+    if (WatchFramesLeft <= 0 || !IsInGameThread())
+        return;
+
+    const int32 Allocations = int32((TotalAllocations - StartAllocations) - (ExcludedAllocations - StartExcluded));
+    FScopeStats& Stats = WatchScopes[int32(Scope)];
+
+    Stats.Calls++;
+    Stats.CallsThatAllocated += Allocations > 0;
+    Stats.MaxAllocations = FMath::Max(Stats.MaxAllocations, Allocations);
+    Stats.Allocations += Allocations;
+}
+
+FDarkestFearAllocScope::FExclude::FExclude()
+    : StartAllocations(TotalAllocations)
+{
+}
+
+FDarkestFearAllocScope::FExclude::~FExclude()
+{
+    ExcludedAllocations += TotalAllocations - StartAllocations;
+}
+
+static FAutoConsoleCommand AllocWatchCommand(
+    TEXT("DarkestFear.AllocWatch"),
+    TEXT("DarkestFear.AllocWatch [Frames=300]: counts the game thread heap allocations of placement, pickup and firing "
+         "over the next frames and logs an error if any of them allocated. Needs -DarkestFearCountAllocs"),
+    FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+    {
+        if (!FDarkestFearAllocCounter::IsEnabled())
+        {
+            UE_LOG(LogDarkestFearArena, Warning, TEXT("Allocation counting is off, run with -DarkestFearCountAllocs"));
+            return;
+        }
+
+        WatchFramesLeft = Args.Num() > 0 ? FMath::Max(FCString::Atoi(*Args[0]), 1) : 300;
+        WatchFrames = 0;
+        WatchMax = 0;
+        WatchTotal = 0;
+        WatchFramesWithAllocations = 0;
+
+        for (FScopeStats& Stats : WatchScopes)
+            Stats = FScopeStats();
+    }));
+
+static FAutoConsoleCommandWithOutputDevice ArenaStatsCommand(
+    TEXT("DarkestFear.ArenaStats"),
+    TEXT("Logs the frame arena's capacity and peak use, and last frame's game thread heap allocations"),
+    FConsoleCommandWithOutputDeviceDelegate::CreateLambda([](FOutputDevice& Ar)
+    {
+        const FDarkestFearFrameArena& Arena = FDarkestFearFrameArena::Get();
+
+        Ar.Logf(TEXT("Frame arena: %.1f KB capacity, %.1f KB peak"), Arena.GetCapacity() / 1024.0, Arena.GetPeakBytesUsed() / 1024.0);
+
+        if (FDarkestFearAllocCounter::IsEnabled())
+            Ar.Logf(TEXT("Game thread heap allocations last frame: %d"), FDarkestFearAllocCounter::GetLastFrameAllocations());
+    }));
+
+static FAutoConsoleCommandWithArgsAndOutputDevice ArenaBenchCommand(
+    TEXT("DarkestFear.ArenaBench"),
+    TEXT("DarkestFear.ArenaBench [Iterations=100000]: builds a placement frame's temporaries on the heap and in the frame arena"),
+    FConsoleCommandWithArgsAndOutputDeviceDelegate::CreateLambda([](const TArray<FString>& Args, FOutputDevice& Ar)
+    {
+        const int32 Iterations = Args.Num() > 0 ? FMath::Max(FCString::Atoi(*Args[0]), 1) : 100000;
+
+        // What a placement frame used to build: the facing text, its message, and a few candidate points
+        const FVector Location(1234.5f, -678.9f, 42.f);
+        int64 Checksum = 0;
+
+        int32 AllocationsBefore = FDarkestFearAllocCounter::GetFrameAllocations();
+        double StartTime = FPlatformTime::Seconds();
+
+        for (int32 Iteration = 0; Iteration < Iterations; Iteration++)
+        {
+            const FString Info = TEXT("X: ") + FString::FromInt(Location.X) + TEXT(", Y: ") + FString::FromInt(Location.Y) +
+                                 TEXT(" , Z: ") + FString::FromInt(Location.Z);
+            const FString Message = FString::Printf(TEXT("You are facing: %s"), *Info);
+
+            TArray<FVector> Points;
+
+            for (int32 Index = 0; Index < 8; Index++)
+                Points.Add(Location + FVector(Index));
+
+            Checksum += Message.Len() + Points.Num();
+        }
+
+        const double HeapSeconds = FPlatformTime::Seconds() - StartTime;
+        const int32 HeapAllocations = FDarkestFearAllocCounter::GetFrameAllocations() - AllocationsBefore;
+
+        FDarkestFearFrameArena& Arena = FDarkestFearFrameArena::Get();
+
+        AllocationsBefore = FDarkestFearAllocCounter::GetFrameAllocations();
+        StartTime = FPlatformTime::Seconds();
+
+        for (int32 Iteration = 0; Iteration < Iterations; Iteration++)
+        {
+            // Each iteration is a frame, without disturbing what the real frame put in the arena
+            const FDarkestFearFrameArena::FMark Mark = Arena.GetMark();
+
+            const TCHAR* Message = Arena.Printf(TEXT("You are facing: X: %d, Y: %d, Z: %d"), FMath::TruncToInt(Location.X),
+                                                FMath::TruncToInt(Location.Y), FMath::TruncToInt(Location.Z));
+
+            TArray<FVector, FDarkestFearFrameAllocator> Points;
+
+            for (int32 Index = 0; Index < 8; Index++)
+                Points.Add(Location + FVector(Index));
+
+            Checksum += FCString::Strlen(Message) + Points.Num();
+
+            Arena.PopMark(Mark);
+        }
+
+        const double ArenaSeconds = FPlatformTime::Seconds() - StartTime;
+        const int32 ArenaAllocations = FDarkestFearAllocCounter::GetFrameAllocations() - AllocationsBefore;
+
+        Ar.Logf(TEXT("%d placement frames (checksum %lld)"), Iterations, Checksum);
+        Ar.Logf(TEXT("  Heap:  %8.2f ms, %.2f us/frame"), HeapSeconds * 1000.0, HeapSeconds * 1e6 / Iterations);
+        Ar.Logf(TEXT("  Arena: %8.2f ms, %.2f us/frame, %.2fx"), ArenaSeconds * 1000.0, ArenaSeconds * 1e6 / Iterations,
+                HeapSeconds / FMath::Max(ArenaSeconds, 1e-9));
+
+        if (FDarkestFearAllocCounter::IsEnabled())
+        {
+            Ar.Logf(TEXT("  Heap allocations per frame: heap path %.2f, arena path %.2f"),
+                    float(HeapAllocations) / Iterations, float(ArenaAllocations) / Iterations);
+        }
+    }));
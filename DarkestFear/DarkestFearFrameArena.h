@@ -0,0 +1,254 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Linear allocator for game thread data that only lives until the end of the frame: temporary arrays, formatted
+ * debug strings, query batches. Allocating is a pointer bump, freeing is the reset at the end of every frame.
+ * Blocks are kept between frames, so once the busiest frame has been seen the arena never touches the heap again.
+ *
+ * Never keep arena memory across frames, and only use it on the game thread. The scene query batch being run and
+ * the projectiles a fire batch spawned live here.
+ *
+ *   TArray<FVector, FDarkestFearFrameAllocator> Points;   // array storage from the arena
+ *   const TCHAR* Text = FDarkestFearFrameArena::Get().Printf(TEXT("%d items"), Num);
+ */
+class DARKESTFEAR_API FDarkestFearFrameArena
+{
+public:
+    static FDarkestFearFrameArena& Get();
+
+    /** Hooks the end of frame reset, called by the module */
+    static void Startup();
+    static void Shutdown();
+
+    /** Alignment 0 (DEFAULT_ALIGNMENT) means DefaultAlignment */
+    void* Allocate(SIZE_T Size, uint32 Alignment = DEFAULT_ALIGNMENT);
+
+    /** Formats into arena memory. The string is valid until the end of the frame */
+    const TCHAR* Printf(const TCHAR* Format, ...);
+
+    /** Releases everything allocated this frame, keeping the blocks */
+    void Reset();
+
+    /** Position in the arena, everything allocated after it can be released early with PopMark */
+    struct FMark
+    {
+        int32 Block;
+        SIZE_T Offset;
+        SIZE_T BytesUsed;
+    };
+
+    FMark GetMark() const { return {CurrentBlock, BlockOffset, BytesUsed}; }
+    void PopMark(const FMark& Mark);
+
+    SIZE_T GetBytesUsed() const { return BytesUsed; }
+    SIZE_T GetPeakBytesUsed() const { return PeakBytesUsed; }
+    SIZE_T GetCapacity() const;
+
+    /** Bytes of each block, bigger requests get a block of their own */
+    static constexpr SIZE_T BlockSize = 64 * 1024;
+
+    /** Alignment of allocations that don't ask for one, enough for any fundamental or vector type */
+    static constexpr uint32 DefaultAlignment = 16;
+
+    ~FDarkestFearFrameArena();
+
+private:
+    struct FBlock
+    {
+        uint8* Data;
+        SIZE_T Size;
+    };
+
+    TArray<FBlock> Blocks;
+    int32 CurrentBlock = 0;
+    SIZE_T BlockOffset = 0;
+    SIZE_T BytesUsed = 0;
+    SIZE_T PeakBytesUsed = 0;
+
+    static FDelegateHandle EndFrameHandle;
+};
+
+/** TArray allocator taking its storage from FDarkestFearFrameArena. Growing leaves the old storage behind until the frame ends */
+class FDarkestFearFrameAllocator
+{
+public:
+    using SizeType = int32;
+
+    enum { NeedsElementType = true };
+    enum { RequireRangeCheck = true };
+
+    class ForAnyElementType
+    {
+    public:
+        ForAnyElementType()
+            : Data(nullptr)
+        {
+        }
+
+        FORCEINLINE void MoveToEmpty(ForAnyElementType& Other)
+        {
+            checkSlow(this != &Other);
+
+            Data = Other.Data;
+            Other.Data = nullptr;
+        }
+
+        FORCEINLINE FScriptContainerElement* GetAllocation() const
+        {
+            return Data;
+        }
+
+        void ResizeAllocation(SizeType PreviousNumElements, SizeType NumElements, SIZE_T NumBytesPerElement,
+                              uint32 Alignment = FDarkestFearFrameArena::DefaultAlignment)
+        {
+            FScriptContainerElement* OldData = Data;
+
+            if (NumElements == 0)
+            {
+                Data = nullptr;
+                return;
+            }
+
+            Data = static_cast<FScriptContainerElement*>(FDarkestFearFrameArena::Get().Allocate(NumElements * NumBytesPerElement, Alignment));
+
+            if (OldData != nullptr && PreviousNumElements > 0)
+                FMemory::Memcpy(Data, OldData, FMath::Min(PreviousNumElements, NumElements) * NumBytesPerElement);
+        }
+
+        FORCEINLINE SizeType CalculateSlackReserve(SizeType NumElements, SIZE_T NumBytesPerElement) const
+        {
+            return DefaultCalculateSlackReserve(NumElements, NumBytesPerElement, false);
+        }
+
+        FORCEINLINE SizeType CalculateSlackShrink(SizeType NumElements, SizeType NumAllocatedElements, SIZE_T NumBytesPerElement) const
+        {
+            return DefaultCalculateSlackShrink(NumElements, NumAllocatedElements, NumBytesPerElement, false);
+        }
+
+        FORCEINLINE SizeType CalculateSlackGrow(SizeType NumElements, SizeType NumAllocatedElements, SIZE_T NumBytesPerElement) const
+        {
+            return DefaultCalculateSlackGrow(NumElements, NumAllocatedElements, NumBytesPerElement, false);
+        }
+
+        SIZE_T GetAllocatedSize(SizeType NumAllocatedElements, SIZE_T NumBytesPerElement) const
+        {
+            return NumAllocatedElements * NumBytesPerElement;
+        }
+
+        bool HasAllocation() const
+        {
+            return Data != nullptr;
+        }
+
+        SizeType GetInitialCapacity() const
+        {
+            return 0;
+        }
+
+    private:
+        ForAnyElementType(const ForAnyElementType&) = delete;
+        ForAnyElementType& operator=(const ForAnyElementType&) = delete;
+
+        FScriptContainerElement* Data;
+    };
+
+    template <typename ElementType>
+    class ForElementType : public ForAnyElementType
+    {
+    public:
+        FORCEINLINE ElementType* GetAllocation() const
+        {
+            return static_cast<ElementType*>(ForAnyElementType::GetAllocation());
+        }
+
+        void ResizeAllocation(SizeType PreviousNumElements, SizeType NumElements, SIZE_T NumBytesPerElement)
+        {
+            ForAnyElementType::ResizeAllocation(PreviousNumElements, NumElements, NumBytesPerElement, alignof(ElementType));
+        }
+    };
+};
+
+template <>
+struct TAllocatorTraits<FDarkestFearFrameAllocator> : TAllocatorTraitsBase<FDarkestFearFrameAllocator>
+{
+    enum { SupportsMove = true };
+};
+
+/** Gameplay paths whose heap allocations are counted on their own, see FDarkestFearAllocScope */
+enum class EDarkestFearAllocScope : uint8
+{
+    Placement,
+    PickUp,
+    Fire,
+
+    Count
+};
+
+/**
+ * Counts general heap allocations made on the game thread, per frame and inside each FDarkestFearAllocScope. Wraps
+ * GMalloc, so it is only installed when the game runs with -DarkestFearCountAllocs, and never in Shipping.
+ *
+ * Console commands:
+ *   DarkestFear.AllocWatch [Frames=300]  Heap allocations of placement, pickup and firing over the next frames,
+ *                                        errors if any of them allocated. Whole frames are reported for reference
+ *   DarkestFear.ArenaBench [Iterations]  Placement-mode temporaries built on the heap and in the frame arena
+ *
+ * The DarkestFear.FrameArena automation tests check that a warm arena frame makes no heap allocations.
+ */
+class DARKESTFEAR_API FDarkestFearAllocCounter
+{
+public:
+    static void Startup();
+    static void Shutdown();
+
+    static bool IsEnabled();
+
+    /** Game thread allocations so far this frame */
+    static int32 GetFrameAllocations();
+
+    /** Game thread allocations of the previous frame */
+    static int32 GetLastFrameAllocations();
+
+    /** Game thread allocations since startup, never reset */
+    static int64 GetTotalAllocations();
+};
+
+/**
+ * Counts the game thread heap allocations of a gameplay path while it is alive, for DarkestFear.AllocWatch. Engine
+ * work the path can't avoid, such as spawning an actor or sending an RPC, is left out with
+ * FDarkestFearAllocScope::FExclude. Costs nothing unless allocations are being counted.
+ */
+class DARKESTFEAR_API FDarkestFearAllocScope
+{
+public:
+    explicit FDarkestFearAllocScope(EDarkestFearAllocScope InScope);
+    ~FDarkestFearAllocScope();
+
+    /** Allocations made while it is alive don't count towards the enclosing scopes */
+    class DARKESTFEAR_API FExclude
+    {
+    public:
+        FExclude();
+        ~FExclude();
+
+    private:
+        int64 StartAllocations;
+    };
+
+private:
+    EDarkestFearAllocScope Scope;
+    int64 StartAllocations;
+    int64 StartExcluded;
+};
+
+#if !UE_BUILD_SHIPPING
+#define DARKESTFEAR_ALLOC_SCOPE(Scope) FDarkestFearAllocScope ANONYMOUS_VARIABLE(DarkestFearAllocScope)(EDarkestFearAllocScope::Scope)
+#define DARKESTFEAR_ALLOC_EXCLUDE() FDarkestFearAllocScope::FExclude ANONYMOUS_VARIABLE(DarkestFearAllocExclude)
+#else
+#define DARKESTFEAR_ALLOC_SCOPE(Scope)
+#define DARKESTFEAR_ALLOC_EXCLUDE()
+#endif
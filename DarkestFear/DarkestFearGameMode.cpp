@@ -3,6 +3,8 @@
 #include "DarkestFearGameMode.h"
 #include "DarkestFearHUD.h"
 #include "DarkestFearCharacter.h"
+#include "DarkestFearPlayerController.h"
+#include "Engine/World.h"
 #include "UObject/ConstructorHelpers.h"
 
 ADarkestFearGameMode::ADarkestFearGameMode()
@@ -14,4 +16,22 @@ ADarkestFearGameMode::ADarkestFearGameMode()
 
 	// use our custom HUD class
 	HUDClass = ADarkestFearHUD::StaticClass();
+
+	// carries inventories through seamless travel
+	PlayerControllerClass = ADarkestFearPlayerController::StaticClass();
+	bUseSeamlessTravel = true;
+}
+
+void ADarkestFearGameMode::GetSeamlessTravelActorList(bool bToTransition, TArray<AActor*>& ActorList)
+{
+	Super::GetSeamlessTravelActorList(bToTransition, ActorList);
+
+	// local controllers are asked by the engine themselves
+	for (FConstPlayerControllerIterator It = GetWorld()->GetPlayerControllerIterator(); It; ++It)
+	{
+		ADarkestFearPlayerController* PlayerController = Cast<ADarkestFearPlayerController>(It->Get());
+
+		if (PlayerController != nullptr && !PlayerController->IsLocalController())
+			PlayerController->AddTravellingActors(bToTransition, ActorList);
+	}
 }
@@ -13,6 +13,8 @@ class ADarkestFearGameMode : public AGameModeBase
 
 public:
 	ADarkestFearGameMode();
+
+	virtual void GetSeamlessTravelActorList(bool bToTransition, TArray<AActor*>& ActorList) override;
 };
 
 
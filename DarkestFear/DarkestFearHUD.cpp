@@ -1,6 +1,7 @@
 // Copyright Epic Games, Inc. All Rights Reserved.
 
 #include "DarkestFearHUD.h"
+#include "DarkestFearMemory.h"
 #include "Engine/Canvas.h"
 #include "Engine/Texture2D.h"
 #include "TextureResource.h"
@@ -9,6 +10,8 @@
 
 ADarkestFearHUD::ADarkestFearHUD()
 {
+	DARKESTFEAR_LLM_SCOPE(STAT_DarkestFearHUDLLM);
+
 	// Set the crosshair texture
 	static ConstructorHelpers::FObjectFinder<UTexture2D> CrosshairTexObj(TEXT("/Game/FirstPerson/Textures/FirstPersonCrosshair"));
 	CrosshairTex = CrosshairTexObj.Object;
@@ -17,6 +20,8 @@ ADarkestFearHUD::ADarkestFearHUD()
 
 void ADarkestFearHUD::DrawHUD()
 {
+	DARKESTFEAR_LLM_SCOPE(STAT_DarkestFearHUDLLM);
+
 	Super::DrawHUD();
 
 	// Draw very simple crosshair
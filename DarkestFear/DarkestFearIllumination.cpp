@@ -0,0 +1,304 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DarkestFearIllumination.h"
+
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformFilemanager.h"
+#include "Items/Flashlight.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogDarkestFearIllumination, Log, All);
+
+float FDarkestFearIllumination::DistanceFalloff(float Distance, float Radius)
+{
+    if (Distance >= Radius)
+        return 0.f;
+
+    // Same window the renderer uses for inverse squared falloff
+    const float Window = FMath::Square(FMath::Clamp(1.f - FMath::Square(FMath::Square(Distance / Radius)), 0.f, 1.f));
+    const float DistanceMeters = Distance / 100.f;
+
+    return Window / (FMath::Square(DistanceMeters) + 1.f);
+}
+
+float FDarkestFearIllumination::ConeFalloff(float CosAngle, float CosInner, float CosOuter)
+{
+    return FMath::SmoothStep(CosOuter, FMath::Max(CosInner, CosOuter + KINDA_SMALL_NUMBER), CosAngle);
+}
+
+FString FDarkestFearIllumination::GetGridPath(const FString& MapName)
+{
+    return FPaths::ProjectContentDir() / TEXT("Illumination") / FPaths::GetBaseFilename(MapName) + TEXT(".dfil");
+}
+
+void UDarkestFearIlluminationSubsystem::OnWorldBeginPlay(UWorld& InWorld)
+{
+    Super::OnWorldBeginPlay(InWorld);
+
+    const FString MapName = UWorld::RemovePIEPrefix(InWorld.GetOutermost()->GetName());
+    const FString Path = FDarkestFearIllumination::GetGridPath(MapName);
+
+    if (!FPaths::FileExists(Path))
+    {
+        UE_LOG(LogDarkestFearIllumination, Verbose, TEXT("%s has no illumination grid"), *MapName);
+        return;
+    }
+
+    if (!LoadGrid(Path))
+        UE_LOG(LogDarkestFearIllumination, Warning, TEXT("Illumination grid %s is invalid, run the bake again"), *Path);
+}
+
+void UDarkestFearIlluminationSubsystem::Deinitialize()
+{
+    UnloadGrid();
+
+    Super::Deinitialize();
+}
+
+bool UDarkestFearIlluminationSubsystem::LoadGrid(const FString& Path)
+{
+    IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+
+    MappedFile.Reset(PlatformFile.OpenMapped(*Path));
+
+    if (MappedFile.IsValid())
+        MappedRegion.Reset(MappedFile->MapRegion(0, MappedFile->GetFileSize()));
+
+    int64 FileSize = 0;
+
+    if (MappedRegion.IsValid())
+    {
+        Header = reinterpret_cast<const FDarkestFearIlluminationHeader*>(MappedRegion->GetMappedPtr());
+        FileSize = MappedRegion->GetMappedSize();
+    }
+    else
+    {
+        // Platforms or pak files that can't map: keep the whole grid in memory instead
+        MappedFile.Reset();
+
+        if (!FFileHelper::LoadFileToArray(LoadedFile, *Path))
+            return false;
+
+        Header = reinterpret_cast<const FDarkestFearIlluminationHeader*>(LoadedFile.GetData());
+        FileSize = LoadedFile.Num();
+    }
+
+    if (!ValidateGrid(FileSize))
+    {
+        UnloadGrid();
+        return false;
+    }
+
+    return true;
+}
+
+bool UDarkestFearIlluminationSubsystem::ValidateGrid(int64 FileSize)
+{
+    if (FileSize < int64(sizeof(FDarkestFearIlluminationHeader)) ||
+        Header->Magic != FDarkestFearIlluminationHeader::FileMagic ||
+        Header->Version != FDarkestFearIlluminationHeader::FileVersion ||
+        Header->CellSize <= 0.f || Header->NumBricks.GetMin() <= 0 || Header->NumStoredBricks < 0)
+    {
+        return false;
+    }
+
+    const int64 NumBricks = int64(Header->NumBricks.X) * Header->NumBricks.Y * Header->NumBricks.Z;
+    const int64 IndexBytes = NumBricks * sizeof(uint32);
+    const int64 SampleBytes = int64(Header->NumStoredBricks) * FDarkestFearIlluminationHeader::BrickSamples * sizeof(FFloat16);
+
+    if (FileSize != int64(sizeof(FDarkestFearIlluminationHeader)) + IndexBytes + SampleBytes)
+        return false;
+
+    const uint32* Index = reinterpret_cast<const uint32*>(Header + 1);
+
+    // Lookups trust the index, a brick number past the stored bricks would read outside the file
+    for (int64 Brick = 0; Brick < NumBricks; Brick++)
+    {
+        if (!(Index[Brick] & FDarkestFearIlluminationHeader::UniformFlag) && Index[Brick] >= uint32(Header->NumStoredBricks))
+            return false;
+    }
+
+    BrickIndex = Index;
+    BrickSamples = reinterpret_cast<const FFloat16*>(BrickIndex + NumBricks);
+
+    return true;
+}
+
+void UDarkestFearIlluminationSubsystem::UnloadGrid()
+{
+    Header = nullptr;
+    BrickIndex = nullptr;
+    BrickSamples = nullptr;
+
+    // The region has to go before the file it maps
+    MappedRegion.Reset();
+    MappedFile.Reset();
+    LoadedFile.Empty();
+}
+
+float UDarkestFearIlluminationSubsystem::GetAmbientIllumination(const FVector& Location) const
+{
+    if (Header == nullptr)
+        return AmbientFallback;
+
+    constexpr int32 BrickCells = FDarkestFearIlluminationHeader::BrickCells;
+    constexpr int32 SamplesPerAxis = FDarkestFearIlluminationHeader::BrickSamplesPerAxis;
+
+    // Outside the grid the nearest border value is used
+    const FIntVector GridCells = Header->NumBricks * BrickCells;
+    const FVector Local = ((Location - Header->Origin) / Header->CellSize).BoundToBox(FVector::ZeroVector, FVector(GridCells));
+
+    // Clamped as integers: a float epsilon below the far border rounds back onto it once grids get large. The far
+    // border itself is the last cell at alpha 1
+    const FIntVector Cell(FMath::Clamp(FMath::FloorToInt(Local.X), 0, GridCells.X - 1),
+                          FMath::Clamp(FMath::FloorToInt(Local.Y), 0, GridCells.Y - 1),
+                          FMath::Clamp(FMath::FloorToInt(Local.Z), 0, GridCells.Z - 1));
+    const FVector Alpha = (Local - FVector(Cell)).BoundToBox(FVector::ZeroVector, FVector::OneVector);
+    const FIntVector Brick = Cell / BrickCells;
+
+    const uint32 Entry = BrickIndex[(Brick.Z * Header->NumBricks.Y + Brick.Y) * Header->NumBricks.X + Brick.X];
+
+    if (Entry & FDarkestFearIlluminationHeader::UniformFlag)
+    {
+        FFloat16 Value;
+        Value.Encoded = static_cast<uint16>(Entry);
+        return Value.GetFloat();
+    }
+
+    // Corner samples of the cell, all inside this brick thanks to the duplicated borders
+    const FIntVector InBrick = Cell - Brick * BrickCells;
+    const FFloat16* Samples = BrickSamples + int64(Entry) * FDarkestFearIlluminationHeader::BrickSamples;
+    const int32 Base = (InBrick.Z * SamplesPerAxis + InBrick.Y) * SamplesPerAxis + InBrick.X;
+
+    auto Sample = [Samples, Base](int32 X, int32 Y, int32 Z)
+    {
+        return Samples[Base + (Z * SamplesPerAxis + Y) * SamplesPerAxis + X].GetFloat();
+    };
+
+    const float Y0 = FMath::Lerp(FMath::Lerp(Sample(0, 0, 0), Sample(1, 0, 0), Alpha.X),
+                                 FMath::Lerp(Sample(0, 1, 0), Sample(1, 1, 0), Alpha.X), Alpha.Y);
+    const float Y1 = FMath::Lerp(FMath::Lerp(Sample(0, 0, 1), Sample(1, 0, 1), Alpha.X),
+                                 FMath::Lerp(Sample(0, 1, 1), Sample(1, 1, 1), Alpha.X), Alpha.Y);
+
+    return FMath::Lerp(Y0, Y1, Alpha.Z);
+}
+
+float UDarkestFearIlluminationSubsystem::GetIllumination(const FVector& Location) const
+{
+    float Illumination = GetAmbientIllumination(Location);
+
+    for (const TWeakObjectPtr<AFlashlight>& Flashlight : Flashlights)
+    {
+        if (const AFlashlight* Light = Flashlight.Get())
+            Illumination += Light->GetIlluminationAt(Location);
+    }
+
+    return Illumination;
+}
+
+void UDarkestFearIlluminationSubsystem::RegisterFlashlight(AFlashlight* Flashlight)
+{
+    Flashlights.AddUnique(Flashlight);
+}
+
+void UDarkestFearIlluminationSubsystem::UnregisterFlashlight(AFlashlight* Flashlight)
+{
+    Flashlights.RemoveSwap(Flashlight);
+}
+
+FBox UDarkestFearIlluminationSubsystem::GetGridBounds() const
+{
+    if (Header == nullptr)
+        return FBox(ForceInit);
+
+    const FVector Extent = FVector(Header->NumBricks * FDarkestFearIlluminationHeader::BrickCells) * Header->CellSize;
+    return FBox(Header->Origin, Header->Origin + Extent);
+}
+
+int64 UDarkestFearIlluminationSubsystem::GetGridBytes() const
+{
+    if (MappedRegion.IsValid())
+        return MappedRegion->GetMappedSize();
+
+    return LoadedFile.Num();
+}
+
+void UDarkestFearIlluminationSubsystem::DumpStats(FOutputDevice& Ar) const
+{
+    if (Header == nullptr)
+    {
+        Ar.Logf(TEXT("No illumination grid, every query returns %.3f"), AmbientFallback);
+        return;
+    }
+
+    const int32 NumBricks = Header->NumBricks.X * Header->NumBricks.Y * Header->NumBricks.Z;
+
+    Ar.Logf(TEXT("Illumination grid: %dx%dx%d bricks of %d^3 cells, %.0f cm cells, %d of %d bricks stored (%.1f%%)"),
+            Header->NumBricks.X, Header->NumBricks.Y, Header->NumBricks.Z, FDarkestFearIlluminationHeader::BrickCells,
+            Header->CellSize, Header->NumStoredBricks, NumBricks, 100.f * Header->NumStoredBricks / FMath::Max(NumBricks, 1));
+    Ar.Logf(TEXT("  %.1f KB %s, %d flashlights registered"), GetGridBytes() / 1024.0,
+            MappedRegion.IsValid() ? TEXT("memory-mapped (resident only where queried)") : TEXT("loaded in memory"),
+            Flashlights.Num());
+}
+
+static FAutoConsoleCommandWithWorldArgsAndOutputDevice IlluminationStatsCommand(
+    TEXT("DarkestFear.IlluminationStats"),
+    TEXT("Logs the size and memory of this map's illumination grid"),
+    FConsoleCommandWithWorldArgsAndOutputDeviceDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World, FOutputDevice& Ar)
+    {
+        if (const UDarkestFearIlluminationSubsystem* Illumination = World ? World->GetSubsystem<UDarkestFearIlluminationSubsystem>() : nullptr)
+            Illumination->DumpStats(Ar);
+    }));
+
+static FAutoConsoleCommandWithWorldArgsAndOutputDevice IlluminationBenchCommand(
+    TEXT("DarkestFear.IlluminationBench"),
+    TEXT("DarkestFear.IlluminationBench [Queries=1000000]: illumination queries per second at random points of the grid"),
+    FConsoleCommandWithWorldArgsAndOutputDeviceDelegate::CreateLambda(
+        [](const TArray<FString>& Args, UWorld* World, FOutputDevice& Ar)
+        {
+            const UDarkestFearIlluminationSubsystem* Illumination = World ? World->GetSubsystem<UDarkestFearIlluminationSubsystem>() : nullptr;
+
+            if (Illumination == nullptr)
+                return;
+
+            const int32 NumQueries = Args.Num() > 0 ? FMath::Max(FCString::Atoi(*Args[0]), 1) : 1000000;
+
+            // Points inside the grid, where every query does a real lookup rather than clamping to the border. Maps
+            // without a grid only measure the fallback and flashlights, over a box around the origin
+            FBox Bounds = Illumination->GetGridBounds();
+
+            if (!Bounds.IsValid)
+                Bounds = FBox(FVector(-5000.f), FVector(5000.f));
+
+            // Generated up front so only the queries are timed
+            FRandomStream Random(3);
+            TArray<FVector> Points;
+            Points.Reserve(NumQueries);
+
+            for (int32 Index = 0; Index < NumQueries; Index++)
+            {
+                Points.Add(FVector(Random.FRandRange(Bounds.Min.X, Bounds.Max.X), Random.FRandRange(Bounds.Min.Y, Bounds.Max.Y),
+                                   Random.FRandRange(Bounds.Min.Z, Bounds.Max.Z)));
+            }
+
+            float Sum = 0.f;
+            double StartTime = FPlatformTime::Seconds();
+
+            for (const FVector& Point : Points)
+                Sum += Illumination->GetAmbientIllumination(Point);
+
+            const double AmbientSeconds = FPlatformTime::Seconds() - StartTime;
+            StartTime = FPlatformTime::Seconds();
+
+            for (const FVector& Point : Points)
+                Sum += Illumination->GetIllumination(Point);
+
+            const double TotalSeconds = FPlatformTime::Seconds() - StartTime;
+
+            Illumination->DumpStats(Ar);
+            Ar.Logf(TEXT("%d queries: ambient %.1f M/s, with flashlights %.1f M/s (checksum %f)"), NumQueries,
+                    NumQueries / FMath::Max(AmbientSeconds, 1e-9) / 1e6, NumQueries / FMath::Max(TotalSeconds, 1e-9) / 1e6, Sum);
+        }));
@@ -0,0 +1,116 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GenericPlatform/GenericPlatformFile.h"
+#include "Math/Float16.h"
+#include "Subsystems/WorldSubsystem.h"
+
+#include "DarkestFearIllumination.generated.h"
+
+/**
+ * On-disk layout of a baked ambient illumination grid, see UDarkestFearBakeIlluminationCommandlet.
+ *
+ * The level is covered by a grid of CellSize cells, grouped in bricks of BrickCells^3 cells. A brick whose
+ * samples are all about the same is stored as a single value in the index; every other brick stores its
+ * (BrickCells + 1)^3 corner samples, border samples included, so a trilinear lookup never leaves its brick.
+ *
+ *   FDarkestFearIlluminationHeader
+ *   uint32 Index[NumBricks.X * NumBricks.Y * NumBricks.Z]   X fastest. UniformFlag | half value, or brick number
+ *   FFloat16 Samples[NumStoredBricks][BrickSamples]         X fastest within a brick
+ *
+ * Values are in ULightComponent::ComputeLightBrightness units per square meter.
+ */
+struct FDarkestFearIlluminationHeader
+{
+    static constexpr uint32 FileMagic = 0x4C494644; // "DFIL"
+    static constexpr uint32 FileVersion = 1;
+
+    static constexpr int32 BrickCells = 4;
+    static constexpr int32 BrickSamplesPerAxis = BrickCells + 1;
+    static constexpr int32 BrickSamples = BrickSamplesPerAxis * BrickSamplesPerAxis * BrickSamplesPerAxis;
+    static constexpr uint32 UniformFlag = 0x80000000;
+
+    uint32 Magic;
+    uint32 Version;
+    FVector Origin;
+    float CellSize;
+    FIntVector NumBricks;
+    int32 NumStoredBricks;
+};
+
+/** Light helpers shared by the bake and the runtime dynamic lights, so both agree on units and falloff */
+struct DARKESTFEAR_API FDarkestFearIllumination
+{
+    /** Inverse square falloff, windowed to reach zero at Radius. Distances in cm, falloff in 1/m^2 */
+    static float DistanceFalloff(float Distance, float Radius);
+
+    /** Smooth cone falloff between the inner and outer cone angle cosines */
+    static float ConeFalloff(float CosAngle, float CosInner, float CosOuter);
+
+    /** Where the grid file of a map lives: <Project>/Content/Illumination/<Map>.dfil */
+    static FString GetGridPath(const FString& MapName);
+};
+
+/**
+ * Answers "how lit is this spot" in O(1): the static lighting baked into the map's illumination grid, sampled with
+ * trilinear interpolation, plus every lit flashlight. The grid file is memory-mapped when the world begins play,
+ * so only the pages a query touches are ever read. Maps without a grid answer with AmbientFallback.
+ *
+ * The grid is a loose file, it has to be staged with DirectoriesToAlwaysStageAsNonUFS=(Path="Illumination") so it
+ * can be mapped in packaged builds; when mapping is not possible the file is read into memory instead.
+ *
+ * Console commands:
+ *   DarkestFear.IlluminationStats          Grid size, stored bricks and resident memory of this map
+ *   DarkestFear.IlluminationBench [Count]  Query throughput, ambient only and with flashlights
+ */
+UCLASS()
+class DARKESTFEAR_API UDarkestFearIlluminationSubsystem : public UWorldSubsystem
+{
+    GENERATED_BODY()
+
+public:
+    virtual void OnWorldBeginPlay(UWorld& InWorld) override;
+    virtual void Deinitialize() override;
+
+    /** Baked static illumination at Location, AmbientFallback if the map has no grid */
+    float GetAmbientIllumination(const FVector& Location) const;
+
+    /** Baked illumination plus the contribution of every lit flashlight. Flashlights are not occluded */
+    float GetIllumination(const FVector& Location) const;
+
+    void RegisterFlashlight(class AFlashlight* Flashlight);
+    void UnregisterFlashlight(class AFlashlight* Flashlight);
+
+    bool HasGrid() const { return Header != nullptr; }
+
+    /** World space box the grid covers, invalid without a grid */
+    FBox GetGridBounds() const;
+
+    /** Bytes of the grid file, mapped or loaded */
+    int64 GetGridBytes() const;
+
+    void DumpStats(FOutputDevice& Ar) const;
+
+    /** Illumination reported where no grid was baked */
+    float AmbientFallback = 0.f;
+
+private:
+    TUniquePtr<IMappedFileHandle> MappedFile;
+    TUniquePtr<IMappedFileRegion> MappedRegion;
+
+    // Used when the file can't be mapped
+    TArray<uint8> LoadedFile;
+
+    // Point into the mapped region or LoadedFile
+    const FDarkestFearIlluminationHeader* Header = nullptr;
+    const uint32* BrickIndex = nullptr;
+    const FFloat16* BrickSamples = nullptr;
+
+    TArray<TWeakObjectPtr<class AFlashlight>> Flashlights;
+
+    bool LoadGrid(const FString& Path);
+    bool ValidateGrid(int64 FileSize);
+    void UnloadGrid();
+};
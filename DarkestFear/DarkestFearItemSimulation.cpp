@@ -0,0 +1,256 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DarkestFearItemSimulation.h"
+
+#include "Async/ParallelFor.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+
+DECLARE_CYCLE_STAT(TEXT("DarkestFear Item Simulation"), STAT_DarkestFearItemSimulation, STATGROUP_Game);
+DECLARE_CYCLE_STAT(TEXT("DarkestFear Item Simulation Commit"), STAT_DarkestFearItemSimulationCommit, STATGROUP_Game);
+
+int32 UDarkestFearItemSimulationSubsystem::NextPoolId = 0;
+
+void UDarkestFearItemSimulationSubsystem::Deinitialize()
+{
+    // Items that ended play already left, whatever is still here travels on to the next world
+    for (const TUniquePtr<FDarkestFearItemSimPoolBase>& Pool : Pools)
+    {
+        if (Pool.IsValid())
+            Pool->ReleaseAll();
+    }
+
+    Pools.Reset();
+
+    Super::Deinitialize();
+}
+
+void UDarkestFearItemSimulationSubsystem::Simulate(float DeltaTime)
+{
+    check(IsInGameThread());
+
+    {
+        SCOPE_CYCLE_COUNTER(STAT_DarkestFearItemSimulation);
+
+        Jobs.Reset();
+
+        for (const TUniquePtr<FDarkestFearItemSimPoolBase>& Pool : Pools)
+        {
+            if (!Pool.IsValid())
+                continue;
+
+            for (int32 First = 0; First < Pool->Num(); First += StatesPerTask)
+                Jobs.Add({Pool.Get(), First, FMath::Min(First + StatesPerTask, Pool->Num())});
+        }
+
+        // A handful of states is cheaper to run here than to hand out
+        ParallelFor(Jobs.Num(), [this, DeltaTime](int32 JobIndex)
+        {
+            const FJob& Job = Jobs[JobIndex];
+            Job.Pool->Update(Job.First, Job.Last, DeltaTime);
+        }, Jobs.Num() < 2);
+    }
+
+    SCOPE_CYCLE_COUNTER(STAT_DarkestFearItemSimulationCommit);
+
+    for (const TUniquePtr<FDarkestFearItemSimPoolBase>& Pool : Pools)
+    {
+        if (Pool.IsValid())
+            Pool->Commit();
+    }
+}
+
+int32 UDarkestFearItemSimulationSubsystem::GetNumStates() const
+{
+    int32 NumStates = 0;
+
+    for (const TUniquePtr<FDarkestFearItemSimPoolBase>& Pool : Pools)
+    {
+        if (Pool.IsValid())
+            NumStates += Pool->Num();
+    }
+
+    return NumStates;
+}
+
+SIZE_T UDarkestFearItemSimulationSubsystem::GetAllocatedSize() const
+{
+    SIZE_T Bytes = Pools.GetAllocatedSize() + Jobs.GetAllocatedSize();
+
+    for (const TUniquePtr<FDarkestFearItemSimPoolBase>& Pool : Pools)
+    {
+        if (Pool.IsValid())
+            Bytes += Pool->GetAllocatedSize();
+    }
+
+    return Bytes;
+}
+
+void UDarkestFearItemSimulationSubsystem::Tick(float DeltaTime)
+{
+    Simulate(DeltaTime);
+}
+
+bool UDarkestFearItemSimulationSubsystem::IsTickable() const
+{
+    const UWorld* World = GetWorld();
+    return !IsTemplate() && World != nullptr && World->IsGameWorld();
+}
+
+TStatId UDarkestFearItemSimulationSubsystem::GetStatId() const
+{
+    RETURN_QUICK_DECLARE_CYCLE_STAT(UDarkestFearItemSimulationSubsystem, STATGROUP_Tickables);
+}
+
+FDarkestFearItemSimChanges FDarkestFearItemSimBenchState::Simulate(FDarkestFearItemSimBenchState& State, float DeltaTime)
+{
+    if (!State.bIsOn)
+        return 0;
+
+    State.Charge -= State.DrainPerSecond * DeltaTime;
+
+    if (State.Charge > 0.f)
+        return 0;
+
+    State.Charge = 0.f;
+    State.bIsOn = false;
+
+    return 1;
+}
+
+ADarkestFearItemSimBenchActor::ADarkestFearItemSimBenchActor()
+{
+    PrimaryActorTick.bCanEverTick = true;
+}
+
+void ADarkestFearItemSimBenchActor::Tick(float DeltaTime)
+{
+    Super::Tick(DeltaTime);
+
+    if (const FDarkestFearItemSimChanges Changes = FDarkestFearItemSimBenchState::Simulate(State, DeltaTime))
+        CommitSimulation(State, Changes);
+}
+
+void ADarkestFearItemSimBenchActor::CommitSimulation(const FDarkestFearItemSimBenchState& InState,
+                                                     FDarkestFearItemSimChanges Changes)
+{
+    NumChanges++;
+}
+
+static FAutoConsoleCommandWithWorldArgsAndOutputDevice ItemSimBenchCommand(
+    TEXT("DarkestFear.ItemSimBench"),
+    TEXT("DarkestFear.ItemSimBench [Counts=10000 100000]: per frame cost of battery drain on ticking actors, and "
+         "through the item simulation run serially and in parallel"),
+    FConsoleCommandWithWorldArgsAndOutputDeviceDelegate::CreateLambda(
+        [](const TArray<FString>& Args, UWorld* World, FOutputDevice& Ar)
+        {
+            if (World == nullptr)
+                return;
+
+            TArray<int32> Counts;
+
+            for (const FString& Arg : Args)
+                Counts.Add(FMath::Max(FCString::Atoi(*Arg), 1));
+
+            if (Counts.Num() == 0)
+                Counts = {10000, 100000};
+
+            constexpr int32 NumFrames = 100;
+            constexpr float DeltaTime = 1.f / 60.f;
+
+            FActorSpawnParameters SpawnParams;
+            SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+            SpawnParams.ObjectFlags |= RF_Transient;
+
+            for (const int32 Count : Counts)
+            {
+                // Batteries running out all along the run, so commits are part of the cost
+                FRandomStream Random(3);
+                TArray<FDarkestFearItemSimBenchState> InitialStates;
+
+                for (int32 Index = 0; Index < Count; Index++)
+                    InitialStates.Add({Random.FRandRange(0.f, 2.f), 1.f, true});
+
+                TArray<ADarkestFearItemSimBenchActor*> Actors;
+                Actors.Reserve(Count);
+
+                for (int32 Index = 0; Index < Count; Index++)
+                {
+                    ADarkestFearItemSimBenchActor* Actor = World->SpawnActor<ADarkestFearItemSimBenchActor>(SpawnParams);
+                    Actor->State = InitialStates[Index];
+                    Actors.Add(Actor);
+                }
+
+                // What the tick manager does for each of them, minus the scheduling around it
+                double StartTime = FPlatformTime::Seconds();
+
+                for (int32 Frame = 0; Frame < NumFrames; Frame++)
+                {
+                    for (ADarkestFearItemSimBenchActor* Actor : Actors)
+                        Actor->TickActor(DeltaTime, LEVELTICK_All, Actor->PrimaryActorTick);
+                }
+
+                const double TickSeconds = FPlatformTime::Seconds() - StartTime;
+                int32 TickChanges = 0;
+
+                for (ADarkestFearItemSimBenchActor* Actor : Actors)
+                {
+                    TickChanges += Actor->NumChanges;
+                    Actor->NumChanges = 0;
+                }
+
+                // Same actors, committed to by the pool instead of ticking
+                TDarkestFearItemSimPool<FDarkestFearItemSimBenchState, ADarkestFearItemSimBenchActor> Pool;
+
+                for (int32 Index = 0; Index < Count; Index++)
+                    Pool.Add(Actors[Index], InitialStates[Index]);
+
+                StartTime = FPlatformTime::Seconds();
+
+                for (int32 Frame = 0; Frame < NumFrames; Frame++)
+                {
+                    Pool.Update(0, Count, DeltaTime);
+                    Pool.Commit();
+                }
+
+                const double SerialSeconds = FPlatformTime::Seconds() - StartTime;
+
+                for (int32 Index = 0; Index < Count; Index++)
+                    Pool.GetState(Index) = InitialStates[Index];
+
+                const int32 NumTasks = FMath::DivideAndRoundUp(Count, UDarkestFearItemSimulationSubsystem::StatesPerTask);
+
+                StartTime = FPlatformTime::Seconds();
+
+                for (int32 Frame = 0; Frame < NumFrames; Frame++)
+                {
+                    ParallelFor(NumTasks, [&Pool, Count](int32 Task)
+                    {
+                        const int32 First = Task * UDarkestFearItemSimulationSubsystem::StatesPerTask;
+                        Pool.Update(First, FMath::Min(First + UDarkestFearItemSimulationSubsystem::StatesPerTask, Count), DeltaTime);
+                    });
+
+                    Pool.Commit();
+                }
+
+                const double ParallelSeconds = FPlatformTime::Seconds() - StartTime;
+                int32 SimChanges = 0;
+
+                for (ADarkestFearItemSimBenchActor* Actor : Actors)
+                {
+                    SimChanges += Actor->NumChanges;
+                    Actor->Destroy();
+                }
+
+                Ar.Logf(TEXT("%d items, %d frames (%d batteries ran out, %d expected)"), Count, NumFrames, SimChanges / 2,
+                        TickChanges);
+                Ar.Logf(TEXT("  Actor ticks:          %8.3f ms/frame"), TickSeconds * 1000.0 / NumFrames);
+                Ar.Logf(TEXT("  Simulation, serial:   %8.3f ms/frame  %.1fx"), SerialSeconds * 1000.0 / NumFrames,
+                        TickSeconds / FMath::Max(SerialSeconds, 1e-9));
+                Ar.Logf(TEXT("  Simulation, parallel: %8.3f ms/frame  %.1fx"), ParallelSeconds * 1000.0 / NumFrames,
+                        TickSeconds / FMath::Max(ParallelSeconds, 1e-9));
+            }
+
+            CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS);
+        }));
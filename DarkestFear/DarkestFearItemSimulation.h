@@ -0,0 +1,257 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+
+#include "DarkestFearItemSimulation.generated.h"
+
+/** Bit mask of presentation changes a simulation kernel reports back, defined by each state type. 0 means none */
+typedef uint8 FDarkestFearItemSimChanges;
+
+/** Type-erased pool, so the subsystem can update the states of every item class together */
+class FDarkestFearItemSimPoolBase
+{
+public:
+    virtual ~FDarkestFearItemSimPoolBase() = default;
+
+    /** Runs the kernel over states [First, Last). Called from worker threads, touches nothing but the states */
+    virtual void Update(int32 First, int32 Last, float DeltaTime) = 0;
+
+    /** Hands the changes the last Update reported to their items. Game thread */
+    virtual void Commit() = 0;
+
+    /** Gives every state back to its item and empties the pool, for items that outlive the world */
+    virtual void ReleaseAll() = 0;
+
+    virtual int32 Num() const = 0;
+    virtual SIZE_T GetAllocatedSize() const = 0;
+};
+
+/**
+ * Simulated states of one item class, packed together. TState is plain data with a pure kernel:
+ *
+ *   static FDarkestFearItemSimChanges Simulate(TState& State, float DeltaTime);
+ *
+ * and TItem applies whatever the kernel reported on the game thread:
+ *
+ *   void CommitSimulation(const TState& State, FDarkestFearItemSimChanges Changes);
+ *
+ * and keeps what it needs of its state when the world goes away without ending its play, as seamless travel does:
+ *
+ *   void ReleaseSimulation(const TState& State);
+ */
+template <typename TState, typename TItem>
+class TDarkestFearItemSimPool final : public FDarkestFearItemSimPoolBase
+{
+public:
+    int32 Add(TItem* Item, const TState& State)
+    {
+        Items.Add(Item);
+        Changes.Add(0);
+        return States.Add(State);
+    }
+
+    /** Removes the state at Index by moving the last one into it. Returns the item that moved, if any */
+    TItem* RemoveAtSwap(int32 Index)
+    {
+        Items.RemoveAtSwap(Index, 1, false);
+        States.RemoveAtSwap(Index, 1, false);
+        Changes.RemoveAtSwap(Index, 1, false);
+
+        return Items.IsValidIndex(Index) ? Items[Index] : nullptr;
+    }
+
+    TState& GetState(int32 Index) { return States[Index]; }
+
+    virtual void Update(int32 First, int32 Last, float DeltaTime) override
+    {
+        for (int32 Index = First; Index < Last; Index++)
+            Changes[Index] = TState::Simulate(States[Index], DeltaTime);
+    }
+
+    virtual void Commit() override
+    {
+        // Backwards, so items leaving the pool while committing only ever move already committed states around
+        for (int32 Index = States.Num() - 1; Index >= 0; Index--)
+        {
+            if (Changes[Index] == 0)
+                continue;
+
+            const FDarkestFearItemSimChanges ItemChanges = Changes[Index];
+            Changes[Index] = 0;
+
+            if (Items[Index] != nullptr)
+                Items[Index]->CommitSimulation(States[Index], ItemChanges);
+        }
+    }
+
+    virtual void ReleaseAll() override
+    {
+        for (int32 Index = 0; Index < States.Num(); Index++)
+        {
+            if (Items[Index] != nullptr)
+            {
+                Items[Index]->SimulationIndex = INDEX_NONE;
+                Items[Index]->ReleaseSimulation(States[Index]);
+            }
+        }
+
+        Items.Reset();
+        States.Reset();
+        Changes.Reset();
+    }
+
+    virtual int32 Num() const override { return States.Num(); }
+
+    virtual SIZE_T GetAllocatedSize() const override
+    {
+        return States.GetAllocatedSize() + Items.GetAllocatedSize() + Changes.GetAllocatedSize();
+    }
+
+private:
+    TArray<TState> States;
+    TArray<TItem*> Items;
+    TArray<FDarkestFearItemSimChanges> Changes;
+};
+
+/**
+ * Per-frame item state (battery drain, charge, timers) without per-item ticks. Each item class keeps its simulated
+ * state in a plain struct registered here; once per frame every state of every class is advanced by its kernel in
+ * parallel on the task graph, and only the items whose kernel reported a presentation change (a battery running
+ * out turns the light off) are called back, on the game thread.
+ *
+ * Items register in BeginPlay and unregister in EndPlay. States may be read and written on the game thread at any
+ * time outside the update. Items still registered when the world goes away (carried by seamless travel) get their
+ * state back through ReleaseSimulation and register again in the next world.
+ *
+ * Console commands:
+ *   DarkestFear.ItemSimBench [Counts=10000 100000]  Per-actor ticking against the serial and parallel simulation
+ *
+ * The DarkestFear.ItemSimulation automation tests check that parallel updates match serial ones, and a flashlight's
+ * battery end to end.
+ */
+UCLASS()
+class DARKESTFEAR_API UDarkestFearItemSimulationSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+    GENERATED_BODY()
+
+public:
+    virtual void Deinitialize() override;
+
+    template <typename TState, typename TItem>
+    void Register(TItem* Item, const TState& State)
+    {
+        check(Item->SimulationIndex == INDEX_NONE);
+        Item->SimulationIndex = GetPool<TState, TItem>().Add(Item, State);
+    }
+
+    template <typename TState, typename TItem>
+    void Unregister(TItem* Item)
+    {
+        if (Item->SimulationIndex == INDEX_NONE)
+            return;
+
+        if (TItem* Moved = GetPool<TState, TItem>().RemoveAtSwap(Item->SimulationIndex))
+            Moved->SimulationIndex = Item->SimulationIndex;
+
+        Item->SimulationIndex = INDEX_NONE;
+    }
+
+    /** State of a registered item, nullptr if it is not registered */
+    template <typename TState, typename TItem>
+    TState* GetState(const TItem* Item)
+    {
+        const int32 PoolId = GetPoolId<TState>();
+
+        if (Item->SimulationIndex == INDEX_NONE || !Pools.IsValidIndex(PoolId) || !Pools[PoolId].IsValid())
+            return nullptr;
+
+        using FPool = TDarkestFearItemSimPool<TState, typename TRemoveConst<TItem>::Type>;
+        return &static_cast<FPool&>(*Pools[PoolId]).GetState(Item->SimulationIndex);
+    }
+
+    /** Advances every state and commits what changed */
+    void Simulate(float DeltaTime);
+
+    int32 GetNumStates() const;
+    SIZE_T GetAllocatedSize() const;
+
+    /** States a single task advances */
+    static constexpr int32 StatesPerTask = 1024;
+
+    // FTickableGameObject
+    virtual void Tick(float DeltaTime) override;
+    virtual bool IsTickable() const override;
+    virtual TStatId GetStatId() const override;
+
+private:
+    struct FJob
+    {
+        FDarkestFearItemSimPoolBase* Pool;
+        int32 First;
+        int32 Last;
+    };
+
+    // Indexed by pool id, see GetPoolId
+    TArray<TUniquePtr<FDarkestFearItemSimPoolBase>> Pools;
+
+    // Rebuilt every frame, kept to not allocate
+    TArray<FJob> Jobs;
+
+    static int32 NextPoolId;
+
+    template <typename TState>
+    static int32 GetPoolId()
+    {
+        static const int32 PoolId = NextPoolId++;
+        return PoolId;
+    }
+
+    template <typename TState, typename TItem>
+    TDarkestFearItemSimPool<TState, TItem>& GetPool()
+    {
+        const int32 PoolId = GetPoolId<TState>();
+
+        if (PoolId >= Pools.Num())
+            Pools.SetNum(PoolId + 1);
+
+        if (!Pools[PoolId].IsValid())
+            Pools[PoolId] = MakeUnique<TDarkestFearItemSimPool<TState, TItem>>();
+
+        return static_cast<TDarkestFearItemSimPool<TState, TItem>&>(*Pools[PoolId]);
+    }
+};
+
+/** Same work as a flashlight's battery, for DarkestFear.ItemSimBench */
+struct FDarkestFearItemSimBenchState
+{
+    float Charge;
+    float DrainPerSecond;
+    bool bIsOn;
+
+    static FDarkestFearItemSimChanges Simulate(FDarkestFearItemSimBenchState& State, float DeltaTime);
+};
+
+/** The per-actor ticking side of DarkestFear.ItemSimBench */
+UCLASS(NotPlaceable, Transient)
+class ADarkestFearItemSimBenchActor : public AActor
+{
+    GENERATED_BODY()
+
+public:
+    ADarkestFearItemSimBenchActor();
+
+    FDarkestFearItemSimBenchState State;
+    int32 NumChanges = 0;
+
+    virtual void Tick(float DeltaTime) override;
+
+    void CommitSimulation(const FDarkestFearItemSimBenchState& InState, FDarkestFearItemSimChanges Changes);
+    void ReleaseSimulation(const FDarkestFearItemSimBenchState& InState) {}
+
+    int32 SimulationIndex = INDEX_NONE;
+};
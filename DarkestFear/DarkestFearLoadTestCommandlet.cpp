@@ -0,0 +1,198 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DarkestFearLoadTestCommandlet.h"
+
+#include "DarkestFearServerStats.h"
+#include "HAL/PlatformProcess.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogDarkestFearLoadTest, Log, All);
+
+UDarkestFearLoadTestCommandlet::UDarkestFearLoadTestCommandlet()
+{
+    IsClient = false;
+    IsServer = false;
+    IsEditor = false;
+    LogToConsole = true;
+}
+
+int32 UDarkestFearLoadTestCommandlet::Main(const FString& Params)
+{
+    FString Map;
+    int32 NumBots = 64;
+    float Duration = 300.f;
+    int32 Port = 7777;
+    int32 BotFPS = 15;
+    int32 PktLag = 0;
+    FString ReportPath = FPaths::ProjectSavedDir() / TEXT("LoadTest/Report.txt");
+    FString ServerExe = FPlatformProcess::ExecutablePath();
+    FString ClientExe = ServerExe;
+
+    if (!FParse::Value(*Params, TEXT("Map="), Map))
+    {
+        UE_LOG(LogDarkestFearLoadTest, Error, TEXT("Missing -Map=<map to host>"));
+        return 1;
+    }
+
+    FParse::Value(*Params, TEXT("Bots="), NumBots);
+    FParse::Value(*Params, TEXT("Duration="), Duration);
+    FParse::Value(*Params, TEXT("Port="), Port);
+    FParse::Value(*Params, TEXT("BotFPS="), BotFPS);
+    FParse::Value(*Params, TEXT("PktLag="), PktLag);
+    FParse::Value(*Params, TEXT("Report="), ReportPath);
+
+    // Packaged executables know their project, the editor binary needs it passed in
+    const bool bCustomServer = FParse::Value(*Params, TEXT("ServerExe="), ServerExe);
+    const bool bCustomClient = FParse::Value(*Params, TEXT("ClientExe="), ClientExe);
+    const FString ProjectArg = FString::Printf(TEXT("\"%s\" "), *FPaths::ConvertRelativePathToFull(FPaths::GetProjectFilePath()));
+
+    const FString CsvPath = FPaths::ConvertRelativePathToFull(FPaths::GetPath(ReportPath) / TEXT("ServerStats.csv"));
+    IFileManager::Get().Delete(*CsvPath);
+    IFileManager::Get().MakeDirectory(*FPaths::GetPath(CsvPath), true);
+
+    const FString ServerArgs = FString::Printf(TEXT("%s%s -server -log -unattended -port=%d -LoadTestStats=\"%s\""),
+                                               bCustomServer ? TEXT("") : *ProjectArg, *Map, Port, *CsvPath);
+
+    FProcHandle Server = FPlatformProcess::CreateProc(*ServerExe, *ServerArgs, true, true, true, nullptr, 0, nullptr, nullptr);
+
+    if (!Server.IsValid())
+    {
+        UE_LOG(LogDarkestFearLoadTest, Error, TEXT("Could not start server %s %s"), *ServerExe, *ServerArgs);
+        return 1;
+    }
+
+    // Give the server time to load the map before the first connection
+    FPlatformProcess::Sleep(10.f);
+
+    TArray<FProcHandle> Bots;
+    Bots.Reserve(NumBots);
+
+    for (int32 Index = 0; Index < NumBots; Index++)
+    {
+        // Bots render nothing, play no sound and tick slowly so 64+ of them fit on the server's machine.
+        // PktLag delays their outgoing packets, which puts their predicted pickups further behind the server
+        const FString ClientArgs = FString::Printf(
+            TEXT("%s127.0.0.1:%d -game -nullrhi -nosound -unattended -NoVerifyGC -DarkestFearBot -BotSeed=%d -FPS=%d -ExecCmds=\"t.MaxFPS %d, Net PktLag=%d\""),
+            bCustomClient ? TEXT("") : *ProjectArg, Port, Index, BotFPS, BotFPS, PktLag);
+
+        FProcHandle Bot = FPlatformProcess::CreateProc(*ClientExe, *ClientArgs, true, true, true, nullptr, 0, nullptr, nullptr);
+
+        if (Bot.IsValid())
+            Bots.Add(Bot);
+        else
+            UE_LOG(LogDarkestFearLoadTest, Warning, TEXT("Bot %d failed to start"), Index);
+
+        // Staggered joins avoid measuring a login storm
+        FPlatformProcess::Sleep(.25f);
+    }
+
+    UE_LOG(LogDarkestFearLoadTest, Display, TEXT("%d bots running, measuring for %.0fs"), Bots.Num(), Duration);
+
+    const double EndTime = FPlatformTime::Seconds() + Duration;
+
+    while (FPlatformTime::Seconds() < EndTime && FPlatformProcess::IsProcRunning(Server))
+    {
+        FPlatformProcess::Sleep(1.f);
+    }
+
+    for (FProcHandle& Bot : Bots)
+    {
+        FPlatformProcess::TerminateProc(Bot, true);
+        FPlatformProcess::CloseProc(Bot);
+    }
+
+    FPlatformProcess::TerminateProc(Server, true);
+    FPlatformProcess::CloseProc(Server);
+
+    const FString Report = BuildReport(CsvPath, Bots.Num(), Duration);
+    FFileHelper::SaveStringToFile(Report, *ReportPath);
+
+    UE_LOG(LogDarkestFearLoadTest, Display, TEXT("%s"), *Report);
+    UE_LOG(LogDarkestFearLoadTest, Display, TEXT("Report written to %s"), *ReportPath);
+
+    return 0;
+}
+
+FString UDarkestFearLoadTestCommandlet::BuildReport(const FString& CsvPath, int32 NumBots, float Duration)
+{
+    TArray<FString> Lines;
+
+    if (!FFileHelper::LoadFileToStringArray(Lines, *CsvPath) || Lines.Num() < 2)
+        return FString::Printf(TEXT("No server stats were written to %s"), *CsvPath);
+
+    TArray<float> FrameMs;
+    float MaxFrameMs = 0.f;
+    float InKBps = 0.f;
+    float OutKBps = 0.f;
+    float PeakUsedMB = 0.f;
+    int32 MaxClients = 0;
+    int32 Samples = 0;
+    int32 PredictionsAccepted = 0;
+    int32 PredictionsRejected = 0;
+    int32 PickUps = 0;
+
+    // Skip the header: Time,Clients,Frames,AvgFrameMs,MaxFrameMs,InKBps,OutKBps,UsedMB,PredictionsAccepted,PredictionsRejected,PickUps
+    for (int32 Index = 1; Index < Lines.Num(); Index++)
+    {
+        TArray<FString> Columns;
+
+        if (Lines[Index].ParseIntoArray(Columns, TEXT(",")) < 8)
+            continue;
+
+        const int32 Clients = FCString::Atoi(*Columns[1]);
+        MaxClients = FMath::Max(MaxClients, Clients);
+        PeakUsedMB = FMath::Max(PeakUsedMB, FCString::Atof(*Columns[7]));
+
+        // Running totals, the last row has them all
+        if (Columns.Num() >= 10)
+        {
+            PredictionsAccepted = FCString::Atoi(*Columns[8]);
+            PredictionsRejected = FCString::Atoi(*Columns[9]);
+        }
+
+        if (Columns.Num() >= 11)
+            PickUps = FCString::Atoi(*Columns[10]);
+
+        // Only rows with everybody connected describe the steady state
+        if (Clients < NumBots)
+            continue;
+
+        FrameMs.Add(FCString::Atof(*Columns[3]));
+        MaxFrameMs = FMath::Max(MaxFrameMs, FCString::Atof(*Columns[4]));
+        InKBps += FCString::Atof(*Columns[5]);
+        OutKBps += FCString::Atof(*Columns[6]);
+        Samples++;
+    }
+
+    FString Report = FString::Printf(TEXT("DarkestFear load test: %d bots, %.0fs, %d clients at most\n"),
+                                     NumBots, Duration, MaxClients);
+
+    if (Samples == 0)
+    {
+        Report += TEXT("Not every bot connected, no steady state samples\n");
+    }
+    else
+    {
+        FrameMs.Sort();
+
+        float SumFrameMs = 0.f;
+        for (float Ms : FrameMs)
+            SumFrameMs += Ms;
+
+        Report += FString::Printf(TEXT("Server frame: avg %.2f ms, p95 %.2f ms, max %.2f ms\n"), SumFrameMs / Samples,
+                                  FrameMs[FMath::Min(FMath::FloorToInt(Samples * .95f), Samples - 1)], MaxFrameMs);
+        Report += FString::Printf(TEXT("Bandwidth: in %.1f KB/s, out %.1f KB/s (%.2f KB/s out per bot)\n"),
+                                  InKBps / Samples, OutKBps / Samples, OutKBps / Samples / FMath::Max(NumBots, 1));
+    }
+
+    Report += FString::Printf(TEXT("Server memory: peak %.1f MB\n"), PeakUsedMB);
+    Report += FString::Printf(TEXT("Predicted item actions: %d accepted, %d rejected (%.2f%% mispredicted)\n"),
+                              PredictionsAccepted, PredictionsRejected,
+                              100.f * PredictionsRejected / FMath::Max(PredictionsAccepted + PredictionsRejected, 1));
+    Report += FString::Printf(TEXT("Items picked up: %d (%.2f per bot per minute)\n"), PickUps,
+                              PickUps / FMath::Max(NumBots * Duration / 60.f, 1.f));
+
+    return Report;
+}
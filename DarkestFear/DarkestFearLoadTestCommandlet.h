@@ -0,0 +1,34 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+
+#include "DarkestFearLoadTestCommandlet.generated.h"
+
+/**
+ * Runs a dedicated server and N headless bot clients on this machine over loopback, then reports server tick time,
+ * bandwidth, memory, how many predicted item actions the server rejected and how many items the bots picked up. Bots contend for the same items, and
+ * -PktLag adds latency (ms) to every bot's outgoing packets.
+ *
+ * Usage: -run=DarkestFearLoadTest -Map=<map> [-Bots=64] [-Duration=300] [-Port=7777] [-BotFPS=15] [-PktLag=0]
+ *        [-Report=<file>] [-ServerExe=<exe>] [-ClientExe=<exe>]
+ *
+ * Without -ServerExe/-ClientExe this executable is reused with the current project, which works from the editor.
+ * Point them at a packaged Linux server and client for real numbers.
+ */
+UCLASS()
+class UDarkestFearLoadTestCommandlet : public UCommandlet
+{
+    GENERATED_BODY()
+
+public:
+    UDarkestFearLoadTestCommandlet();
+
+    virtual int32 Main(const FString& Params) override;
+
+private:
+    /** Summarises the server stats CSV into a human readable report */
+    static FString BuildReport(const FString& CsvPath, int32 NumBots, float Duration);
+};
@@ -0,0 +1,388 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DarkestFearMemory.h"
+
+#include "DarkestFearCharacter.h"
+#include "DarkestFearChunks.h"
+#include "DarkestFearHUD.h"
+#include "DarkestFearIllumination.h"
+#include "DarkestFearItemSimulation.h"
+#include "DarkestFearProjectile.h"
+#include "EngineUtils.h"
+#include "Item.h"
+#include "Engine/GameInstance.h"
+#include "Engine/TextureRenderTarget2D.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/App.h"
+#include "Items/Flashlight.h"
+#include "Items/Phone.h"
+
+DEFINE_STAT(STAT_DarkestFearItemsLLM);
+DEFINE_STAT(STAT_DarkestFearInventoryLLM);
+DEFINE_STAT(STAT_DarkestFearProjectilesLLM);
+DEFINE_STAT(STAT_DarkestFearPlacementGhostLLM);
+DEFINE_STAT(STAT_DarkestFearHUDLLM);
+DEFINE_STAT(STAT_DarkestFearPhoneCaptureLLM);
+
+namespace
+{
+    // High-water marks survive between reports, keyed like the report rows
+    TMap<FName, FDarkestFearMemoryStat> PeakStats;
+
+    void AddToStat(TMap<FName, FDarkestFearMemoryStat>& Stats, FName Name, int64 Bytes)
+    {
+        FDarkestFearMemoryStat& Stat = Stats.FindOrAdd(Name);
+        Stat.Count++;
+        Stat.Bytes += Bytes;
+    }
+}
+
+int64 FDarkestFearMemoryReport::EstimateActorBytes(const AActor* Actor)
+{
+    // UObject shells are not part of resource sizes, so add the actor's and each component's properties
+    int64 Bytes = Actor->GetClass()->GetPropertiesSize();
+
+    for (const UActorComponent* Component : Actor->GetComponents())
+    {
+        if (Component != nullptr)
+            Bytes += Component->GetClass()->GetPropertiesSize();
+    }
+
+    return Bytes + const_cast<AActor*>(Actor)->GetResourceSizeBytes(EResourceSizeMode::EstimatedTotal);
+}
+
+void FDarkestFearMemoryReport::Gather(UWorld* World, TMap<FName, FDarkestFearMemoryStat>& OutStats)
+{
+    OutStats.Reset();
+
+    if (World == nullptr)
+        return;
+
+    static const FName InventoryName(TEXT("Inventory"));
+    static const FName ProjectilesName(TEXT("Projectiles"));
+    static const FName PlacementGhostName(TEXT("PlacementGhost"));
+    static const FName HUDName(TEXT("HUD"));
+    static const FName PhoneCaptureName(TEXT("PhoneCapture"));
+    static const FName IlluminationName(TEXT("IlluminationGrid"));
+    static const FName ItemSimulationName(TEXT("ItemSimulation"));
+
+    for (TActorIterator<AItem> It(World); It; ++It)
+    {
+        AddToStat(OutStats, *FString::Printf(TEXT("Items.%s"), *It->GetClass()->GetName()), EstimateActorBytes(*It));
+
+        const APhone* Phone = Cast<APhone>(*It);
+
+        if (Phone != nullptr && Phone->RealTimeCamera != nullptr && Phone->RealTimeCamera->TextureTarget != nullptr)
+        {
+            AddToStat(OutStats, PhoneCaptureName,
+                      Phone->RealTimeCamera->TextureTarget->GetResourceSizeBytes(EResourceSizeMode::EstimatedTotal));
+        }
+    }
+
+    for (TActorIterator<ADarkestFearCharacter> It(World); It; ++It)
+    {
+        AddToStat(OutStats, InventoryName, It->Inventory.GetAllocatedSize());
+
+        if (It->ActiveItemGhost != nullptr)
+        {
+            AddToStat(OutStats, PlacementGhostName,
+                      It->ActiveItemGhost->GetClass()->GetPropertiesSize() +
+                      It->ActiveItemGhost->GetResourceSizeBytes(EResourceSizeMode::Exclusive));
+        }
+    }
+
+    for (TActorIterator<ADarkestFearProjectile> It(World); It; ++It)
+    {
+        AddToStat(OutStats, ProjectilesName, EstimateActorBytes(*It));
+    }
+
+    for (TActorIterator<ADarkestFearHUD> It(World); It; ++It)
+    {
+        AddToStat(OutStats, HUDName, EstimateActorBytes(*It));
+    }
+
+    // Mapped, so only the touched pages are resident, but the whole file is what a level can cost
+    const UDarkestFearIlluminationSubsystem* Illumination = World->GetSubsystem<UDarkestFearIlluminationSubsystem>();
+
+    if (Illumination != nullptr && Illumination->HasGrid())
+        AddToStat(OutStats, IlluminationName, Illumination->GetGridBytes());
+
+    const UDarkestFearItemSimulationSubsystem* Simulation = World->GetSubsystem<UDarkestFearItemSimulationSubsystem>();
+
+    if (Simulation != nullptr && Simulation->GetNumStates() > 0)
+        AddToStat(OutStats, ItemSimulationName, Simulation->GetAllocatedSize());
+
+    for (TPair<FName, FDarkestFearMemoryStat>& Pair : OutStats)
+    {
+        FDarkestFearMemoryStat& Peak = PeakStats.FindOrAdd(Pair.Key);
+        Peak.PeakCount = FMath::Max(Peak.PeakCount, Pair.Value.Count);
+        Peak.PeakBytes = FMath::Max(Peak.PeakBytes, Pair.Value.Bytes);
+
+        Pair.Value.PeakCount = Peak.PeakCount;
+        Pair.Value.PeakBytes = Peak.PeakBytes;
+    }
+}
+
+void FDarkestFearMemoryReport::Dump(UWorld* World, FOutputDevice& Ar)
+{
+    TMap<FName, FDarkestFearMemoryStat> Stats;
+    Gather(World, Stats);
+    Stats.KeySort(FNameLexicalLess());
+
+    Ar.Logf(TEXT("%-32s %8s %12s %10s %12s"), TEXT("Subsystem"), TEXT("Count"), TEXT("KB"), TEXT("PeakCount"), TEXT("PeakKB"));
+
+    int64 TotalBytes = 0;
+
+    for (const TPair<FName, FDarkestFearMemoryStat>& Pair : Stats)
+    {
+        Ar.Logf(TEXT("%-32s %8d %12.1f %10d %12.1f"), *Pair.Key.ToString(), Pair.Value.Count,
+                Pair.Value.Bytes / 1024.0, Pair.Value.PeakCount, Pair.Value.PeakBytes / 1024.0);
+        TotalBytes += Pair.Value.Bytes;
+    }
+
+    Ar.Logf(TEXT("Total: %.1f KB"), TotalBytes / 1024.0);
+}
+
+bool FDarkestFearMemoryReport::Soak(UWorld* World, int32 Iterations, int32 CountPerIteration, int64 MaxGrowthBytes,
+                                   FOutputDevice& Ar)
+{
+    if (World == nullptr)
+        return false;
+
+    const TArray<UClass*> Classes = {
+        AItem::StaticClass(), AFlashlight::StaticClass(), APhone::StaticClass(), ADarkestFearProjectile::StaticClass()
+    };
+
+    auto MeasureTotal = [World]()
+    {
+        TMap<FName, FDarkestFearMemoryStat> Stats;
+        Gather(World, Stats);
+
+        int64 Total = 0;
+        for (const TPair<FName, FDarkestFearMemoryStat>& Pair : Stats)
+            Total += Pair.Value.Bytes;
+
+        return Total;
+    };
+
+    // Everything the process holds, and what LLM saw allocated when it runs: either one grows with a leak
+    auto MeasureProcess = []()
+    {
+        return int64(FPlatformMemory::GetStats().UsedPhysical);
+    };
+
+    auto MeasureLLM = []() -> int64
+    {
+#if ENABLE_LOW_LEVEL_MEM_TRACKER
+        if (FLowLevelMemTracker::IsEnabled())
+            return FLowLevelMemTracker::Get().GetTagAmountForTracker(ELLMTracker::Default, ELLMTag::Total);
+#endif
+        return -1;
+    };
+
+    FActorSpawnParameters SpawnParams;
+    SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+    TArray<AActor*> Spawned;
+    Spawned.Reserve(CountPerIteration * Classes.Num());
+
+    CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS);
+    const int64 BaselineBytes = MeasureTotal();
+
+    int64 BaselineProcess = 0;
+    int64 BaselineLLM = -1;
+    int64 TrackedBytes = BaselineBytes;
+    int64 ProcessGrowth = 0;
+    int64 LLMGrowth = 0;
+
+    // Iteration 0 only warms up: the first spawns of each class fill allocator pools, object caches and the
+    // like, which stay allocated without being a leak. Growth is measured from the end of it
+    for (int32 Iteration = 0; Iteration <= Iterations; Iteration++)
+    {
+        for (UClass* Class : Classes)
+        {
+            for (int32 Index = 0; Index < CountPerIteration; Index++)
+            {
+                Spawned.Add(World->SpawnActor<AActor>(Class, FTransform(FVector(Index * 10.f, 0.f, 10000.f)), SpawnParams));
+            }
+        }
+
+        for (AActor* Actor : Spawned)
+        {
+            if (Actor != nullptr)
+                Actor->Destroy();
+        }
+
+        Spawned.Reset();
+        CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS);
+
+        TrackedBytes = MeasureTotal();
+
+        if (Iteration == 0)
+        {
+            BaselineProcess = MeasureProcess();
+            BaselineLLM = MeasureLLM();
+
+            Ar.Logf(TEXT("Soak warm-up: tracked %.1f KB, process used %.1f MB"), TrackedBytes / 1024.0,
+                    BaselineProcess / (1024.0 * 1024.0));
+            continue;
+        }
+
+        ProcessGrowth = MeasureProcess() - BaselineProcess;
+        LLMGrowth = BaselineLLM >= 0 ? MeasureLLM() - BaselineLLM : 0;
+
+        Ar.Logf(TEXT("Soak %d/%d: tracked %.1f KB, process %+.2f MB, LLM %+.2f MB"), Iteration, Iterations,
+                TrackedBytes / 1024.0, ProcessGrowth / (1024.0 * 1024.0), LLMGrowth / (1024.0 * 1024.0));
+    }
+
+    // Everything spawned was destroyed and collected, so what the report tracks is back at its start by
+    // construction. Growth of the process (or of what LLM tracked) past the budget is what shows a leak
+    bool bPassed = true;
+
+    if (TrackedBytes > BaselineBytes)
+    {
+        Ar.Logf(ELogVerbosity::Error, TEXT("Soak FAILED: tracked memory grew from %.1f KB to %.1f KB"),
+                BaselineBytes / 1024.0, TrackedBytes / 1024.0);
+        bPassed = false;
+    }
+
+    if (ProcessGrowth > MaxGrowthBytes)
+    {
+        Ar.Logf(ELogVerbosity::Error, TEXT("Soak FAILED: process grew by %.2f MB after warm-up, budget %.2f MB"),
+                ProcessGrowth / (1024.0 * 1024.0), MaxGrowthBytes / (1024.0 * 1024.0));
+        bPassed = false;
+    }
+
+    if (LLMGrowth > MaxGrowthBytes)
+    {
+        Ar.Logf(ELogVerbosity::Error, TEXT("Soak FAILED: LLM tracked memory grew by %.2f MB after warm-up, budget %.2f MB"),
+                LLMGrowth / (1024.0 * 1024.0), MaxGrowthBytes / (1024.0 * 1024.0));
+        bPassed = false;
+    }
+
+    if (bPassed)
+    {
+        Ar.Logf(TEXT("Soak passed: process %+.2f MB, LLM %+.2f MB after warm-up, budget %.2f MB"),
+                ProcessGrowth / (1024.0 * 1024.0), LLMGrowth / (1024.0 * 1024.0), MaxGrowthBytes / (1024.0 * 1024.0));
+    }
+
+    return bPassed;
+}
+
+void FDarkestFearMemoryReport::SpawnBench(UWorld* World, int32 Count, const TArray<FString>& ClassPaths, FOutputDevice& Ar)
+{
+    if (World == nullptr)
+        return;
+
+    FActorSpawnParameters SpawnParams;
+    SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+    TArray<TSubclassOf<AItem>> ItemClasses = {AItem::StaticClass(), AFlashlight::StaticClass(), APhone::StaticClass()};
+
+    UGameInstance* GameInstance = World->GetGameInstance();
+    UDarkestFearChunkSubsystem* ChunkSubsystem = GameInstance != nullptr ? GameInstance->GetSubsystem<UDarkestFearChunkSubsystem>() : nullptr;
+
+    // Content item classes load the way the game loads them, mounting their chunk first. The first load of a class
+    // in an unmounted chunk is what a player waits for on first use
+    for (const FString& ClassPath : ClassPaths)
+    {
+        const TSoftClassPtr<AItem> SoftClass{FSoftObjectPath(ClassPath)};
+        const double StartTime = FPlatformTime::Seconds();
+
+        if (ChunkSubsystem != nullptr)
+        {
+            if (const TSharedPtr<FStreamableHandle> Handle = ChunkSubsystem->RequestItemClass(SoftClass))
+                Handle->WaitUntilComplete();
+        }
+
+        if (UClass* ItemClass = SoftClass.Get())
+        {
+            Ar.Logf(TEXT("Mounted and loaded %s in %.2f ms"), *ClassPath, (FPlatformTime::Seconds() - StartTime) * 1000.0);
+            ItemClasses.Add(ItemClass);
+        }
+        else
+        {
+            Ar.Logf(ELogVerbosity::Error, TEXT("%s is not an item class, or its chunk is not available"), *ClassPath);
+        }
+    }
+
+    Ar.Logf(TEXT("Spawning %d of each item class (%s)"), Count, IsRunningDedicatedServer() ? TEXT("dedicated server") : TEXT("client"));
+
+    for (const TSubclassOf<AItem>& ItemClass : ItemClasses)
+    {
+        TArray<AItem*> Items;
+        Items.Reserve(Count);
+
+        const double StartTime = FPlatformTime::Seconds();
+
+        for (int32 Index = 0; Index < Count; Index++)
+        {
+            const FVector Location(100.f * (Index % 100), 100.f * (Index / 100), 0.f);
+            Items.Add(World->SpawnActor<AItem>(ItemClass, FTransform(Location), SpawnParams));
+        }
+
+        const double SpawnSeconds = FPlatformTime::Seconds() - StartTime;
+        int64 Bytes = 0;
+        int32 NumComponents = 0;
+
+        for (AItem* Item : Items)
+        {
+            if (Item == nullptr)
+                continue;
+
+            Bytes += EstimateActorBytes(Item);
+            NumComponents += Item->GetComponents().Num();
+            Item->Destroy();
+        }
+
+        const int32 NumSpawned = FMath::Max(Items.Num(), 1);
+
+        Ar.Logf(TEXT("  %-12s %7.2f us/spawn  %7.2f KB/item  %.1f components/item"), *ItemClass->GetName(),
+                SpawnSeconds * 1e6 / NumSpawned, Bytes / 1024.0 / NumSpawned, float(NumComponents) / NumSpawned);
+    }
+
+    CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS);
+}
+
+static FAutoConsoleCommandWithWorldArgsAndOutputDevice DarkestFearMemReportCommand(
+    TEXT("DarkestFear.MemReport"),
+    TEXT("Dumps estimated memory per DarkestFear subsystem with high-water marks"),
+    FConsoleCommandWithWorldArgsAndOutputDeviceDelegate::CreateLambda(
+        [](const TArray<FString>& Args, UWorld* World, FOutputDevice& Ar)
+        {
+            FDarkestFearMemoryReport::Dump(World, Ar);
+        }));
+
+static FAutoConsoleCommandWithWorldArgsAndOutputDevice DarkestFearMemSoakCommand(
+    TEXT("DarkestFear.MemSoak"),
+    TEXT("DarkestFear.MemSoak [Iterations=20] [CountPerIteration=100] [MaxGrowthMB=16]: spawns and destroys items and "
+         "projectiles, failing if the process grows past the budget after a warm-up iteration. Exits with 1 when "
+         "unattended"),
+    FConsoleCommandWithWorldArgsAndOutputDeviceDelegate::CreateLambda(
+        [](const TArray<FString>& Args, UWorld* World, FOutputDevice& Ar)
+        {
+            const int32 Iterations = Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 20;
+            const int32 Count = Args.Num() > 1 ? FCString::Atoi(*Args[1]) : 100;
+            const float MaxGrowthMB = Args.Num() > 2 ? FCString::Atof(*Args[2]) : 16.f;
+
+            const bool bPassed = FDarkestFearMemoryReport::Soak(World, FMath::Max(Iterations, 1), FMath::Max(Count, 1),
+                                                                int64(FMath::Max(MaxGrowthMB, 0.f) * 1024.f * 1024.f), Ar);
+
+            // Unattended runs (CI, -ExecCmds soaks) report the result through the exit code
+            if (!bPassed && FApp::IsUnattended())
+                FPlatformMisc::RequestExitWithStatus(false, 1);
+        }));
+
+static FAutoConsoleCommandWithWorldArgsAndOutputDevice DarkestFearItemSpawnBenchCommand(
+    TEXT("DarkestFear.ItemSpawnBench"),
+    TEXT("DarkestFear.ItemSpawnBench [Count=10000] [ItemClassPath...]: spawns items of every native class and of the "
+         "given content classes, logs chunk mount and load time, spawn time and bytes per item"),
+    FConsoleCommandWithWorldArgsAndOutputDeviceDelegate::CreateLambda(
+        [](const TArray<FString>& Args, UWorld* World, FOutputDevice& Ar)
+        {
+            const int32 Count = Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 10000;
+            const TArray<FString> ClassPaths(Args.GetData() + FMath::Min(Args.Num(), 1), FMath::Max(Args.Num() - 1, 0));
+
+            FDarkestFearMemoryReport::SpawnBench(World, FMath::Max(Count, 1), ClassPaths, Ar);
+        }));
@@ -0,0 +1,69 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/LowLevelMemStats.h"
+#include "HAL/LowLevelMemTracker.h"
+
+/*
+ * Low level memory tracker tags for DarkestFear subsystems. Run with -llm and use "stat LLMFULL" to see them,
+ * add -llmtagsets=assetclasses to split items by class.
+ */
+DECLARE_LLM_MEMORY_STAT_EXTERN(TEXT("DF Items"), STAT_DarkestFearItemsLLM, STATGROUP_LLMFULL, DARKESTFEAR_API);
+DECLARE_LLM_MEMORY_STAT_EXTERN(TEXT("DF Inventory"), STAT_DarkestFearInventoryLLM, STATGROUP_LLMFULL, DARKESTFEAR_API);
+DECLARE_LLM_MEMORY_STAT_EXTERN(TEXT("DF Projectiles"), STAT_DarkestFearProjectilesLLM, STATGROUP_LLMFULL, DARKESTFEAR_API);
+DECLARE_LLM_MEMORY_STAT_EXTERN(TEXT("DF PlacementGhost"), STAT_DarkestFearPlacementGhostLLM, STATGROUP_LLMFULL, DARKESTFEAR_API);
+DECLARE_LLM_MEMORY_STAT_EXTERN(TEXT("DF HUD"), STAT_DarkestFearHUDLLM, STATGROUP_LLMFULL, DARKESTFEAR_API);
+DECLARE_LLM_MEMORY_STAT_EXTERN(TEXT("DF PhoneCapture"), STAT_DarkestFearPhoneCaptureLLM, STATGROUP_LLMFULL, DARKESTFEAR_API);
+
+/** Tags allocations in the current scope with one of the DarkestFear LLM stats above */
+#define DARKESTFEAR_LLM_SCOPE(Stat) LLM_SCOPED_SINGLE_STAT_TAG(Stat)
+
+/** Tags allocations in the current scope with an item's class (only visible with -llmtagsets=assetclasses) */
+#define DARKESTFEAR_LLM_SCOPE_CLASS(Class) LLM_SCOPED_TAG_WITH_OBJECT_IN_SET(Class, ELLMTagSet::AssetClasses)
+
+/** Live object count and estimated bytes of one subsystem, with the highest values seen so far */
+struct FDarkestFearMemoryStat
+{
+    int32 Count = 0;
+    int64 Bytes = 0;
+    int32 PeakCount = 0;
+    int64 PeakBytes = 0;
+};
+
+/**
+ * Per-subsystem memory report for a world: items (by class), inventory, projectiles, placement ghost, HUD, phone
+ * captures and the level's illumination grid. Complements LLM with numbers that are available in any build,
+ * including Shipping.
+ *
+ * Console commands:
+ *   DarkestFear.MemReport                                   Dumps the report with high-water marks
+ *   DarkestFear.MemSoak [Iterations] [Count] [MaxGrowthMB]  Spawns and destroys items and projectiles, fails on growth
+ *   DarkestFear.ItemSpawnBench [Count] [ClassPath...]       Spawn time and bytes per item for each item class
+ */
+class DARKESTFEAR_API FDarkestFearMemoryReport
+{
+public:
+    /** Measures every subsystem in World and updates the high-water marks */
+    static void Gather(UWorld* World, TMap<FName, FDarkestFearMemoryStat>& OutStats);
+
+    static void Dump(UWorld* World, FOutputDevice& Ar);
+
+    /**
+     * Runs the spawn/destroy loop, after one warm-up iteration. Returns false if process memory (or LLM's total, when
+     * running with -llm) grew by more than MaxGrowthBytes from the end of the warm-up
+     */
+    static bool Soak(UWorld* World, int32 Iterations, int32 CountPerIteration, int64 MaxGrowthBytes, FOutputDevice& Ar);
+
+    /**
+     * Spawns Count items of every native item class and of ClassPaths, logs the average spawn time and bytes per
+     * item, then destroys them. ClassPaths (e.g. /Game/Items/Flashlight/BP_Flashlight.BP_Flashlight_C) are loaded
+     * through UDarkestFearChunkSubsystem::RequestItemClass, logging how long mounting their chunk and loading took.
+     * Run it on a dedicated server and a client build to compare the stripped and full item variants.
+     */
+    static void SpawnBench(UWorld* World, int32 Count, const TArray<FString>& ClassPaths, FOutputDevice& Ar);
+
+private:
+    static int64 EstimateActorBytes(const AActor* Actor);
+};
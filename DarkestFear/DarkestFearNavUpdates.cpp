@@ -0,0 +1,167 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DarkestFearNavUpdates.h"
+
+#include "EngineUtils.h"
+#include "Item.h"
+#include "NavigationSystem.h"
+#include "Components/StaticMeshComponent.h"
+#include "Engine/StaticMesh.h"
+#include "HAL/IConsoleManager.h"
+#include "NavMesh/RecastNavMesh.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogDarkestFearNav, Log, All);
+
+void UDarkestFearNavUpdateSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+    Super::Initialize(Collection);
+
+    FlushInterval = .25f;
+    FlushBudgetMs = 1.f;
+    MaxTileGenerationJobs = 2;
+
+    TimeSinceFlush = 0.f;
+    bConfiguredNavMesh = false;
+    bBenchmarkRunning = false;
+    BenchmarkStartTime = 0.0;
+    BenchmarkFlushSeconds = 0.0;
+    BenchmarkMaxFrameMs = 0.f;
+}
+
+void UDarkestFearNavUpdateSubsystem::RequestItemNavUpdate(AItem* Item, bool bAffectsNavigation)
+{
+    // Navigation only exists on the server
+    if (GetWorld()->GetNetMode() == NM_Client)
+        return;
+
+    if (Item != nullptr && Item->MeshComponent != nullptr)
+        PendingUpdates.Add(Item, bAffectsNavigation);
+}
+
+void UDarkestFearNavUpdateSubsystem::ConfigureNavMesh()
+{
+    // Fewer concurrent tile jobs keep rebuilds from competing with the game for every worker thread
+    for (TActorIterator<ARecastNavMesh> It(GetWorld()); It; ++It)
+    {
+        It->SetMaxSimultaneousTileGenerationJobsCount(MaxTileGenerationJobs);
+
+        // Static and modifiers-only navmeshes never rebuild around a placed mesh
+        if (It->GetRuntimeGenerationMode() != ERuntimeGenerationType::Dynamic)
+        {
+            UE_LOG(LogDarkestFearNav, Warning,
+                   TEXT("%s does not use dynamic runtime generation, placing and picking up items will not update it"),
+                   *It->GetName());
+        }
+    }
+
+    bConfiguredNavMesh = true;
+}
+
+void UDarkestFearNavUpdateSubsystem::Flush()
+{
+    const double StartTime = FPlatformTime::Seconds();
+    const double EndTime = StartTime + FlushBudgetMs / 1000.0;
+
+    for (auto It = PendingUpdates.CreateIterator(); It; ++It)
+    {
+        AItem* Item = It.Key().Get();
+
+        // Toggling relevance removes or adds the mesh in the nav octree, dirtying only its own bounds
+        if (Item != nullptr && Item->MeshComponent->CanEverAffectNavigation() != It.Value())
+            Item->MeshComponent->SetCanEverAffectNavigation(It.Value());
+
+        It.RemoveCurrent();
+
+        // Whatever is left waits for the next frame
+        if (FPlatformTime::Seconds() > EndTime)
+            break;
+    }
+
+    if (bBenchmarkRunning)
+        BenchmarkFlushSeconds += FPlatformTime::Seconds() - StartTime;
+}
+
+void UDarkestFearNavUpdateSubsystem::Tick(float DeltaTime)
+{
+    if (!bConfiguredNavMesh)
+        ConfigureNavMesh();
+
+    TimeSinceFlush += DeltaTime;
+
+    // Once a flush ran out of budget, keep draining every frame until the queue is empty
+    if (PendingUpdates.Num() > 0 && TimeSinceFlush >= FlushInterval)
+    {
+        Flush();
+
+        if (PendingUpdates.Num() == 0)
+            TimeSinceFlush = 0.f;
+    }
+
+    if (bBenchmarkRunning)
+    {
+        BenchmarkMaxFrameMs = FMath::Max(BenchmarkMaxFrameMs, FApp::GetDeltaTime() * 1000.f);
+
+        const UNavigationSystemV1* NavSys = FNavigationSystem::GetCurrent<UNavigationSystemV1>(GetWorld());
+
+        if (PendingUpdates.Num() == 0 && NavSys != nullptr && !NavSys->IsNavigationBuildInProgress())
+        {
+            bBenchmarkRunning = false;
+
+            UE_LOG(LogDarkestFearNav, Display,
+                   TEXT("Navigation caught up after %.1f ms, game thread spent %.2f ms flushing, worst frame %.2f ms"),
+                   (FPlatformTime::Seconds() - BenchmarkStartTime) * 1000.0, BenchmarkFlushSeconds * 1000.0,
+                   BenchmarkMaxFrameMs);
+        }
+    }
+}
+
+void UDarkestFearNavUpdateSubsystem::StartPlacementBenchmark(int32 Count, const FVector& Origin)
+{
+    UWorld* World = GetWorld();
+    FActorSpawnParameters SpawnParams;
+    SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+    FRandomStream Random(7);
+    UStaticMesh* Cube = LoadObject<UStaticMesh>(nullptr, TEXT("/Engine/BasicShapes/Cube.Cube"));
+
+    for (int32 Index = 0; Index < Count; Index++)
+    {
+        const FVector Location = Origin + FVector(Random.FRandRange(-3000.f, 3000.f), Random.FRandRange(-3000.f, 3000.f), 0.f);
+        AItem* Item = World->SpawnActor<AItem>(AItem::StaticClass(), FTransform(Location), SpawnParams);
+
+        if (Item != nullptr)
+        {
+            Item->MeshComponent->SetStaticMesh(Cube);
+            Item->OnPlaced();
+        }
+    }
+
+    bBenchmarkRunning = true;
+    BenchmarkStartTime = FPlatformTime::Seconds();
+    BenchmarkFlushSeconds = 0.0;
+    BenchmarkMaxFrameMs = 0.f;
+}
+
+bool UDarkestFearNavUpdateSubsystem::IsTickable() const
+{
+    const UWorld* World = GetWorld();
+    return !IsTemplate() && World != nullptr && World->IsGameWorld() && World->GetNetMode() != NM_Client;
+}
+
+TStatId UDarkestFearNavUpdateSubsystem::GetStatId() const
+{
+    RETURN_QUICK_DECLARE_CYCLE_STAT(UDarkestFearNavUpdateSubsystem, STATGROUP_Tickables);
+}
+
+static FAutoConsoleCommandWithWorldAndArgs NavPlacementBenchCommand(
+    TEXT("DarkestFear.NavPlaceBench"),
+    TEXT("DarkestFear.NavPlaceBench [Count=300]: places items around the origin at once and reports nav rebuild latency"),
+    FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+    {
+        if (UDarkestFearNavUpdateSubsystem* NavUpdates = World ? World->GetSubsystem<UDarkestFearNavUpdateSubsystem>() : nullptr)
+        {
+            const int32 Count = Args.Num() > 0 ? FMath::Max(FCString::Atoi(*Args[0]), 1) : 300;
+            NavUpdates->StartPlacementBenchmark(Count, FVector::ZeroVector);
+        }
+    }));
@@ -0,0 +1,60 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+
+#include "DarkestFearNavUpdates.generated.h"
+
+/**
+ * Throttles navigation updates caused by items being placed and picked up.
+ *
+ * Items report changes here instead of touching navigation themselves. Requests are coalesced per item (placing
+ * and picking up the same item before a flush cancels out) and flushed at most every FlushInterval seconds,
+ * spending no more than FlushBudgetMs of game thread time per frame. Each applied change toggles the item mesh's
+ * navigation relevance, which dirties exactly that mesh's bounds; Recast then rebuilds the touched tiles on its
+ * worker threads, at most MaxTileGenerationJobs at a time.
+ *
+ * Items placed in the level are part of the navmesh from the start, items spawned during play join it through here.
+ * Held items never affect navigation, so carrying them around never dirties tiles. Needs the navmesh's runtime
+ * generation to be Dynamic, ConfigureNavMesh warns otherwise.
+ */
+UCLASS()
+class DARKESTFEAR_API UDarkestFearNavUpdateSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+    GENERATED_BODY()
+
+public:
+    virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+
+    /** Queues a change of whether Item is part of the navigable world */
+    void RequestItemNavUpdate(class AItem* Item, bool bAffectsNavigation);
+
+    float FlushInterval;
+    float FlushBudgetMs;
+    int32 MaxTileGenerationJobs;
+
+    /** Spawns Count items around Origin as fast as possible and logs how long navigation takes to catch up */
+    void StartPlacementBenchmark(int32 Count, const FVector& Origin);
+
+    // FTickableGameObject
+    virtual void Tick(float DeltaTime) override;
+    virtual bool IsTickable() const override;
+    virtual TStatId GetStatId() const override;
+
+private:
+    TMap<TWeakObjectPtr<class AItem>, bool> PendingUpdates;
+    float TimeSinceFlush;
+    bool bConfiguredNavMesh;
+
+    // Benchmark state
+    bool bBenchmarkRunning;
+    double BenchmarkStartTime;
+    double BenchmarkFlushSeconds;
+    float BenchmarkMaxFrameMs;
+
+    void ConfigureNavMesh();
+    void Flush();
+};
@@ -0,0 +1,170 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DarkestFearPlayerController.h"
+
+#include "DarkestFearCharacter.h"
+#include "Item.h"
+#include "Components/StaticMeshComponent.h"
+#include "UObject/Package.h"
+#include "UObject/UObjectIterator.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogDarkestFearTravel, Log, All);
+
+ADarkestFearPlayerController::ADarkestFearPlayerController()
+{
+    TravellingActiveSlot = 0;
+    TravelStartTime = 0.0;
+}
+
+void ADarkestFearPlayerController::PreClientTravel(const FString& PendingURL, ETravelType TravelType,
+                                                   bool bIsSeamlessTravel)
+{
+    Super::PreClientTravel(PendingURL, TravelType, bIsSeamlessTravel);
+
+    if (bIsSeamlessTravel && IsLocalController())
+        BeginTravelStats();
+}
+
+void ADarkestFearPlayerController::GetSeamlessTravelActorList(bool bToEntry, TArray<AActor*>& ActorList)
+{
+    Super::GetSeamlessTravelActorList(bToEntry, ActorList);
+
+    AddTravellingActors(bToEntry, ActorList);
+}
+
+void ADarkestFearPlayerController::AddTravellingActors(bool bToEntry, TArray<AActor*>& ActorList)
+{
+    // Called once going into the transition map, while the old pawn still exists, and once coming out of it
+    if (bToEntry)
+        TakeInventory();
+
+    for (AItem* Item : TravellingInventory)
+    {
+        if (Item != nullptr)
+            ActorList.Add(Item);
+    }
+}
+
+void ADarkestFearPlayerController::OnPossess(APawn* InPawn)
+{
+    Super::OnPossess(InPawn);
+
+    GiveInventory(InPawn);
+}
+
+void ADarkestFearPlayerController::AcknowledgePossession(APawn* P)
+{
+    Super::AcknowledgePossession(P);
+
+    // Clients get their pawn here; a listen server already handed the items over in OnPossess
+    GiveInventory(P);
+}
+
+void ADarkestFearPlayerController::TakeInventory()
+{
+    ADarkestFearCharacter* Character = Cast<ADarkestFearCharacter>(GetPawn());
+
+    if (Character == nullptr)
+        return;
+
+    TravellingInventory = Character->Inventory;
+    TravellingActiveSlot = Character->GetActiveSlot();
+
+    // The pawn is destroyed with the old map, the items must not go down with it
+    for (AItem* Item : TravellingInventory)
+    {
+        if (Item != nullptr)
+            Item->DetachFromActor(FDetachmentTransformRules::KeepWorldTransform);
+    }
+
+    Character->Inventory.Reset();
+    Character->ActiveItem = nullptr;
+}
+
+void ADarkestFearPlayerController::GiveInventory(APawn* NewPawn)
+{
+    ADarkestFearCharacter* Character = Cast<ADarkestFearCharacter>(NewPawn);
+
+    if (Character == nullptr || TravellingInventory.Num() == 0)
+        return;
+
+    for (AItem* Item : TravellingInventory)
+    {
+        if (Item != nullptr)
+            Item->OnSeamlessTravelled();
+    }
+
+    Character->AdoptInventory(TravellingInventory, TravellingActiveSlot);
+    TravellingInventory.Reset();
+
+    if (IsLocalController())
+        EndTravelStats();
+}
+
+void ADarkestFearPlayerController::BeginTravelStats()
+{
+    TravelStartTime = FPlatformTime::Seconds();
+
+    PackagesBeforeTravel.Reset();
+
+    for (TObjectIterator<UPackage> It; It; ++It)
+        PackagesBeforeTravel.Add(It->GetFName());
+
+    // The content a full inventory needs: if any of it goes stale, it has to be loaded again on the new map
+    InventoryAssets.Reset();
+
+    if (const ADarkestFearCharacter* Character = Cast<ADarkestFearCharacter>(GetPawn()))
+    {
+        for (const AItem* Item : Character->Inventory)
+        {
+            if (Item == nullptr)
+                continue;
+
+            TInlineComponentArray<UPrimitiveComponent*> Components(Item);
+
+            for (UPrimitiveComponent* Component : Components)
+            {
+                if (const UStaticMeshComponent* MeshComponent = Cast<UStaticMeshComponent>(Component))
+                    InventoryAssets.Add(MeshComponent->GetStaticMesh());
+
+                TArray<UMaterialInterface*> Materials;
+                Component->GetUsedMaterials(Materials);
+
+                for (UMaterialInterface* Material : Materials)
+                    InventoryAssets.Add(Material);
+            }
+        }
+    }
+}
+
+void ADarkestFearPlayerController::EndTravelStats()
+{
+    if (TravelStartTime <= 0.0)
+        return;
+
+    int32 NumNewPackages = 0;
+
+    for (TObjectIterator<UPackage> It; It; ++It)
+    {
+        if (!PackagesBeforeTravel.Contains(It->GetFName()))
+            NumNewPackages++;
+    }
+
+    int32 NumReloadedAssets = 0;
+
+    for (const TWeakObjectPtr<UObject>& Asset : InventoryAssets)
+    {
+        if (!Asset.IsValid())
+            NumReloadedAssets++;
+    }
+
+    UE_LOG(LogDarkestFearTravel, Display,
+           TEXT("Seamless travel took %.1f ms: %d packages loaded, %d of %d inventory assets had to be reloaded"),
+           (FPlatformTime::Seconds() - TravelStartTime) * 1000.0, NumNewPackages, NumReloadedAssets,
+           InventoryAssets.Num());
+
+    TravelStartTime = 0.0;
+    PackagesBeforeTravel.Reset();
+    InventoryAssets.Reset();
+}
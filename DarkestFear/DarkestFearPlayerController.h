@@ -0,0 +1,59 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/PlayerController.h"
+
+#include "DarkestFearPlayerController.generated.h"
+
+/**
+ * Carries the pawn's inventory through seamless travel. The pawn itself is destroyed with the old map, but its items
+ * are moved through the transition map into the new one, still loaded, and handed to the next pawn this controller
+ * possesses. Runs on the server and on the owning client, since each side has its own copies of the items.
+ *
+ * Local controllers log how long the travel took, how many packages were loaded on the way and how many of the
+ * inventory's assets had to be loaded again (none, as long as the items made it across).
+ */
+UCLASS()
+class DARKESTFEAR_API ADarkestFearPlayerController : public APlayerController
+{
+    GENERATED_BODY()
+
+public:
+    ADarkestFearPlayerController();
+
+    virtual void GetSeamlessTravelActorList(bool bToEntry, TArray<class AActor*>& ActorList) override;
+    virtual void PreClientTravel(const FString& PendingURL, ETravelType TravelType, bool bIsSeamlessTravel) override;
+    virtual void AcknowledgePossession(class APawn* P) override;
+
+    /**
+     * Adds the inventory to the actors kept through seamless travel. The engine only asks local controllers, the
+     * game mode calls this for remote ones on the server
+     */
+    void AddTravellingActors(bool bToEntry, TArray<class AActor*>& ActorList);
+
+protected:
+    virtual void OnPossess(class APawn* InPawn) override;
+
+private:
+    // Items on their way to the next pawn
+    UPROPERTY(Transient)
+    TArray<class AItem*> TravellingInventory;
+
+    int8 TravellingActiveSlot;
+
+    // Takes the inventory from the pawn that is about to be destroyed
+    void TakeInventory();
+
+    // Gives the travelling items to the new pawn, if there are any
+    void GiveInventory(class APawn* NewPawn);
+
+    // Travel measurement, local controllers only
+    double TravelStartTime;
+    TSet<FName> PackagesBeforeTravel;
+    TArray<TWeakObjectPtr<UObject>> InventoryAssets;
+
+    void BeginTravelStats();
+    void EndTravelStats();
+};
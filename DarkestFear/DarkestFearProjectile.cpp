@@ -3,9 +3,21 @@
 #include "DarkestFearProjectile.h"
 #include "GameFramework/ProjectileMovementComponent.h"
 #include "Components/SphereComponent.h"
+#include "DarkestFearMemory.h"
+#include "DarkestFearScalability.h"
+#include "Engine/World.h"
+#include "GameFramework/Pawn.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogProjectile, Log, All);
+
+DECLARE_CYCLE_STAT(TEXT("DarkestFear Spawn Shots"), STAT_DarkestFearSpawnShots, STATGROUP_Game);
+
+int32 ADarkestFearProjectile::NumLiveCosmetic = 0;
 
 ADarkestFearProjectile::ADarkestFearProjectile() 
 {
+	DARKESTFEAR_LLM_SCOPE(STAT_DarkestFearProjectilesLLM);
+
 	// Use a sphere as a simple collision representation
 	CollisionComp = CreateDefaultSubobject<USphereComponent>(TEXT("SphereComp"));
 	CollisionComp->InitSphereRadius(5.0f);
@@ -29,6 +41,138 @@ ADarkestFearProjectile::ADarkestFearProjectile()
 
 	// Die after 3 seconds by default
 	InitialLifeSpan = 3.0f;
+
+	// Projectiles are never replicated: every machine simulates its own copy, matched by ShotId
+	bReplicates = false;
+	ShotId = 0;
+	bIsCosmetic = false;
+	CorrectionTime = 0.1f;
+	PendingCorrection = FVector::ZeroVector;
+
+	// Only ticks while blending a correction
+	PrimaryActorTick.bCanEverTick = true;
+	PrimaryActorTick.bStartWithTickEnabled = false;
+}
+
+void ADarkestFearProjectile::BeginPlay()
+{
+	Super::BeginPlay();
+
+	SpawnLocation = GetActorLocation();
+	SpawnVelocity = ProjectileMovement->Velocity;
+	SpawnTime = GetWorld()->GetTimeSeconds();
+}
+
+void ADarkestFearProjectile::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (bIsCosmetic)
+	{
+		NumLiveCosmetic--;
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void ADarkestFearProjectile::AdvanceSpawn(float Seconds)
+{
+	if (Seconds <= 0.f)
+		return;
+
+	// The step the movement component would have taken, had the projectile been there since the shot
+	const FVector Delta = ProjectileMovement->ComputeMoveDelta(ProjectileMovement->Velocity, Seconds);
+	ProjectileMovement->Velocity = ProjectileMovement->ComputeVelocity(ProjectileMovement->Velocity, Seconds);
+
+	// Swept, so shots fired point blank still hit. A projectile stopped by a wall bounces off it on its next tick
+	FHitResult Hit;
+	ProjectileMovement->SafeMoveUpdatedComponent(Delta, ProjectileMovement->Velocity.Rotation(), true, Hit);
+
+	if (IsPendingKill())
+		return;
+
+	// The shot, not the spawn, is what the prediction error and the life span are measured from
+	SpawnTime -= Seconds;
+	SetLifeSpan(FMath::Max(InitialLifeSpan - Seconds, KINDA_SMALL_NUMBER));
+}
+
+void ADarkestFearProjectile::SpawnBatch(UWorld* World, TSubclassOf<ADarkestFearProjectile> ProjectileClass, APawn* Instigator,
+	TArrayView<const FDarkestFearShot> Shots, bool bCosmetic,
+	TArray<ADarkestFearProjectile*, FDarkestFearFrameAllocator>* OutProjectiles)
+{
+	if (OutProjectiles != nullptr)
+	{
+		OutProjectiles->Reset(Shots.Num());
+		OutProjectiles->AddZeroed(Shots.Num());
+	}
+
+	if (World == nullptr || ProjectileClass == nullptr)
+		return;
+
+	// Only what players see is capped, the server always simulates every shot. Past the cap the newest shots go
+	const int32 NumToSpawn = bCosmetic
+		? FMath::Clamp(FDarkestFearScalability::GetPreset().MaxProjectiles - NumLiveCosmetic, 0, Shots.Num())
+		: Shots.Num();
+
+	SCOPE_CYCLE_COUNTER(STAT_DarkestFearSpawnShots);
+	DARKESTFEAR_LLM_SCOPE(STAT_DarkestFearProjectilesLLM);
+
+	FActorSpawnParameters ActorSpawnParams;
+	ActorSpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButDontSpawnIfColliding;
+	ActorSpawnParams.Owner = Instigator;
+	ActorSpawnParams.Instigator = Instigator;
+
+	for (int32 Index = 0; Index < NumToSpawn; Index++)
+	{
+		const FDarkestFearShot& Shot = Shots[Index];
+
+		ADarkestFearProjectile* Projectile = World->SpawnActor<ADarkestFearProjectile>(
+			ProjectileClass, Shot.Location, Shot.Direction.Rotation(), ActorSpawnParams);
+
+		if (Projectile == nullptr)
+			continue;
+
+		Projectile->ShotId = Shot.ShotId;
+		Projectile->bIsCosmetic = bCosmetic;
+
+		if (bCosmetic)
+			NumLiveCosmetic++;
+
+		Projectile->AdvanceSpawn(Shot.Age);
+
+		if (OutProjectiles != nullptr && !Projectile->IsPendingKill())
+			(*OutProjectiles)[Index] = Projectile;
+	}
+}
+
+void ADarkestFearProjectile::CorrectTowards(const FVector& AuthoritativeLocation, const FVector& AuthoritativeDirection)
+{
+	// Both copies share speed and gravity, so the error is the spawn offset plus the velocity drift since spawning
+	const FVector AuthoritativeVelocity = AuthoritativeDirection.GetSafeNormal() * ProjectileMovement->InitialSpeed;
+	const FVector VelocityError = AuthoritativeVelocity - SpawnVelocity;
+	const float Elapsed = GetWorld()->GetTimeSeconds() - SpawnTime;
+
+	PendingCorrection = (AuthoritativeLocation - SpawnLocation) + VelocityError * Elapsed;
+	ProjectileMovement->Velocity += VelocityError;
+
+	UE_LOG(LogProjectile, Verbose, TEXT("Shot %u corrected by %.2f units after %.3fs"), ShotId, PendingCorrection.Size(), Elapsed);
+
+	SetActorTickEnabled(!PendingCorrection.IsNearlyZero());
+}
+
+void ADarkestFearProjectile::Tick(float DeltaSeconds)
+{
+	Super::Tick(DeltaSeconds);
+
+	const float Alpha = CorrectionTime > 0.f ? FMath::Min(DeltaSeconds / CorrectionTime, 1.f) : 1.f;
+	const FVector Step = PendingCorrection * Alpha;
+
+	AddActorWorldOffset(Step);
+	PendingCorrection -= Step;
+
+	if (PendingCorrection.IsNearlyZero(0.1f))
+	{
+		PendingCorrection = FVector::ZeroVector;
+		SetActorTickEnabled(false);
+	}
 }
 
 void ADarkestFearProjectile::OnHit(UPrimitiveComponent* HitComp, AActor* OtherActor, UPrimitiveComponent* OtherComp, FVector NormalImpulse, const FHitResult& Hit)
@@ -36,7 +180,11 @@ void ADarkestFearProjectile::OnHit(UPrimitiveComponent* HitComp, AActor* OtherAc
 	// Only add impulse and destroy projectile if we hit a physics
 	if ((OtherActor != NULL) && (OtherActor != this) && (OtherComp != NULL) && OtherComp->IsSimulatingPhysics())
 	{
-		OtherComp->AddImpulseAtLocation(GetVelocity() * 100.0f, GetActorLocation());
+		// Cosmetic copies only show the shot, the authoritative projectile applies the impulse
+		if (!bIsCosmetic)
+		{
+			OtherComp->AddImpulseAtLocation(GetVelocity() * 100.0f, GetActorLocation());
+		}
 
 		Destroy();
 	}
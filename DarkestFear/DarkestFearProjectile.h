@@ -4,6 +4,8 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
+#include "DarkestFearAutoFire.h"
+#include "DarkestFearFrameArena.h"
 #include "DarkestFearProjectile.generated.h"
 
 UCLASS(config=Game)
@@ -22,6 +24,41 @@ class ADarkestFearProjectile : public AActor
 public:
 	ADarkestFearProjectile();
 
+	/** Shot this projectile belongs to. Predicted, authoritative and remote copies of one shot share it */
+	uint16 ShotId;
+
+	/** Cosmetic projectiles (client predictions and remote visuals) never apply gameplay effects */
+	uint32 bIsCosmetic : 1;
+
+	/** Time over which a predicted projectile is blended onto the authoritative trajectory */
+	UPROPERTY(EditDefaultsOnly, Category=Projectile)
+	float CorrectionTime;
+
+	/** Smoothly moves a predicted projectile onto the trajectory the server simulated for the same shot */
+	void CorrectTowards(const FVector& AuthoritativeLocation, const FVector& AuthoritativeDirection);
+
+	/** Moves a projectile spawned this frame on along its trajectory, for a shot fired Seconds before the frame ended */
+	void AdvanceSpawn(float Seconds);
+
+	/**
+	 * Spawns the projectiles of a frame's shots together, each advanced by its age. Cosmetic batches stop at the
+	 * MaxProjectiles cap. OutProjectiles gets one entry per shot, nullptr for those that were not spawned. It only
+	 * lives for the frame, in the frame arena
+	 */
+	static void SpawnBatch(UWorld* World, TSubclassOf<ADarkestFearProjectile> ProjectileClass, APawn* Instigator,
+		TArrayView<const FDarkestFearShot> Shots, bool bCosmetic,
+		TArray<ADarkestFearProjectile*, FDarkestFearFrameAllocator>* OutProjectiles = nullptr);
+
+	virtual void Tick(float DeltaSeconds) override;
+
+	/** Cosmetic projectiles currently alive, capped by the DarkestFear quality preset */
+	static int32 NumLiveCosmetic;
+
+protected:
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+public:
 	/** called when projectile hits something */
 	UFUNCTION()
 	void OnHit(UPrimitiveComponent* HitComp, AActor* OtherActor, UPrimitiveComponent* OtherComp, FVector NormalImpulse, const FHitResult& Hit);
@@ -30,5 +67,14 @@ public:
 	FORCEINLINE class USphereComponent* GetCollisionComp() const { return CollisionComp; }
 	/** Returns ProjectileMovement subobject **/
 	FORCEINLINE class UProjectileMovementComponent* GetProjectileMovement() const { return ProjectileMovement; }
+
+private:
+	/** Where and when this copy of the shot was spawned, used to measure prediction error */
+	FVector SpawnLocation;
+	FVector SpawnVelocity;
+	float SpawnTime;
+
+	/** Visual offset still to be applied while blending onto the authoritative trajectory */
+	FVector PendingCorrection;
 };
 
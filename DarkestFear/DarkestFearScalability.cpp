@@ -0,0 +1,185 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DarkestFearScalability.h"
+
+#include "EngineUtils.h"
+#include "Item.h"
+#include "SynthBenchmark.h"
+#include "Engine/Engine.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/ConfigCacheIni.h"
+#include "Misc/CoreDelegates.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogDarkestFearScalability, Log, All);
+
+static TAutoConsoleVariable<int32> CVarDarkestFearQuality(
+    TEXT("sg.DarkestFearQuality"),
+    -1,
+    TEXT("Scalability quality state of DarkestFear features (phone captures, flashlights, projectiles, placed items)\n")
+    TEXT(" -1: pick automatically from a CPU benchmark at startup\n")
+    TEXT("  0: low, 1: medium, 2: high, 3: epic"),
+    ECVF_ScalabilityGroup);
+
+namespace
+{
+    FDelegateHandle PostEngineInitHandle;
+
+    // Where the chosen level lives in GameUserSettings.ini
+    const TCHAR* UserSettingsSection = TEXT("DarkestFear.Scalability");
+    const TCHAR* UserSettingsKey = TEXT("sg.DarkestFearQuality");
+}
+
+UDarkestFearScalabilitySettings::UDarkestFearScalabilitySettings()
+{
+    Low.PhoneCaptureResolution = 128;
+    Low.PhoneCaptureRate = 10.f;
+    Low.bFlashlightShadows = false;
+    Low.FlashlightAttenuationRadius = 800.f;
+    Low.MaxProjectiles = 16;
+    Low.PlacedItemCullDistance = 2000.f;
+
+    Medium.PhoneCaptureResolution = 256;
+    Medium.PhoneCaptureRate = 20.f;
+    Medium.bFlashlightShadows = false;
+    Medium.FlashlightAttenuationRadius = 1100.f;
+    Medium.MaxProjectiles = 32;
+    Medium.PlacedItemCullDistance = 4000.f;
+
+    High.PhoneCaptureResolution = 512;
+    High.PhoneCaptureRate = 30.f;
+    High.bFlashlightShadows = true;
+    High.FlashlightAttenuationRadius = 1500.f;
+    High.MaxProjectiles = 64;
+    High.PlacedItemCullDistance = 8000.f;
+
+    // Epic keeps the struct defaults: every frame captures, full radius, no culling
+
+    MediumCPUIndex = 60.f;
+    HighCPUIndex = 100.f;
+    EpicCPUIndex = 150.f;
+}
+
+const FDarkestFearQualityPreset& UDarkestFearScalabilitySettings::GetPreset(int32 Level) const
+{
+    switch (FMath::Clamp(Level, 0, 3))
+    {
+    case 0: return Low;
+    case 1: return Medium;
+    case 2: return High;
+    default: return Epic;
+    }
+}
+
+void FDarkestFearScalability::Startup()
+{
+    CVarDarkestFearQuality->SetOnChangedCallback(FConsoleVariableDelegate::CreateStatic(&FDarkestFearScalability::OnQualityChanged));
+
+    // A level saved by an earlier run, benchmarked or picked by the player, wins over benchmarking again
+    int32 SavedLevel = -1;
+
+    if (GConfig != nullptr && GConfig->GetInt(UserSettingsSection, UserSettingsKey, SavedLevel, GGameUserSettingsIni) &&
+        SavedLevel >= 0)
+    {
+        CVarDarkestFearQuality->Set(FMath::Min(SavedLevel, 3), ECVF_SetByGameSetting);
+    }
+
+    // The benchmark needs a running engine and only matters if nobody picked a level yet
+    PostEngineInitHandle = FCoreDelegates::OnPostEngineInit.AddStatic(&FDarkestFearScalability::RunStartupBenchmark);
+}
+
+void FDarkestFearScalability::Shutdown()
+{
+    FCoreDelegates::OnPostEngineInit.Remove(PostEngineInitHandle);
+    CVarDarkestFearQuality->SetOnChangedCallback(FConsoleVariableDelegate());
+}
+
+int32 FDarkestFearScalability::GetQualityLevel()
+{
+    // Until the benchmark ran, behave like Epic so nothing is degraded by accident
+    const int32 Level = CVarDarkestFearQuality.GetValueOnGameThread();
+    return Level < 0 ? 3 : FMath::Min(Level, 3);
+}
+
+void FDarkestFearScalability::SetQualityLevel(int32 Level)
+{
+    Level = FMath::Clamp(Level, 0, 3);
+
+    // Same priority as the saved level it replaces, so device profiles and the console still override it
+    CVarDarkestFearQuality->Set(Level, ECVF_SetByGameSetting);
+
+    if (GConfig != nullptr)
+    {
+        GConfig->SetInt(UserSettingsSection, UserSettingsKey, Level, GGameUserSettingsIni);
+        GConfig->Flush(false, GGameUserSettingsIni);
+    }
+}
+
+const FDarkestFearQualityPreset& FDarkestFearScalability::GetPreset()
+{
+    return GetDefault<UDarkestFearScalabilitySettings>()->GetPreset(GetQualityLevel());
+}
+
+int32 FDarkestFearScalability::PickLevelFromBenchmark(float CPUPerfIndex)
+{
+    const UDarkestFearScalabilitySettings* Settings = GetDefault<UDarkestFearScalabilitySettings>();
+
+    if (CPUPerfIndex >= Settings->EpicCPUIndex)
+        return 3;
+    if (CPUPerfIndex >= Settings->HighCPUIndex)
+        return 2;
+    if (CPUPerfIndex >= Settings->MediumCPUIndex)
+        return 1;
+
+    return 0;
+}
+
+void FDarkestFearScalability::ApplyToWorlds()
+{
+    if (GEngine == nullptr)
+        return;
+
+    const FDarkestFearQualityPreset& Preset = GetPreset();
+
+    for (const FWorldContext& Context : GEngine->GetWorldContexts())
+    {
+        UWorld* World = Context.World();
+
+        if (World == nullptr || !World->IsGameWorld())
+            continue;
+
+        for (TActorIterator<AItem> It(World); It; ++It)
+        {
+            It->ApplyQuality(Preset);
+        }
+    }
+}
+
+void FDarkestFearScalability::OnQualityChanged(IConsoleVariable* Variable)
+{
+    UE_LOG(LogDarkestFearScalability, Log, TEXT("DarkestFear quality set to %d"), GetQualityLevel());
+    ApplyToWorlds();
+}
+
+void FDarkestFearScalability::RunStartupBenchmark()
+{
+    // Editor sessions and commandlets never play at a picked level, and a 10s benchmark would stall each launch
+    if (GIsEditor || IsRunningCommandlet() || IsRunningDedicatedServer())
+        return;
+
+    if (CVarDarkestFearQuality.GetValueOnGameThread() >= 0)
+        return;
+
+    // CPU only: it runs headless, and it is the CPU that pays for projectiles and item updates
+    FSynthBenchmarkResults Results;
+    ISynthBenchmark::Get().Run(Results, false, 10.f);
+
+    const float CPUPerfIndex = Results.ComputeCPUPerfIndex();
+    const int32 Level = PickLevelFromBenchmark(CPUPerfIndex);
+
+    UE_LOG(LogDarkestFearScalability, Log, TEXT("CPU performance index %.1f, picking DarkestFear quality %d"),
+           CPUPerfIndex, Level);
+
+    // Saved, so later launches start at this level without benchmarking
+    SetQualityLevel(Level);
+}
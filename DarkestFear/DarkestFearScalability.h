@@ -0,0 +1,106 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/Object.h"
+
+#include "DarkestFearScalability.generated.h"
+
+/** Quality knobs of DarkestFear's own expensive features */
+USTRUCT()
+struct DARKESTFEAR_API FDarkestFearQualityPreset
+{
+    GENERATED_BODY()
+
+    /** Square size of phone render targets */
+    UPROPERTY(EditAnywhere, Category="Phone")
+    int32 PhoneCaptureResolution = 512;
+
+    /** Phone scene captures per second, 0 captures every frame */
+    UPROPERTY(EditAnywhere, Category="Phone")
+    float PhoneCaptureRate = 0.f;
+
+    UPROPERTY(EditAnywhere, Category="Flashlight")
+    bool bFlashlightShadows = true;
+
+    UPROPERTY(EditAnywhere, Category="Flashlight")
+    float FlashlightAttenuationRadius = 1500.f;
+
+    /** Cosmetic projectiles alive at once. Authoritative projectiles are never capped */
+    UPROPERTY(EditAnywhere, Category="Projectile")
+    int32 MaxProjectiles = 128;
+
+    /** Distance past which placed item meshes stop drawing, 0 draws them at any distance */
+    UPROPERTY(EditAnywhere, Category="Items")
+    float PlacedItemCullDistance = 0.f;
+};
+
+/**
+ * Low/Medium/High/Epic presets for the sg.DarkestFearQuality scalability group.
+ * Code defaults below can be overridden in the [/Script/DarkestFear.DarkestFearScalabilitySettings] section of
+ * DefaultGame.ini.
+ */
+UCLASS(config=Game, defaultconfig)
+class DARKESTFEAR_API UDarkestFearScalabilitySettings : public UObject
+{
+    GENERATED_BODY()
+
+public:
+    UDarkestFearScalabilitySettings();
+
+    UPROPERTY(config, EditAnywhere, Category="Presets")
+    FDarkestFearQualityPreset Low;
+
+    UPROPERTY(config, EditAnywhere, Category="Presets")
+    FDarkestFearQualityPreset Medium;
+
+    UPROPERTY(config, EditAnywhere, Category="Presets")
+    FDarkestFearQualityPreset High;
+
+    UPROPERTY(config, EditAnywhere, Category="Presets")
+    FDarkestFearQualityPreset Epic;
+
+    /** CPU performance index (100 = average machine) needed for Medium, High and Epic */
+    UPROPERTY(config, EditAnywhere, Category="Benchmark")
+    float MediumCPUIndex;
+
+    UPROPERTY(config, EditAnywhere, Category="Benchmark")
+    float HighCPUIndex;
+
+    UPROPERTY(config, EditAnywhere, Category="Benchmark")
+    float EpicCPUIndex;
+
+    const FDarkestFearQualityPreset& GetPreset(int32 Level) const;
+};
+
+/**
+ * The sg.DarkestFearQuality scalability group. It sits next to Unreal's own sg.* groups, so it can be set from the
+ * console or device profiles. SetQualityLevel saves the level to the [DarkestFear.Scalability] section of
+ * GameUserSettings.ini, which is loaded at startup. With no level anywhere, a CPU benchmark picks one after engine
+ * init, once, outside the editor and commandlets, and saves it. Changing it reconfigures every live item in place.
+ */
+class DARKESTFEAR_API FDarkestFearScalability
+{
+public:
+    static void Startup();
+    static void Shutdown();
+
+    /** Current level, 0 (Low) to 3 (Epic) */
+    static int32 GetQualityLevel();
+
+    /** Sets the level and saves it to GameUserSettings for later launches */
+    static void SetQualityLevel(int32 Level);
+
+    static const FDarkestFearQualityPreset& GetPreset();
+
+    /** Maps a CPU performance index to a level using the settings' thresholds */
+    static int32 PickLevelFromBenchmark(float CPUPerfIndex);
+
+    /** Pushes the current preset to every item in every game world */
+    static void ApplyToWorlds();
+
+private:
+    static void OnQualityChanged(IConsoleVariable* Variable);
+    static void RunStartupBenchmark();
+};
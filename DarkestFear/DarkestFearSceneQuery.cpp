@@ -0,0 +1,183 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DarkestFearSceneQuery.h"
+
+#include "DarkestFearFrameArena.h"
+#include "Async/ParallelFor.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+
+DECLARE_CYCLE_STAT(TEXT("DarkestFear Scene Query Batch"), STAT_DarkestFearSceneQueryBatch, STATGROUP_Game);
+
+FDarkestFearQueryHandle UDarkestFearSceneQuerySubsystem::LineTrace(const FVector& Start, const FVector& End,
+                                                                 ECollisionChannel Channel,
+                                                                 const FCollisionQueryParams& Params,
+                                                                 FDarkestFearQueryDelegate Callback)
+{
+    return Submit({EQueryType::Line, Channel, Start, End, FQuat::Identity, FCollisionShape(), Params, MoveTemp(Callback)});
+}
+
+FDarkestFearQueryHandle UDarkestFearSceneQuerySubsystem::Sweep(const FVector& Start, const FVector& End,
+                                                             const FQuat& Rotation, ECollisionChannel Channel,
+                                                             const FCollisionShape& Shape,
+                                                             const FCollisionQueryParams& Params,
+                                                             FDarkestFearQueryDelegate Callback)
+{
+    return Submit({EQueryType::Sweep, Channel, Start, End, Rotation, Shape, Params, MoveTemp(Callback)});
+}
+
+FDarkestFearQueryHandle UDarkestFearSceneQuerySubsystem::Overlap(const FVector& Location, const FQuat& Rotation,
+                                                               ECollisionChannel Channel, const FCollisionShape& Shape,
+                                                               const FCollisionQueryParams& Params,
+                                                               FDarkestFearQueryDelegate Callback)
+{
+    return Submit({EQueryType::Overlap, Channel, Location, Location, Rotation, Shape, Params, MoveTemp(Callback)});
+}
+
+FDarkestFearQueryHandle UDarkestFearSceneQuerySubsystem::Submit(FQuery&& Query)
+{
+    check(IsInGameThread());
+
+    Pending.Add(MoveTemp(Query));
+    return NextHandle++;
+}
+
+const FDarkestFearQueryResult* UDarkestFearSceneQuerySubsystem::GetResult(FDarkestFearQueryHandle Handle) const
+{
+    if (Handle < FirstResultHandle || Handle >= FirstResultHandle + Results.Num())
+        return nullptr;
+
+    return &Results[Handle - FirstResultHandle];
+}
+
+void UDarkestFearSceneQuerySubsystem::RunQuery(const FQuery& Query, FDarkestFearQueryResult& OutResult) const
+{
+    UWorld* World = GetWorld();
+
+    switch (Query.Type)
+    {
+    case EQueryType::Line:
+        OutResult.bBlockingHit = World->LineTraceSingleByChannel(OutResult.Hit, Query.Start, Query.End, Query.Channel,
+                                                                 Query.Params);
+        break;
+
+    case EQueryType::Sweep:
+        OutResult.bBlockingHit = World->SweepSingleByChannel(OutResult.Hit, Query.Start, Query.End, Query.Rotation,
+                                                             Query.Channel, Query.Shape, Query.Params);
+        break;
+
+    case EQueryType::Overlap:
+        OutResult.bBlockingHit = World->OverlapMultiByChannel(OutResult.Overlaps, Query.Start, Query.Rotation,
+                                                              Query.Channel, Query.Shape, Query.Params);
+        break;
+    }
+}
+
+void UDarkestFearSceneQuerySubsystem::Flush()
+{
+    check(IsInGameThread());
+    SCOPE_CYCLE_COUNTER(STAT_DarkestFearSceneQueryBatch);
+
+    // Callbacks may submit more queries, those go into the next batch. The running batch is done with once its
+    // callbacks ran, so it lives in the frame arena instead of holding the busiest batch's queries forever
+    TArray<FQuery, FDarkestFearFrameAllocator> Running;
+    Running.Reserve(Pending.Num());
+
+    for (FQuery& Query : Pending)
+        Running.Emplace(MoveTemp(Query));
+
+    Pending.Reset();
+
+    FirstResultHandle = NextHandle - Running.Num();
+    Results.Reset();
+    Results.SetNum(Running.Num());
+
+    // Physics is not simulating at this point of the frame, so the scene can be read from every worker at once
+    const int32 NumTasks = FMath::DivideAndRoundUp(Running.Num(), QueriesPerTask);
+
+    ParallelFor(NumTasks, [this, &Running](int32 Task)
+    {
+        const int32 End = FMath::Min((Task + 1) * QueriesPerTask, Running.Num());
+
+        for (int32 Index = Task * QueriesPerTask; Index < End; Index++)
+            RunQuery(Running[Index], Results[Index]);
+    });
+
+    for (int32 Index = 0; Index < Running.Num(); Index++)
+    {
+        Running[Index].Callback.ExecuteIfBound(Results[Index]);
+    }
+}
+
+void UDarkestFearSceneQuerySubsystem::Tick(float DeltaTime)
+{
+    Flush();
+}
+
+bool UDarkestFearSceneQuerySubsystem::IsTickable() const
+{
+    return !IsTemplate() && Pending.Num() > 0;
+}
+
+TStatId UDarkestFearSceneQuerySubsystem::GetStatId() const
+{
+    RETURN_QUICK_DECLARE_CYCLE_STAT(UDarkestFearSceneQuerySubsystem, STATGROUP_Tickables);
+}
+
+static FAutoConsoleCommandWithWorldArgsAndOutputDevice SceneQueryBenchCommand(
+    TEXT("DarkestFear.SceneQueryBench"),
+    TEXT("DarkestFear.SceneQueryBench [Queries=4096]: times random line traces one by one and as one batch"),
+    FConsoleCommandWithWorldArgsAndOutputDeviceDelegate::CreateLambda(
+        [](const TArray<FString>& Args, UWorld* World, FOutputDevice& Ar)
+        {
+            UDarkestFearSceneQuerySubsystem* SceneQuery = World ? World->GetSubsystem<UDarkestFearSceneQuerySubsystem>() : nullptr;
+
+            if (SceneQuery == nullptr)
+                return;
+
+            const int32 NumQueries = Args.Num() > 0 ? FMath::Max(FCString::Atoi(*Args[0]), 1) : 4096;
+
+            // Same rays for both paths, spread around the world origin where test maps usually are
+            FRandomStream Random(42);
+            TArray<FVector> Starts;
+            TArray<FVector> Ends;
+
+            for (int32 Index = 0; Index < NumQueries; Index++)
+            {
+                const FVector Start = Random.VRand() * Random.FRandRange(0.f, 2000.f);
+                Starts.Add(Start);
+                Ends.Add(Start + Random.VRand() * 1000.f);
+            }
+
+            const FCollisionQueryParams Params(SCENE_QUERY_STAT(DarkestFearSceneQueryBench));
+            int32 SerialHits = 0;
+            const double SerialStart = FPlatformTime::Seconds();
+
+            for (int32 Index = 0; Index < NumQueries; Index++)
+            {
+                FHitResult Hit;
+                SerialHits += World->LineTraceSingleByChannel(Hit, Starts[Index], Ends[Index], ECC_Visibility, Params);
+            }
+
+            const double SerialSeconds = FPlatformTime::Seconds() - SerialStart;
+            int32 BatchHits = 0;
+            const double BatchStart = FPlatformTime::Seconds();
+
+            for (int32 Index = 0; Index < NumQueries; Index++)
+            {
+                SceneQuery->LineTrace(Starts[Index], Ends[Index], ECC_Visibility, Params,
+                                      FDarkestFearQueryDelegate::CreateLambda([&BatchHits](const FDarkestFearQueryResult& Result)
+                                      {
+                                          BatchHits += Result.bBlockingHit;
+                                      }));
+            }
+
+            SceneQuery->Flush();
+
+            const double BatchSeconds = FPlatformTime::Seconds() - BatchStart;
+
+            Ar.Logf(TEXT("%d line traces: serial %.3f ms (%d hits), batched %.3f ms (%d hits), %.2fx"),
+                    NumQueries, SerialSeconds * 1000.0, SerialHits, BatchSeconds * 1000.0, BatchHits,
+                    SerialSeconds / FMath::Max(BatchSeconds, 1e-9));
+        }));
@@ -0,0 +1,101 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "CollisionQueryParams.h"
+#include "CollisionShape.h"
+#include "Engine/EngineTypes.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+
+#include "DarkestFearSceneQuery.generated.h"
+
+struct FDarkestFearQueryResult
+{
+    bool bBlockingHit = false;
+
+    /** Line and sweep hit */
+    FHitResult Hit;
+
+    /** Overlap query results */
+    TArray<FOverlapResult> Overlaps;
+};
+
+DECLARE_DELEGATE_OneParam(FDarkestFearQueryDelegate, const FDarkestFearQueryResult&);
+
+/** Identifies a submitted query. Results can be read back with it until the next batch runs */
+typedef uint64 FDarkestFearQueryHandle;
+
+/**
+ * Batched scene queries. Gameplay code submits line traces, sweeps and overlaps during the frame; the subsystem
+ * runs the whole batch once per frame, after actors ticked, spread over worker threads, then fires the callbacks on
+ * the game thread. Results arrive the same frame the query was submitted.
+ *
+ * Use it for queries that can wait until the end of the frame (per-tick probes, AI checks). Input-driven queries
+ * whose answer is needed immediately should keep tracing synchronously.
+ */
+UCLASS()
+class DARKESTFEAR_API UDarkestFearSceneQuerySubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+    GENERATED_BODY()
+
+public:
+    FDarkestFearQueryHandle LineTrace(const FVector& Start, const FVector& End, ECollisionChannel Channel,
+                                      const FCollisionQueryParams& Params, FDarkestFearQueryDelegate Callback = FDarkestFearQueryDelegate());
+
+    FDarkestFearQueryHandle Sweep(const FVector& Start, const FVector& End, const FQuat& Rotation, ECollisionChannel Channel,
+                                  const FCollisionShape& Shape, const FCollisionQueryParams& Params,
+                                  FDarkestFearQueryDelegate Callback = FDarkestFearQueryDelegate());
+
+    FDarkestFearQueryHandle Overlap(const FVector& Location, const FQuat& Rotation, ECollisionChannel Channel,
+                                    const FCollisionShape& Shape, const FCollisionQueryParams& Params,
+                                    FDarkestFearQueryDelegate Callback = FDarkestFearQueryDelegate());
+
+    /** Result of a query from the last batch, nullptr if it is older or has not run yet */
+    const FDarkestFearQueryResult* GetResult(FDarkestFearQueryHandle Handle) const;
+
+    /** Runs every pending query now and dispatches the callbacks */
+    void Flush();
+
+    int32 GetNumPending() const { return Pending.Num(); }
+
+    /** Queries each worker picks up at once, to keep task overhead low */
+    static constexpr int32 QueriesPerTask = 16;
+
+    // FTickableGameObject
+    virtual void Tick(float DeltaTime) override;
+    virtual bool IsTickable() const override;
+    virtual TStatId GetStatId() const override;
+
+private:
+    enum class EQueryType : uint8
+    {
+        Line,
+        Sweep,
+        Overlap
+    };
+
+    struct FQuery
+    {
+        EQueryType Type;
+        ECollisionChannel Channel;
+        FVector Start;
+        FVector End;
+        FQuat Rotation;
+        FCollisionShape Shape;
+        FCollisionQueryParams Params;
+        FDarkestFearQueryDelegate Callback;
+    };
+
+    TArray<FQuery> Pending;
+
+    // Read back by handle until the next batch, which may be next frame, so not in the frame arena
+    TArray<FDarkestFearQueryResult> Results;
+
+    FDarkestFearQueryHandle NextHandle = 0;
+    FDarkestFearQueryHandle FirstResultHandle = 0;
+
+    FDarkestFearQueryHandle Submit(FQuery&& Query);
+    void RunQuery(const FQuery& Query, FDarkestFearQueryResult& OutResult) const;
+};
@@ -0,0 +1,108 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DarkestFearServerStats.h"
+
+#include "DarkestFearCharacter.h"
+#include "Engine/NetDriver.h"
+#include "Engine/World.h"
+#include "Misc/CommandLine.h"
+#include "Misc/CoreDelegates.h"
+#include "Misc/FileHelper.h"
+
+bool UDarkestFearServerStatsSubsystem::ShouldCreateSubsystem(UObject* Outer) const
+{
+    FString Path;
+    return FParse::Value(FCommandLine::Get(), TEXT("LoadTestStats="), Path);
+}
+
+void UDarkestFearServerStatsSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+    Super::Initialize(Collection);
+
+    FParse::Value(FCommandLine::Get(), TEXT("LoadTestStats="), CsvPath);
+
+    FrameStartTime = 0.0;
+    WindowStartTime = FPlatformTime::Seconds();
+    WindowFrameSeconds = 0.0;
+    WindowMaxFrameSeconds = 0.0;
+    WindowFrames = 0;
+
+    // Frame begin/end brackets the game thread's work, without the idle time spent waiting for the tick rate cap
+    BeginFrameHandle = FCoreDelegates::OnBeginFrame.AddUObject(this, &UDarkestFearServerStatsSubsystem::OnBeginFrame);
+    EndFrameHandle = FCoreDelegates::OnEndFrame.AddUObject(this, &UDarkestFearServerStatsSubsystem::OnEndFrame);
+
+    if (!CsvPath.IsEmpty() && !FPaths::FileExists(CsvPath))
+        FFileHelper::SaveStringToFile(GetCsvHeader(), *CsvPath);
+}
+
+void UDarkestFearServerStatsSubsystem::Deinitialize()
+{
+    FCoreDelegates::OnBeginFrame.Remove(BeginFrameHandle);
+    FCoreDelegates::OnEndFrame.Remove(EndFrameHandle);
+
+    Super::Deinitialize();
+}
+
+void UDarkestFearServerStatsSubsystem::OnBeginFrame()
+{
+    FrameStartTime = FPlatformTime::Seconds();
+}
+
+void UDarkestFearServerStatsSubsystem::OnEndFrame()
+{
+    if (FrameStartTime <= 0.0)
+        return;
+
+    const double FrameSeconds = FPlatformTime::Seconds() - FrameStartTime;
+    WindowFrameSeconds += FrameSeconds;
+    WindowMaxFrameSeconds = FMath::Max(WindowMaxFrameSeconds, FrameSeconds);
+    WindowFrames++;
+}
+
+void UDarkestFearServerStatsSubsystem::Tick(float DeltaTime)
+{
+    const double Now = FPlatformTime::Seconds();
+
+    if (Now - WindowStartTime >= 1.0)
+    {
+        WriteRow(Now);
+
+        WindowStartTime = Now;
+        WindowFrameSeconds = 0.0;
+        WindowMaxFrameSeconds = 0.0;
+        WindowFrames = 0;
+    }
+}
+
+void UDarkestFearServerStatsSubsystem::WriteRow(double Now)
+{
+    const UNetDriver* NetDriver = GetWorld()->GetNetDriver();
+    const int32 Clients = NetDriver != nullptr ? NetDriver->ClientConnections.Num() : 0;
+    const float InKBps = NetDriver != nullptr ? NetDriver->InBytesPerSecond / 1024.f : 0.f;
+    const float OutKBps = NetDriver != nullptr ? NetDriver->OutBytesPerSecond / 1024.f : 0.f;
+
+    const FItemPredictionStats& Predictions = FItemPredictionStats::Get();
+
+    const FString Row = FString::Printf(TEXT("%.1f,%d,%d,%.3f,%.3f,%.2f,%.2f,%.1f,%d,%d,%d\n"),
+                                        GetWorld()->GetRealTimeSeconds(), Clients, WindowFrames,
+                                        WindowFrames > 0 ? WindowFrameSeconds * 1000.0 / WindowFrames : 0.0,
+                                        WindowMaxFrameSeconds * 1000.0, InKBps, OutKBps,
+                                        FPlatformMemory::GetStats().UsedPhysical / (1024.0 * 1024.0),
+                                        Predictions.Accepted, Predictions.Rejected, Predictions.PickUps);
+
+    // Appending every second means a killed server still leaves a complete file behind
+    FFileHelper::SaveStringToFile(Row, *CsvPath, FFileHelper::EEncodingOptions::AutoDetect, &IFileManager::Get(),
+                                  FILEWRITE_Append);
+}
+
+bool UDarkestFearServerStatsSubsystem::IsTickable() const
+{
+    const UWorld* World = GetWorld();
+    return !IsTemplate() && !CsvPath.IsEmpty() && World != nullptr && World->GetNetMode() != NM_Client;
+}
+
+TStatId UDarkestFearServerStatsSubsystem::GetStatId() const
+{
+    RETURN_QUICK_DECLARE_CYCLE_STAT(UDarkestFearServerStatsSubsystem, STATGROUP_Tickables);
+}
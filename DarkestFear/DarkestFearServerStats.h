@@ -0,0 +1,48 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+
+#include "DarkestFearServerStats.generated.h"
+
+/**
+ * Writes one CSV row per second with server health while running with -LoadTestStats=<file>:
+ * connected clients, game thread time per frame (average and max), network bandwidth, process memory and running
+ * totals of predicted item actions and pickups.
+ * The load test commandlet reads these rows back to build its report.
+ */
+UCLASS()
+class DARKESTFEAR_API UDarkestFearServerStatsSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+    GENERATED_BODY()
+
+public:
+    virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+    virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+    virtual void Deinitialize() override;
+
+    // FTickableGameObject
+    virtual void Tick(float DeltaTime) override;
+    virtual bool IsTickable() const override;
+    virtual TStatId GetStatId() const override;
+
+    static const TCHAR* GetCsvHeader() { return TEXT("Time,Clients,Frames,AvgFrameMs,MaxFrameMs,InKBps,OutKBps,UsedMB,PredictionsAccepted,PredictionsRejected,PickUps\n"); }
+
+private:
+    FString CsvPath;
+    FDelegateHandle BeginFrameHandle;
+    FDelegateHandle EndFrameHandle;
+
+    double FrameStartTime;
+    double WindowStartTime;
+    double WindowFrameSeconds;
+    double WindowMaxFrameSeconds;
+    int32 WindowFrames;
+
+    void OnBeginFrame();
+    void OnEndFrame();
+    void WriteRow(double Now);
+};
@@ -0,0 +1,563 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DarkestFearSnapshots.h"
+
+#include "IImageWrapper.h"
+#include "IImageWrapperModule.h"
+#include "RenderingThread.h"
+#include "RHIGPUReadback.h"
+#include "Async/Async.h"
+#include "Engine/GameInstance.h"
+#include "Engine/TextureRenderTarget2D.h"
+#include "Engine/World.h"
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Modules/ModuleManager.h"
+#include "Templates/Atomic.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogDarkestFearSnapshots, Log, All);
+
+// Latencies kept for the stats, older ones are overwritten
+static constexpr int32 MaxLatencySamples = 1024;
+
+static IImageWrapperModule* ImageWrapperModule = nullptr;
+
+FDarkestFearSnapshotPipeline::FDarkestFearSnapshotPipeline(const FString& InDirectory, EFormat InFormat)
+    : Directory(InDirectory)
+    , IndexPath(InDirectory / TEXT("Gallery.tsv"))
+    , Format(InFormat)
+{
+    // Modules can only be loaded on the game thread, the encoders only create wrappers from it
+    if (ImageWrapperModule == nullptr)
+        ImageWrapperModule = &FModuleManager::LoadModuleChecked<IImageWrapperModule>(TEXT("ImageWrapper"));
+
+    IFileManager::Get().MakeDirectory(*Directory, true);
+
+    LoadIndex();
+}
+
+FDarkestFearSnapshotPipeline::~FDarkestFearSnapshotPipeline()
+{
+    Flush();
+}
+
+void FDarkestFearSnapshotPipeline::LoadIndex()
+{
+    TArray<FString> Lines;
+
+    if (!FFileHelper::LoadFileToStringArray(Lines, *IndexPath))
+    {
+        FFileHelper::SaveStringToFile(TEXT("File\tCaptureTime\tWidth\tHeight\tBytes\n"), *IndexPath);
+        return;
+    }
+
+    // First line is the header
+    for (int32 Index = 1; Index < Lines.Num(); Index++)
+    {
+        TArray<FString> Fields;
+
+        if (Lines[Index].ParseIntoArray(Fields, TEXT("\t")) != 5)
+            continue;
+
+        FDarkestFearGalleryEntry Entry;
+        Entry.File = Fields[0];
+        FDateTime::ParseIso8601(*Fields[1], Entry.CaptureTime);
+        Entry.Width = FCString::Atoi(*Fields[2]);
+        Entry.Height = FCString::Atoi(*Fields[3]);
+        Entry.Bytes = FCString::Atoi64(*Fields[4]);
+
+        Gallery.Add(MoveTemp(Entry));
+    }
+
+    NextFileNumber = Gallery.Num();
+}
+
+static int64 GetRawBytes(const FDarkestFearSnapshot& Snapshot)
+{
+    return Snapshot.Pixels.Num() * sizeof(FColor) + Snapshot.HalfPixels.Num() * sizeof(FFloat16Color);
+}
+
+bool FDarkestFearSnapshotPipeline::CanAccept(int32 Width, int32 Height, int32 BytesPerPixel) const
+{
+    FScopeLock ScopeLock(&Lock);
+
+    return EncodeQueue.Num() < MaxQueued && BytesInFlight + int64(Width) * Height * BytesPerPixel <= MaxBytesInFlight;
+}
+
+bool FDarkestFearSnapshotPipeline::Submit(FDarkestFearSnapshot&& Snapshot)
+{
+    check((Snapshot.Pixels.Num() == Snapshot.Width * Snapshot.Height) !=
+          (Snapshot.HalfPixels.Num() == Snapshot.Width * Snapshot.Height));
+
+    const int64 RawBytes = GetRawBytes(Snapshot);
+
+    FScopeLock ScopeLock(&Lock);
+
+    Stats.Submitted++;
+
+    if (EncodeQueue.Num() >= MaxQueued || BytesInFlight + RawBytes > MaxBytesInFlight)
+    {
+        Stats.Dropped++;
+        return false;
+    }
+
+    BytesInFlight += RawBytes;
+    Stats.PeakBytesInFlight = FMath::Max(Stats.PeakBytesInFlight, BytesInFlight);
+
+    EncodeQueue.Add(MoveTemp(Snapshot));
+
+    if (NumEncodeTasks < MaxEncodeTasks)
+    {
+        NumEncodeTasks++;
+        Async(EAsyncExecution::ThreadPool, [this]() { EncodeWorker(); });
+    }
+
+    return true;
+}
+
+bool FDarkestFearSnapshotPipeline::Encode(const FDarkestFearSnapshot& Snapshot, TArray64<uint8>& OutData) const
+{
+    const TSharedPtr<IImageWrapper> ImageWrapper =
+        ImageWrapperModule->CreateImageWrapper(Format == EFormat::Png ? EImageFormat::PNG : EImageFormat::JPEG);
+
+    if (!ImageWrapper.IsValid() ||
+        !ImageWrapper->SetRaw(Snapshot.Pixels.GetData(), Snapshot.Pixels.Num() * sizeof(FColor), Snapshot.Width,
+                              Snapshot.Height, ERGBFormat::BGRA, 8))
+        return false;
+
+    OutData = ImageWrapper->GetCompressed(Format == EFormat::Jpeg ? JpegQuality : 0);
+    return OutData.Num() > 0;
+}
+
+void FDarkestFearSnapshotPipeline::EncodeWorker()
+{
+    for (;;)
+    {
+        FDarkestFearSnapshot Snapshot;
+
+        {
+            FScopeLock ScopeLock(&Lock);
+
+            if (EncodeQueue.Num() == 0)
+            {
+                NumEncodeTasks--;
+                return;
+            }
+
+            Snapshot = MoveTemp(EncodeQueue[0]);
+            EncodeQueue.RemoveAt(0, 1, false);
+        }
+
+        const double StartTime = FPlatformTime::Seconds();
+        const int64 RawBytes = GetRawBytes(Snapshot);
+
+        // Half float targets hold linear scene color, the image formats want 8 bit sRGB
+        if (Snapshot.HalfPixels.Num() > 0)
+        {
+            Snapshot.Pixels.SetNumUninitialized(Snapshot.HalfPixels.Num());
+
+            for (int32 Index = 0; Index < Snapshot.HalfPixels.Num(); Index++)
+                Snapshot.Pixels[Index] = FLinearColor(Snapshot.HalfPixels[Index]).ToFColor(true);
+
+            Snapshot.HalfPixels.Empty();
+        }
+
+        // Scene captures leave inverse opacity in alpha, photos are opaque
+        for (FColor& Pixel : Snapshot.Pixels)
+            Pixel.A = 255;
+
+        FEncoded Encoded;
+        const bool bEncoded = Encode(Snapshot, Encoded.Data);
+
+        const double EncodeSeconds = FPlatformTime::Seconds() - StartTime;
+
+        Encoded.RawBytes = RawBytes;
+        Encoded.CaptureSeconds = Snapshot.CaptureSeconds;
+        Encoded.Entry.CaptureTime = Snapshot.CaptureTime;
+        Encoded.Entry.Width = Snapshot.Width;
+        Encoded.Entry.Height = Snapshot.Height;
+        Encoded.Entry.Bytes = Encoded.Data.Num();
+
+        // The raw pixels are the bulk of the memory in flight, let them go before waiting on the lock
+        Snapshot.Pixels.Empty();
+
+        FScopeLock ScopeLock(&Lock);
+
+        BytesInFlight -= Encoded.RawBytes;
+        Stats.EncodeSeconds += EncodeSeconds;
+
+        if (!bEncoded)
+        {
+            Stats.Failed++;
+            continue;
+        }
+
+        Encoded.Entry.File = FString::Printf(TEXT("Snapshot_%s_%04d.%s"), *Encoded.Entry.CaptureTime.ToString(),
+                                             NextFileNumber++, Format == EFormat::Png ? TEXT("png") : TEXT("jpg"));
+
+        BytesInFlight += Encoded.Data.Num();
+        Stats.PeakBytesInFlight = FMath::Max(Stats.PeakBytesInFlight, BytesInFlight);
+
+        WriteQueue.Add(MoveTemp(Encoded));
+
+        // One writer keeps the disk sequential and the index in order
+        if (!bWriting)
+        {
+            bWriting = true;
+            Async(EAsyncExecution::ThreadPool, [this]() { WriteWorker(); });
+        }
+    }
+}
+
+void FDarkestFearSnapshotPipeline::WriteWorker()
+{
+    for (;;)
+    {
+        FEncoded Encoded;
+
+        {
+            FScopeLock ScopeLock(&Lock);
+
+            if (WriteQueue.Num() == 0)
+            {
+                bWriting = false;
+                return;
+            }
+
+            Encoded = MoveTemp(WriteQueue[0]);
+            WriteQueue.RemoveAt(0, 1, false);
+        }
+
+        const double StartTime = FPlatformTime::Seconds();
+
+        bool bWritten = false;
+        TUniquePtr<FArchive> Writer(IFileManager::Get().CreateFileWriter(*(Directory / Encoded.Entry.File)));
+
+        if (Writer.IsValid())
+        {
+            Writer->Serialize(Encoded.Data.GetData(), Encoded.Data.Num());
+            Writer->Close();
+            bWritten = !Writer->IsError();
+        }
+
+        // Appending keeps the index valid even if the game dies halfway through a burst
+        if (bWritten)
+        {
+            const FString Line = FString::Printf(TEXT("%s\t%s\t%d\t%d\t%lld\n"), *Encoded.Entry.File,
+                                                 *Encoded.Entry.CaptureTime.ToIso8601(), Encoded.Entry.Width,
+                                                 Encoded.Entry.Height, Encoded.Entry.Bytes);
+
+            FFileHelper::SaveStringToFile(Line, *IndexPath, FFileHelper::EEncodingOptions::AutoDetect,
+                                          &IFileManager::Get(), FILEWRITE_Append);
+        }
+        else
+        {
+            UE_LOG(LogDarkestFearSnapshots, Warning, TEXT("Could not write snapshot %s"), *Encoded.Entry.File);
+        }
+
+        const double EndTime = FPlatformTime::Seconds();
+
+        FScopeLock ScopeLock(&Lock);
+
+        BytesInFlight -= Encoded.Data.Num();
+        Stats.WriteSeconds += EndTime - StartTime;
+
+        if (!bWritten)
+        {
+            Stats.Failed++;
+            continue;
+        }
+
+        const float LatencyMs = (EndTime - Encoded.CaptureSeconds) * 1000.0;
+
+        if (Stats.LatenciesMs.Num() < MaxLatencySamples)
+            Stats.LatenciesMs.Add(LatencyMs);
+        else
+            Stats.LatenciesMs[Stats.Written % MaxLatencySamples] = LatencyMs;
+
+        Stats.Written++;
+        Gallery.Add(MoveTemp(Encoded.Entry));
+    }
+}
+
+bool FDarkestFearSnapshotPipeline::IsIdle() const
+{
+    FScopeLock ScopeLock(&Lock);
+
+    return EncodeQueue.Num() == 0 && WriteQueue.Num() == 0 && NumEncodeTasks == 0 && !bWriting;
+}
+
+void FDarkestFearSnapshotPipeline::Flush()
+{
+    while (!IsIdle())
+        FPlatformProcess::Sleep(.001f);
+}
+
+TArray<FDarkestFearGalleryEntry> FDarkestFearSnapshotPipeline::GetGallery() const
+{
+    FScopeLock ScopeLock(&Lock);
+    return Gallery;
+}
+
+FDarkestFearSnapshotStats FDarkestFearSnapshotPipeline::GetStats() const
+{
+    FScopeLock ScopeLock(&Lock);
+    return Stats;
+}
+
+void FDarkestFearSnapshotPipeline::ResetStats()
+{
+    FScopeLock ScopeLock(&Lock);
+
+    Stats = FDarkestFearSnapshotStats();
+    Stats.PeakBytesInFlight = BytesInFlight;
+}
+
+struct UDarkestFearSnapshotSubsystem::FReadback
+{
+    TUniquePtr<FRHIGPUTextureReadback> GPU;
+
+    int32 Width;
+    int32 Height;
+    EPixelFormat Format;
+    FDateTime CaptureTime;
+    double CaptureSeconds;
+
+    // Set on the render thread once the pixels went to the pipeline
+    TAtomic<bool> bDone{false};
+};
+
+void UDarkestFearSnapshotSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+    Super::Initialize(Collection);
+
+    // Nobody takes photos on a dedicated server
+    if (!IsRunningDedicatedServer())
+        Pipeline = MakeUnique<FDarkestFearSnapshotPipeline>(FPaths::ProjectSavedDir() / TEXT("Snapshots"),
+                                                            FDarkestFearSnapshotPipeline::EFormat::Jpeg);
+}
+
+void UDarkestFearSnapshotSubsystem::Deinitialize()
+{
+    // Readback commands in flight still hand their pixels to the pipeline
+    FlushRenderingCommands();
+
+    Readbacks.Reset();
+    Pipeline.Reset();
+
+    Super::Deinitialize();
+}
+
+bool UDarkestFearSnapshotSubsystem::Capture(UTextureRenderTarget2D* Target)
+{
+    if (Pipeline == nullptr || Target == nullptr)
+        return false;
+
+    // RTF_RGBA8 targets, and the RTF_RGBA16f render targets default to, which the encoder converts
+    const EPixelFormat Format = Target->GetFormat();
+
+    if (Format != PF_B8G8R8A8 && Format != PF_FloatRGBA)
+    {
+        UE_LOG(LogDarkestFearSnapshots, Warning, TEXT("%s is neither an RGBA8 nor an RGBA16f render target, cannot take a snapshot"),
+               *Target->GetName());
+        return false;
+    }
+
+    FTextureRenderTargetResource* Resource = Target->GameThread_GetRenderTargetResource();
+    const int32 BytesPerPixel = Format == PF_FloatRGBA ? sizeof(FFloat16Color) : sizeof(FColor);
+
+    if (Resource == nullptr || Readbacks.Num() >= MaxReadbacks || !Pipeline->CanAccept(Target->SizeX, Target->SizeY, BytesPerPixel))
+        return false;
+
+    TSharedPtr<FReadback, ESPMode::ThreadSafe> Readback = MakeShared<FReadback, ESPMode::ThreadSafe>();
+    Readback->GPU = MakeUnique<FRHIGPUTextureReadback>(TEXT("DarkestFearSnapshot"));
+    Readback->Width = Target->SizeX;
+    Readback->Height = Target->SizeY;
+    Readback->Format = Format;
+    Readback->CaptureTime = FDateTime::Now();
+    Readback->CaptureSeconds = FPlatformTime::Seconds();
+
+    // Copied after whatever the capture component rendered this frame, read back once the GPU got there
+    ENQUEUE_RENDER_COMMAND(DarkestFearSnapshotCopy)([Resource, Readback](FRHICommandListImmediate& RHICmdList)
+    {
+        Readback->GPU->EnqueueCopy(RHICmdList, Resource->GetRenderTargetTexture());
+    });
+
+    Readbacks.Add(MoveTemp(Readback));
+    return true;
+}
+
+void UDarkestFearSnapshotSubsystem::Tick(float DeltaTime)
+{
+    Readbacks.RemoveAll([](const TSharedPtr<FReadback, ESPMode::ThreadSafe>& Readback)
+    {
+        return Readback->bDone.Load();
+    });
+
+    if (Readbacks.Num() == 0)
+        return;
+
+    ENQUEUE_RENDER_COMMAND(DarkestFearSnapshotPoll)(
+        [Pending = Readbacks, Pipeline = Pipeline.Get()](FRHICommandListImmediate& RHICmdList)
+        {
+            for (const TSharedPtr<FReadback, ESPMode::ThreadSafe>& Readback : Pending)
+            {
+                if (Readback->bDone.Load() || !Readback->GPU->IsReady())
+                    continue;
+
+                void* Data = nullptr;
+                int32 RowPitch = 0;
+                Readback->GPU->LockTexture(RHICmdList, Data, RowPitch);
+
+                FDarkestFearSnapshot Snapshot;
+                Snapshot.Width = Readback->Width;
+                Snapshot.Height = Readback->Height;
+                Snapshot.CaptureTime = Readback->CaptureTime;
+                Snapshot.CaptureSeconds = Readback->CaptureSeconds;
+
+                // Only copied here, converting half floats is left to the encoder's worker
+                if (Readback->Format == PF_FloatRGBA)
+                {
+                    Snapshot.HalfPixels.SetNumUninitialized(Snapshot.Width * Snapshot.Height);
+
+                    for (int32 Y = 0; Y < Snapshot.Height; Y++)
+                    {
+                        FMemory::Memcpy(&Snapshot.HalfPixels[Y * Snapshot.Width], static_cast<const FFloat16Color*>(Data) + Y * RowPitch,
+                                        Snapshot.Width * sizeof(FFloat16Color));
+                    }
+                }
+                else
+                {
+                    Snapshot.Pixels.SetNumUninitialized(Snapshot.Width * Snapshot.Height);
+
+                    for (int32 Y = 0; Y < Snapshot.Height; Y++)
+                    {
+                        FMemory::Memcpy(&Snapshot.Pixels[Y * Snapshot.Width], static_cast<const FColor*>(Data) + Y * RowPitch,
+                                        Snapshot.Width * sizeof(FColor));
+                    }
+                }
+
+                Readback->GPU->Unlock();
+                Readback->GPU.Reset();
+
+                Pipeline->Submit(MoveTemp(Snapshot));
+                Readback->bDone = true;
+            }
+        });
+}
+
+bool UDarkestFearSnapshotSubsystem::IsTickable() const
+{
+    return !IsTemplate() && Readbacks.Num() > 0;
+}
+
+TStatId UDarkestFearSnapshotSubsystem::GetStatId() const
+{
+    RETURN_QUICK_DECLARE_CYCLE_STAT(UDarkestFearSnapshotSubsystem, STATGROUP_Tickables);
+}
+
+static void LogSnapshotStats(const FDarkestFearSnapshotStats& Stats, FOutputDevice& Ar)
+{
+    TArray<float> Latencies = Stats.LatenciesMs;
+    Latencies.Sort();
+
+    const auto Percentile = [&Latencies](float Fraction)
+    {
+        return Latencies.Num() > 0 ? Latencies[FMath::Min(FMath::FloorToInt(Latencies.Num() * Fraction), Latencies.Num() - 1)] : 0.f;
+    };
+
+    Ar.Logf(TEXT("  Submitted %d, dropped %d, written %d, failed %d"), Stats.Submitted, Stats.Dropped, Stats.Written,
+            Stats.Failed);
+    Ar.Logf(TEXT("  Encode %.2f ms, write %.2f ms per snapshot"),
+            Stats.EncodeSeconds * 1000.0 / FMath::Max(Stats.Written + Stats.Failed, 1),
+            Stats.WriteSeconds * 1000.0 / FMath::Max(Stats.Written + Stats.Failed, 1));
+    Ar.Logf(TEXT("  Capture to disk latency: p50 %.1f ms, p95 %.1f ms, max %.1f ms"), Percentile(.5f), Percentile(.95f),
+            Latencies.Num() > 0 ? Latencies.Last() : 0.f);
+    Ar.Logf(TEXT("  Peak memory in flight %.1f MB"), Stats.PeakBytesInFlight / (1024.0 * 1024.0));
+}
+
+static FAutoConsoleCommandWithWorldArgsAndOutputDevice SnapshotBenchCommand(
+    TEXT("DarkestFear.SnapshotBench"),
+    TEXT("DarkestFear.SnapshotBench [Count=32] [Size=1024] [png|jpg]: submits a burst of synthetic snapshots to a "
+         "pipeline writing to Saved/SnapshotBench and reports throughput and latency"),
+    FConsoleCommandWithWorldArgsAndOutputDeviceDelegate::CreateLambda(
+        [](const TArray<FString>& Args, UWorld* World, FOutputDevice& Ar)
+        {
+            const int32 Count = Args.Num() > 0 ? FMath::Max(FCString::Atoi(*Args[0]), 1) : 32;
+            const int32 Size = Args.Num() > 1 ? FMath::Clamp(FCString::Atoi(*Args[1]), 16, 8192) : 1024;
+            const bool bPng = Args.Num() > 2 && Args[2] == TEXT("png");
+
+            const FString Directory = FPaths::ProjectSavedDir() / TEXT("SnapshotBench");
+            IFileManager::Get().DeleteDirectory(*Directory, false, true);
+
+            FDarkestFearSnapshotPipeline Pipeline(Directory, bPng ? FDarkestFearSnapshotPipeline::EFormat::Png
+                                                                  : FDarkestFearSnapshotPipeline::EFormat::Jpeg);
+
+            // Gradients with noise compress about like a dark room does, built before timing starts
+            FRandomStream Random(11);
+            TArray<FDarkestFearSnapshot> Snapshots;
+            Snapshots.SetNum(Count);
+
+            for (FDarkestFearSnapshot& Snapshot : Snapshots)
+            {
+                Snapshot.Width = Size;
+                Snapshot.Height = Size;
+                Snapshot.Pixels.SetNumUninitialized(Size * Size);
+
+                for (int32 Y = 0; Y < Size; Y++)
+                {
+                    for (int32 X = 0; X < Size; X++)
+                    {
+                        const int32 Noise = Random.RandHelper(24);
+                        Snapshot.Pixels[Y * Size + X] = FColor(uint8(X * 96 / Size + Noise), uint8(Y * 64 / Size + Noise), uint8(Noise));
+                    }
+                }
+            }
+
+            const double StartTime = FPlatformTime::Seconds();
+
+            for (FDarkestFearSnapshot& Snapshot : Snapshots)
+            {
+                Snapshot.CaptureTime = FDateTime::Now();
+                Snapshot.CaptureSeconds = FPlatformTime::Seconds();
+                Pipeline.Submit(MoveTemp(Snapshot));
+            }
+
+            const double SubmitSeconds = FPlatformTime::Seconds() - StartTime;
+
+            Pipeline.Flush();
+
+            const double TotalSeconds = FPlatformTime::Seconds() - StartTime;
+            const FDarkestFearSnapshotStats Stats = Pipeline.GetStats();
+            const double RawMegabytes = Stats.Written * double(Size) * Size * sizeof(FColor) / (1024.0 * 1024.0);
+
+            Ar.Logf(TEXT("Burst of %d %dx%d %s snapshots, queue %d, memory cap %.0f MB, %d encoders"), Count, Size, Size,
+                    bPng ? TEXT("PNG") : TEXT("JPEG"), Pipeline.MaxQueued, Pipeline.MaxBytesInFlight / (1024.0 * 1024.0),
+                    Pipeline.MaxEncodeTasks);
+            Ar.Logf(TEXT("  Caller thread: %.3f ms for the burst, %.1f us per snapshot"), SubmitSeconds * 1000.0,
+                    SubmitSeconds * 1e6 / Count);
+            Ar.Logf(TEXT("  Drained in %.1f ms: %.1f snapshots/s, %.1f MB/s raw"), TotalSeconds * 1000.0,
+                    Stats.Written / FMath::Max(TotalSeconds, 1e-9), RawMegabytes / FMath::Max(TotalSeconds, 1e-9));
+
+            LogSnapshotStats(Stats, Ar);
+        }));
+
+static FAutoConsoleCommandWithWorldArgsAndOutputDevice SnapshotStatsCommand(
+    TEXT("DarkestFear.SnapshotStats"),
+    TEXT("Logs the gallery size and this session's snapshot pipeline stats"),
+    FConsoleCommandWithWorldArgsAndOutputDeviceDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World, FOutputDevice& Ar)
+    {
+        UGameInstance* GameInstance = World != nullptr ? World->GetGameInstance() : nullptr;
+        UDarkestFearSnapshotSubsystem* Snapshots = GameInstance != nullptr ? GameInstance->GetSubsystem<UDarkestFearSnapshotSubsystem>() : nullptr;
+
+        if (Snapshots == nullptr || Snapshots->GetPipeline() == nullptr)
+            return;
+
+        const FDarkestFearSnapshotPipeline* Pipeline = Snapshots->GetPipeline();
+
+        Ar.Logf(TEXT("%d photos in %s"), Pipeline->GetGallery().Num(), *Pipeline->GetDirectory());
+        LogSnapshotStats(Pipeline->GetStats(), Ar);
+    }));
@@ -0,0 +1,175 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Math/Float16Color.h"
+#include "Subsystems/GameInstanceSubsystem.h"
+#include "Tickable.h"
+
+#include "DarkestFearSnapshots.generated.h"
+
+/** Pixels of one captured photo, on their way to disk */
+struct FDarkestFearSnapshot
+{
+    int32 Width = 0;
+    int32 Height = 0;
+
+    /** BGRA, Width * Height of them */
+    TArray<FColor> Pixels;
+
+    /** Linear half float pixels instead of Pixels, as read back from RGBA16f targets. The encoder converts them to sRGB */
+    TArray<FFloat16Color> HalfPixels;
+
+    FDateTime CaptureTime;
+
+    /** FPlatformTime::Seconds() at capture, for latency stats */
+    double CaptureSeconds = 0.0;
+};
+
+/** One photo of the gallery, as listed in the gallery index */
+struct FDarkestFearGalleryEntry
+{
+    FString File;
+    FDateTime CaptureTime;
+    int32 Width = 0;
+    int32 Height = 0;
+    int64 Bytes = 0;
+};
+
+struct FDarkestFearSnapshotStats
+{
+    int32 Submitted = 0;
+    int32 Dropped = 0;
+    int32 Written = 0;
+    int32 Failed = 0;
+
+    double EncodeSeconds = 0.0;
+    double WriteSeconds = 0.0;
+
+    /** Capture to file on disk */
+    TArray<float> LatenciesMs;
+
+    int64 PeakBytesInFlight = 0;
+};
+
+/**
+ * Encodes snapshots and writes them to a gallery directory, off the game thread.
+ *
+ * Submit only moves the pixels into a bounded queue. Up to MaxEncodeTasks workers of the thread pool compress them
+ * to PNG or JPEG, and a single writer task saves the files in order and appends them to the gallery index
+ * (<Directory>/Gallery.tsv, one "File  CaptureTime  Width  Height  Bytes" line per photo). Snapshots beyond
+ * MaxQueued, or whose pixels would take the memory in flight over MaxBytesInFlight, are dropped: a burst can delay
+ * the gallery, but never stall the game or grow memory without bound.
+ *
+ * Needs no world and no renderer, so it can be driven headless with synthetic buffers, see DarkestFear.SnapshotBench
+ * and the DarkestFear.Snapshots automation tests.
+ */
+class DARKESTFEAR_API FDarkestFearSnapshotPipeline
+{
+public:
+    enum class EFormat : uint8
+    {
+        Png,
+        Jpeg
+    };
+
+    FDarkestFearSnapshotPipeline(const FString& InDirectory, EFormat InFormat);
+
+    /** Waits for everything queued to be on disk */
+    ~FDarkestFearSnapshotPipeline();
+
+    /** Queues a snapshot for encoding. Safe from any thread. False if it was dropped */
+    bool Submit(FDarkestFearSnapshot&& Snapshot);
+
+    /** Whether a snapshot of this size would be accepted right now */
+    bool CanAccept(int32 Width, int32 Height, int32 BytesPerPixel = sizeof(FColor)) const;
+
+    /** Blocks until every queued snapshot is written */
+    void Flush();
+
+    bool IsIdle() const;
+
+    /** Photos already on disk, oldest first */
+    TArray<FDarkestFearGalleryEntry> GetGallery() const;
+
+    FDarkestFearSnapshotStats GetStats() const;
+    void ResetStats();
+
+    const FString& GetDirectory() const { return Directory; }
+
+    int32 MaxQueued = 16;
+    int64 MaxBytesInFlight = 64 * 1024 * 1024;
+    int32 MaxEncodeTasks = 2;
+
+    /** JPEG quality, 1-100 */
+    int32 JpegQuality = 85;
+
+private:
+    struct FEncoded
+    {
+        FDarkestFearGalleryEntry Entry;
+        TArray64<uint8> Data;
+        int64 RawBytes;
+        double CaptureSeconds;
+    };
+
+    FString Directory;
+    FString IndexPath;
+    EFormat Format;
+
+    mutable FCriticalSection Lock;
+
+    // Everything below is guarded by Lock
+    TArray<FDarkestFearSnapshot> EncodeQueue;
+    TArray<FEncoded> WriteQueue;
+    TArray<FDarkestFearGalleryEntry> Gallery;
+    FDarkestFearSnapshotStats Stats;
+    int32 NumEncodeTasks = 0;
+    bool bWriting = false;
+    int64 BytesInFlight = 0;
+    int32 NextFileNumber = 0;
+
+    void LoadIndex();
+    void EncodeWorker();
+    void WriteWorker();
+    bool Encode(const FDarkestFearSnapshot& Snapshot, TArray64<uint8>& OutData) const;
+};
+
+/**
+ * Owns the player's snapshot gallery (Saved/Snapshots) for the whole game session, so writes in flight survive map
+ * travel, and turns render targets into snapshots without stalling: the copy is read back from the GPU a few frames
+ * later and handed to the pipeline straight from the render thread.
+ *
+ * Console commands:
+ *   DarkestFear.SnapshotBench [Count=32] [Size=1024] [png|jpg]  Burst of synthetic snapshots through a pipeline
+ *   DarkestFear.SnapshotStats                                   Gallery size and pipeline stats of this session
+ */
+UCLASS()
+class DARKESTFEAR_API UDarkestFearSnapshotSubsystem : public UGameInstanceSubsystem, public FTickableGameObject
+{
+    GENERATED_BODY()
+
+public:
+    virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+    virtual void Deinitialize() override;
+
+    /** Reads Target back and saves it to the gallery. RGBA8 and RGBA16f targets only. False if the snapshot was dropped */
+    bool Capture(class UTextureRenderTarget2D* Target);
+
+    FDarkestFearSnapshotPipeline* GetPipeline() const { return Pipeline.Get(); }
+
+    /** GPU readbacks that may be pending at once */
+    static constexpr int32 MaxReadbacks = 4;
+
+    // FTickableGameObject
+    virtual void Tick(float DeltaTime) override;
+    virtual bool IsTickable() const override;
+    virtual TStatId GetStatId() const override;
+
+private:
+    struct FReadback;
+
+    TUniquePtr<FDarkestFearSnapshotPipeline> Pipeline;
+    TArray<TSharedPtr<FReadback, ESPMode::ThreadSafe>> Readbacks;
+};
@@ -0,0 +1,286 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "InputRecorder.h"
+
+#include "Misc/App.h"
+#include "Misc/CommandLine.h"
+#include "Misc/FileHelper.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogInputRecorder, Log, All);
+
+namespace
+{
+    const uint32 InputRecordingMagic = 0x52494644; // "DFIR"
+    const uint32 InputRecordingVersion = 1;
+
+    // Packed frame delta (at least a byte), input and value
+    const int64 MinRecordedInputBytes = 1 + sizeof(uint8) + sizeof(float);
+}
+
+FInputRecorder::FInputRecorder()
+    : bIsRecording(false)
+    , bIsReplaying(false)
+    , CurrentFrame(0)
+    , ReplayCursor(0)
+    , FrameEventCount(0)
+    , LastFrameTime(0.0)
+    , bPreviousUseFixedTimeStep(false)
+    , PreviousFixedDeltaTime(0.0)
+{
+    FMemory::Memzero(AxisValues);
+}
+
+void FInputRecorder::InitFromCommandLine()
+{
+    FString Path;
+
+    if (FParse::Value(FCommandLine::Get(), TEXT("ReplayInput="), Path))
+    {
+        FString CsvPath;
+        float FixedFPS = 60.f;
+        FParse::Value(FCommandLine::Get(), TEXT("ReplayTimingCsv="), CsvPath);
+        FParse::Value(FCommandLine::Get(), TEXT("ReplayFPS="), FixedFPS);
+
+        StartReplay(Path, CsvPath, FixedFPS);
+    }
+    else if (FParse::Value(FCommandLine::Get(), TEXT("RecordInput="), Path))
+    {
+        StartRecording(Path);
+    }
+}
+
+void FInputRecorder::StartRecording(const FString& Path)
+{
+    Events.Reset();
+    FMemory::Memzero(AxisValues);
+    CurrentFrame = 0;
+    RecordingPath = Path;
+    bIsRecording = true;
+
+    UE_LOG(LogInputRecorder, Log, TEXT("Recording input to %s"), *Path);
+}
+
+void FInputRecorder::StopRecording()
+{
+    if (!bIsRecording)
+        return;
+
+    bIsRecording = false;
+
+    TArray<uint8> Bytes;
+    FMemoryWriter Writer(Bytes);
+    Serialize(Writer);
+
+    if (FFileHelper::SaveArrayToFile(Bytes, *RecordingPath))
+    {
+        UE_LOG(LogInputRecorder, Log, TEXT("Saved %d inputs over %u frames (%d bytes) to %s"),
+               Events.Num(), CurrentFrame, Bytes.Num(), *RecordingPath);
+    }
+    else
+    {
+        UE_LOG(LogInputRecorder, Error, TEXT("Could not write input recording %s"), *RecordingPath);
+    }
+}
+
+bool FInputRecorder::StartReplay(const FString& Path, const FString& CsvPath, float FixedFPS)
+{
+    TArray<uint8> Bytes;
+
+    if (!FFileHelper::LoadFileToArray(Bytes, *Path))
+    {
+        UE_LOG(LogInputRecorder, Error, TEXT("Could not read input recording %s"), *Path);
+        return false;
+    }
+
+    FMemoryReader Reader(Bytes);
+    Serialize(Reader);
+
+    if (Reader.IsError())
+    {
+        UE_LOG(LogInputRecorder, Error, TEXT("%s is not a valid input recording"), *Path);
+        Events.Reset();
+        return false;
+    }
+
+    // Identical frames need identical delta times, whatever the machine can actually manage
+    if (!bIsReplaying)
+    {
+        bPreviousUseFixedTimeStep = FApp::UseFixedTimeStep();
+        PreviousFixedDeltaTime = FApp::GetFixedDeltaTime();
+    }
+
+    FApp::SetFixedDeltaTime(1.0 / FMath::Max(FixedFPS, 1.f));
+    FApp::SetUseFixedTimeStep(true);
+
+    FMemory::Memzero(AxisValues);
+    CurrentFrame = 0;
+    ReplayCursor = 0;
+    FrameEventCount = 0;
+    TimingCsvPath = CsvPath;
+    TimingCsv = TEXT("Frame,Inputs,FrameMs\n");
+    LastFrameTime = FPlatformTime::Seconds();
+    bIsReplaying = true;
+
+    UE_LOG(LogInputRecorder, Log, TEXT("Replaying %d inputs from %s at %.1f fps"), Events.Num(), *Path, FixedFPS);
+    return true;
+}
+
+void FInputRecorder::StopReplay()
+{
+    if (!bIsReplaying)
+        return;
+
+    bIsReplaying = false;
+
+    FApp::SetFixedDeltaTime(PreviousFixedDeltaTime);
+    FApp::SetUseFixedTimeStep(bPreviousUseFixedTimeStep);
+
+    if (!TimingCsvPath.IsEmpty())
+    {
+        FFileHelper::SaveStringToFile(TimingCsv, *TimingCsvPath);
+    }
+
+    UE_LOG(LogInputRecorder, Log, TEXT("Replay finished after %u frames"), CurrentFrame);
+
+    if (FParse::Param(FCommandLine::Get(), TEXT("ExitAfterReplay")))
+    {
+        FPlatformMisc::RequestExit(false);
+    }
+}
+
+void FInputRecorder::Record(EDarkestFearInput Input, float Value)
+{
+    if (!bIsRecording)
+        return;
+
+    if (IsAxis(Input))
+    {
+        float& LastValue = AxisValues[static_cast<uint8>(Input)];
+
+        if (LastValue == Value)
+            return;
+
+        LastValue = Value;
+    }
+
+    Events.Add({CurrentFrame, Input, Value});
+}
+
+void FInputRecorder::GetReplayedInputs(TArray<FRecordedInput>& OutInputs)
+{
+    OutInputs.Reset();
+
+    if (!bIsReplaying)
+        return;
+
+    for (; ReplayCursor < Events.Num() && Events[ReplayCursor].Frame == CurrentFrame; ++ReplayCursor)
+    {
+        const FRecordedInput& Event = Events[ReplayCursor];
+
+        if (IsAxis(Event.Input))
+            AxisValues[static_cast<uint8>(Event.Input)] = Event.Value;
+        else
+            OutInputs.Add(Event);
+    }
+
+    FrameEventCount = OutInputs.Num();
+
+    // Axis bindings fire every frame, so held values are replayed every frame too
+    for (uint8 Axis = static_cast<uint8>(EDarkestFearInput::MoveForward); Axis <= static_cast<uint8>(EDarkestFearInput::LookUpRate); ++Axis)
+    {
+        OutInputs.Add({CurrentFrame, static_cast<EDarkestFearInput>(Axis), AxisValues[Axis]});
+    }
+}
+
+void FInputRecorder::AdvanceFrame()
+{
+    if (bIsReplaying)
+    {
+        const double Now = FPlatformTime::Seconds();
+        TimingCsv += FString::Printf(TEXT("%u,%d,%.3f\n"), CurrentFrame, FrameEventCount, (Now - LastFrameTime) * 1000.0);
+        LastFrameTime = Now;
+
+        if (ReplayCursor >= Events.Num())
+        {
+            StopReplay();
+        }
+    }
+
+    ++CurrentFrame;
+}
+
+void FInputRecorder::Serialize(FArchive& Ar)
+{
+    uint32 Magic = InputRecordingMagic;
+    uint32 Version = InputRecordingVersion;
+    int32 Num = Events.Num();
+
+    Ar << Magic << Version << Num;
+
+    if (Magic != InputRecordingMagic || Version != InputRecordingVersion || Num < 0)
+    {
+        Ar.SetError();
+        return;
+    }
+
+    if (Ar.IsLoading())
+    {
+        // The count comes from the file, a corrupt one must not allocate more events than the file can hold
+        if (Num > (Ar.TotalSize() - Ar.Tell()) / MinRecordedInputBytes)
+        {
+            Ar.SetError();
+            return;
+        }
+
+        Events.SetNumUninitialized(Num);
+    }
+
+    uint32 PreviousFrame = 0;
+
+    for (FRecordedInput& Event : Events)
+    {
+        // Frames are stored as deltas so long idle stretches stay small
+        uint32 FrameDelta = Event.Frame - PreviousFrame;
+        uint8 Input = static_cast<uint8>(Event.Input);
+
+        Ar.SerializeIntPacked(FrameDelta);
+        Ar << Input << Event.Value;
+
+        if (Ar.IsError())
+            return;
+
+        if (Ar.IsLoading())
+        {
+            Event.Frame = PreviousFrame + FrameDelta;
+            Event.Input = static_cast<EDarkestFearInput>(Input);
+
+            if (Input >= static_cast<uint8>(EDarkestFearInput::Count))
+            {
+                Ar.SetError();
+                return;
+            }
+        }
+
+        PreviousFrame = Event.Frame;
+    }
+}
+
+void UDarkestFearInputRecorderSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+    Super::Initialize(Collection);
+
+    // Nobody plays on a dedicated server
+    if (!IsRunningDedicatedServer())
+        Recorder.InitFromCommandLine();
+}
+
+void UDarkestFearInputRecorderSubsystem::Deinitialize()
+{
+    Recorder.StopRecording();
+    Recorder.StopReplay();
+
+    Super::Deinitialize();
+}
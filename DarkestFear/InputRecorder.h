@@ -0,0 +1,133 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/GameInstanceSubsystem.h"
+
+#include "InputRecorder.generated.h"
+
+/**
+ * Every gameplay input the character binds. Recorded files store these values, so only ever append to this list!
+ */
+enum class EDarkestFearInput : uint8
+{
+    Jump,
+    StopJumping,
+    PrimaryUse,
+    SecondaryUse,
+    Fire,
+    PickUpItem,
+    UseItemSlot0,
+    UseItemSlot1,
+    UseItemSlot2,
+    UseActiveItem,
+    BeginPlace,
+    FinishPlace,
+    MouseWheelUp,
+    MouseWheelDown,
+
+    // Axes: recorded only when their value changes, replayed every frame
+    MoveForward,
+    MoveRight,
+    Turn,
+    TurnRate,
+    LookUp,
+    LookUpRate,
+
+    // Actions added since the axes
+    StopFire,
+
+    Count
+};
+
+struct FRecordedInput
+{
+    uint32 Frame;
+    EDarkestFearInput Input;
+    float Value;
+};
+
+/**
+ * Records the character's bound inputs with the frame they happened on and plays them back frame by frame.
+ *
+ * Files are a small header followed by (packed frame delta, input, value) triplets. Replays run at a fixed
+ * timestep so two runs of the same file simulate identical frames, and optionally write a per-frame timing CSV
+ * whose rows line up with the replayed input stream.
+ */
+class DARKESTFEAR_API FInputRecorder
+{
+public:
+    FInputRecorder();
+
+    /** Reads -RecordInput=, -ReplayInput=, -ReplayTimingCsv= and -ReplayFPS= from the command line */
+    void InitFromCommandLine();
+
+    void StartRecording(const FString& Path);
+    void StopRecording();
+    bool IsRecording() const { return bIsRecording; }
+
+    bool StartReplay(const FString& Path, const FString& TimingCsvPath, float FixedFPS);
+    void StopReplay();
+    bool IsReplaying() const { return bIsReplaying; }
+
+    /** Records an action (Value 1) or an axis value for the current frame */
+    void Record(EDarkestFearInput Input, float Value);
+
+    /**
+     * Returns the replayed inputs due this frame, including held axis values.
+     * Call once per frame before AdvanceFrame.
+     */
+    void GetReplayedInputs(TArray<FRecordedInput>& OutInputs);
+
+    /** Ends the current frame, writing its timing row when replaying */
+    void AdvanceFrame();
+
+private:
+    bool bIsRecording;
+    bool bIsReplaying;
+
+    uint32 CurrentFrame;
+    TArray<FRecordedInput> Events;
+    int32 ReplayCursor;
+    int32 FrameEventCount;
+
+    // Last value seen or replayed per axis, so unchanged axes cost nothing in the file
+    float AxisValues[static_cast<uint8>(EDarkestFearInput::Count)];
+
+    FString RecordingPath;
+    FString TimingCsvPath;
+    FString TimingCsv;
+    double LastFrameTime;
+
+    // FApp's timestep before the replay fixed it, put back when it stops
+    bool bPreviousUseFixedTimeStep;
+    double PreviousFixedDeltaTime;
+
+    static bool IsAxis(EDarkestFearInput Input)
+    {
+        return Input >= EDarkestFearInput::MoveForward && Input <= EDarkestFearInput::LookUpRate;
+    }
+
+    void Serialize(FArchive& Ar);
+};
+
+/**
+ * The process's one FInputRecorder. Starts recording or replaying from the command line when the game starts and
+ * finishes when it ends, so possessing a new pawn, dying or travelling neither restarts nor truncates the file.
+ * Only the local player's character feeds and reads it, see ADarkestFearCharacter::GetInputRecorder.
+ */
+UCLASS()
+class DARKESTFEAR_API UDarkestFearInputRecorderSubsystem : public UGameInstanceSubsystem
+{
+    GENERATED_BODY()
+
+public:
+    virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+    virtual void Deinitialize() override;
+
+    FInputRecorder& GetRecorder() { return Recorder; }
+
+private:
+    FInputRecorder Recorder;
+};
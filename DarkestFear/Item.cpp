@@ -3,14 +3,34 @@
 
 #include "Item.h"
 
+#include "DarkestFearEvents.h"
+#include "DarkestFearMemory.h"
+#include "DarkestFearNavUpdates.h"
+#include "DarkestFearScalability.h"
+#include "EngineUtils.h"
+#include "ItemLagCompensation.h"
+#include "TimerManager.h"
+#include "Components/LightComponent.h"
+#include "HAL/IConsoleManager.h"
+
 // Sets default values
 AItem::AItem()
 {
+    DARKESTFEAR_LLM_SCOPE(STAT_DarkestFearItemsLLM);
+    DARKESTFEAR_LLM_SCOPE_CLASS(GetClass());
+
     // Set this actor to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
     PrimaryActorTick.bCanEverTick = false;
 
     // Every item can be picked up by default, but it should not be stolen if its in player hands
     bCanPickup = true;
+    bIsAtRest = false;
+    SimulationIndex = INDEX_NONE;
+
+    // The server owns where every item is: placed items replicate their transform, held ones the hand they are in.
+    // Replicating also makes items spawned at runtime on the server addressable in client RPCs
+    bReplicates = true;
+    SetReplicatingMovement(true);
 
     ArrowComponent = CreateEditorOnlyDefaultSubobject<UArrowComponent>(TEXT("ItemForward"));
 
@@ -31,13 +51,75 @@ AItem::AItem()
     {
         MeshComponent->SetupAttachment(ArrowComponent);
         MeshComponent->SetRelativeLocation(FVector(0, 0, 0));
+
+        // Relevant by default, so items placed in the level are part of the navmesh built with it
     }
 }
 
+void AItem::PreRegisterAllComponents()
+{
+    // Items spawned during play join navigation from BeginPlay, through UDarkestFearNavUpdateSubsystem's throttle,
+    // rather than each dirtying tiles the moment it registers
+    if (MeshComponent && !HasAnyFlags(RF_WasLoaded) && GetWorld() != nullptr && GetWorld()->IsGameWorld())
+        MeshComponent->SetCanEverAffectNavigation(false);
+
+    Super::PreRegisterAllComponents();
+}
+
 // Called when the game starts or when spawned
 void AItem::BeginPlay()
 {
     Super::BeginPlay();
+
+    ApplyQuality(FDarkestFearScalability::GetPreset());
+
+    if (GetAttachParentActor() == nullptr)
+        RequestNavUpdate(true);
+
+    RegisterLagCompensation();
+}
+
+void AItem::OnRep_AttachmentReplication()
+{
+    const bool bWasHeld = GetAttachParentActor() != nullptr;
+    const bool bIsHeld = AttachmentReplication.AttachParent != nullptr;
+
+    // Our own predicted pickups and placements already did all of this
+    if (bIsHeld && !bWasHeld)
+    {
+        // Stationary components can't be attached to a moving hand
+        ExitRestState();
+        RequestNavUpdate(false);
+    }
+
+    Super::OnRep_AttachmentReplication();
+
+    if (bWasHeld && !bIsHeld)
+        OnPlaced();
+}
+
+void AItem::OnSeamlessTravelled()
+{
+    // The previous map's subsystems went away with it
+    RegisterLagCompensation();
+}
+
+void AItem::RegisterLagCompensation()
+{
+    // The server keeps a bounds history of every item so client interactions can be judged in the past
+    if (HasAuthority() && GetWorld()->GetNetMode() != NM_Standalone)
+    {
+        if (UItemLagCompensationSubsystem* LagCompensation = GetWorld()->GetSubsystem<UItemLagCompensationSubsystem>())
+            LagCompensation->RegisterItem(this);
+    }
+}
+
+void AItem::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+    if (UItemLagCompensationSubsystem* LagCompensation = GetWorld()->GetSubsystem<UItemLagCompensationSubsystem>())
+        LagCompensation->UnregisterItem(this);
+
+    Super::EndPlay(EndPlayReason);
 }
 
 void AItem::Use(class ADarkestFearCharacter* DarkestFearCharacter)
@@ -50,6 +132,117 @@ void AItem::AlternateUse(ADarkestFearCharacter* DarkestFearCharacter)
     // Implement only in child items
 }
 
+void AItem::UndoUse(ADarkestFearCharacter* DarkestFearCharacter)
+{
+    // Implement only in child items
+}
+
+void AItem::ApplyQuality(const FDarkestFearQualityPreset& Quality)
+{
+    if (MeshComponent)
+        MeshComponent->SetCullDistance(Quality.PlacedItemCullDistance);
+}
+
+void AItem::RequestNavUpdate(bool bAffectsNavigation)
+{
+    if (UDarkestFearNavUpdateSubsystem* NavUpdates = GetWorld()->GetSubsystem<UDarkestFearNavUpdateSubsystem>())
+        NavUpdates->RequestItemNavUpdate(this, bAffectsNavigation);
+}
+
+void AItem::OnPlaced()
+{
+    RequestNavUpdate(true);
+
+    if (MeshComponent && MeshComponent->IsSimulatingPhysics())
+    {
+        GetWorldTimerManager().SetTimer(RestCheckTimerHandle, this, &AItem::CheckForRest, .5f, true);
+    }
+    else
+    {
+        EnterRestState();
+    }
+}
+
+void AItem::CheckForRest()
+{
+    if (!MeshComponent->RigidBodyIsAwake())
+    {
+        GetWorldTimerManager().ClearTimer(RestCheckTimerHandle);
+        EnterRestState();
+    }
+}
+
+void AItem::EnterRestState()
+{
+    if (bIsAtRest)
+        return;
+
+    bIsAtRest = true;
+    RestSavedStates.Reset();
+
+    if (RootComponent == nullptr)
+        return;
+
+    // Parents before children, so no stationary component is ever left under a movable parent
+    TArray<USceneComponent*> SceneComponents;
+    SceneComponents.Add(RootComponent);
+    RootComponent->GetChildrenComponents(true, SceneComponents);
+
+    for (USceneComponent* Component : SceneComponents)
+    {
+        UPrimitiveComponent* Primitive = Cast<UPrimitiveComponent>(Component);
+        FRestSavedState& Saved = RestSavedStates.AddDefaulted_GetRef();
+
+        Saved.Component = Component;
+        Saved.Mobility = Component->Mobility;
+        Saved.CollisionEnabled = Primitive ? Primitive->GetCollisionEnabled() : ECollisionEnabled::NoCollision;
+        Saved.bGenerateOverlapEvents = Primitive ? Primitive->GetGenerateOverlapEvents() : false;
+
+        // Lights stay movable: without baked lighting there is nothing else to switch to. They still benefit,
+        // the renderer keeps their shadow map cached as long as none of the casters around them move
+        if (Cast<ULightComponent>(Component) == nullptr)
+            Component->SetMobility(EComponentMobility::Stationary);
+
+        if (Primitive != nullptr)
+        {
+            Primitive->SetGenerateOverlapEvents(false);
+
+            if (Primitive->GetCollisionEnabled() == ECollisionEnabled::QueryAndPhysics)
+                Primitive->SetCollisionEnabled(ECollisionEnabled::QueryOnly);
+        }
+    }
+}
+
+void AItem::ExitRestState()
+{
+    GetWorldTimerManager().ClearTimer(RestCheckTimerHandle);
+
+    if (!bIsAtRest)
+        return;
+
+    bIsAtRest = false;
+
+    // Children before parents, the reverse of EnterRestState
+    for (int32 Index = RestSavedStates.Num() - 1; Index >= 0; Index--)
+    {
+        const FRestSavedState& Saved = RestSavedStates[Index];
+        USceneComponent* Component = Saved.Component.Get();
+
+        if (Component == nullptr)
+            continue;
+
+        Component->SetMobility(Saved.Mobility);
+
+        if (UPrimitiveComponent* Primitive = Cast<UPrimitiveComponent>(Component))
+        {
+            Primitive->SetCollisionEnabled(Saved.CollisionEnabled);
+            Primitive->SetGenerateOverlapEvents(Saved.bGenerateOverlapEvents);
+        }
+    }
+
+    RestSavedStates.Reset();
+}
+
 /**
  * Gives the player this item and sets its default properties.
  * Picked up items are attached to the default right hand socket by default
@@ -63,6 +256,10 @@ AItem* AItem::Pickup(ADarkestFearCharacter* DarkestFearCharacter, FName Attachme
     {
         if (DarkestFearCharacter)
         {
+            // Leaving the world: it is going to move with the player again
+            ExitRestState();
+            RequestNavUpdate(false);
+
             /* todo 11/09/2020: Disable collision and stuff before attaching to player to avoid weird behaviors!
              *     Remember to do this by setting collision groups! It'd be nice if those groups could be made
              *     programmatically.
@@ -74,8 +271,44 @@ AItem* AItem::Pickup(ADarkestFearCharacter* DarkestFearCharacter, FName Attachme
                 AttachmentName
             );
 
+            UDarkestFearEventSubsystem::PushItemEvent(EDarkestFearItemEvent::PickedUp, this, DarkestFearCharacter);
+
             return this;
         }
     }
     return nullptr;
 }
+
+static FAutoConsoleCommandWithWorldArgsAndOutputDevice ItemRestStatsCommand(
+    TEXT("DarkestFear.RestStats"),
+    TEXT("Counts items at rest, movable item components and shadow casting item lights"),
+    FConsoleCommandWithWorldArgsAndOutputDeviceDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World, FOutputDevice& Ar)
+    {
+        int32 NumItems = 0;
+        int32 NumAtRest = 0;
+        int32 NumMovableComponents = 0;
+        int32 NumShadowLights = 0;
+        int32 NumOverlapping = 0;
+
+        for (TActorIterator<AItem> It(World); It; ++It)
+        {
+            NumItems++;
+            NumAtRest += It->IsAtRest();
+
+            TInlineComponentArray<USceneComponent*> Components(*It);
+
+            for (const USceneComponent* Component : Components)
+            {
+                NumMovableComponents += Component->Mobility == EComponentMobility::Movable;
+
+                if (const UPrimitiveComponent* Primitive = Cast<UPrimitiveComponent>(Component))
+                    NumOverlapping += Primitive->GetGenerateOverlapEvents();
+
+                if (const ULightComponent* Light = Cast<ULightComponent>(Component))
+                    NumShadowLights += Light->IsVisible() && Light->CastShadows;
+            }
+        }
+
+        Ar.Logf(TEXT("Items: %d, at rest: %d, movable components: %d, overlap generating: %d, shadow casting lights: %d"),
+                NumItems, NumAtRest, NumMovableComponents, NumOverlapping, NumShadowLights);
+    }));
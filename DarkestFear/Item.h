@@ -27,15 +27,45 @@ public:
 
     virtual void Use(class ADarkestFearCharacter* DarkestFearCharacter);
     virtual void AlternateUse(class ADarkestFearCharacter* DarkestFearCharacter);
+
+    // Reverts a predicted Use the server rejected. Items whose Use changes their state must implement it
+    virtual void UndoUse(class ADarkestFearCharacter* DarkestFearCharacter);
     /*
      * todo 11/09/2020 change the below line AttachmentName to value taken from the player character
      * it absolutely makes no sense to define a default player value in the item class. 
      */
     virtual AItem* Pickup(class ADarkestFearCharacter* DarkestFearCharacter, FName AttachmentName = "hand_l_socket");
 
+    // Reconfigures the item for a DarkestFear scalability preset. Called on BeginPlay and whenever the preset changes
+    virtual void ApplyQuality(const struct FDarkestFearQualityPreset& Quality);
+
+    // Called once the item has been put down in the world. It enters its rest state as soon as it stops moving
+    virtual void OnPlaced();
+
+    bool IsAtRest() const { return bIsAtRest; }
+
+    // Called once the item has been carried into a new map by seamless travel. BeginPlay does not run again there
+    virtual void OnSeamlessTravelled();
+
+    // Slot of this item's simulated state, managed by UDarkestFearItemSimulationSubsystem. INDEX_NONE if it has none
+    int32 SimulationIndex;
+
+    // Runs the client side of a pickup or placement the server made, once the replicated attachment arrives
+    virtual void OnRep_AttachmentReplication() override;
+
 protected:
     // Called when the game starts or when spawned
     virtual void BeginPlay() override;
+    virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+    virtual void PreRegisterAllComponents() override;
+
+    /*
+     * A placed item won't move until somebody picks it up, so while at rest it stops paying for movement:
+     * components become stationary (no transform propagation, and shadow casters the renderer can cache),
+     * overlap events are off and collision only answers queries. ExitRestState restores everything.
+     */
+    virtual void EnterRestState();
+    virtual void ExitRestState();
 
 private:
     // Sets default properties hidden from everybody's eyes
@@ -46,4 +76,26 @@ private:
      */
     UPROPERTY()
     class UArrowComponent* ArrowComponent;
+
+    // What EnterRestState changed on each component, so ExitRestState can put it back
+    struct FRestSavedState
+    {
+        TWeakObjectPtr<USceneComponent> Component;
+        EComponentMobility::Type Mobility;
+        ECollisionEnabled::Type CollisionEnabled;
+        bool bGenerateOverlapEvents;
+    };
+
+    bool bIsAtRest;
+    TArray<FRestSavedState> RestSavedStates;
+    FTimerHandle RestCheckTimerHandle;
+
+    // Polls a physics simulating item until it goes to sleep
+    void CheckForRest();
+
+    // Lets the server judge client interactions with this item, see UItemLagCompensationSubsystem
+    void RegisterLagCompensation();
+
+    // Asks for this item to be added to or removed from navigation, see UDarkestFearNavUpdateSubsystem
+    void RequestNavUpdate(bool bAffectsNavigation);
 };
@@ -0,0 +1,350 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ItemLagCompensation.h"
+
+#include "HAL/IConsoleManager.h"
+#include "Item.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogLagCompensation, Log, All);
+
+//////////////////////////////////////////////////////////////////////////
+// FItemBoundsHistory
+
+FItemBoundsHistory::FItemBoundsHistory()
+    : Head(0)
+    , NumValidFrames(0)
+    , NumSlots(0)
+{
+}
+
+void FItemBoundsHistory::Init(int32 InNumFrames)
+{
+    Frames.SetNum(FMath::Max(InNumFrames, 2));
+    Head = 0;
+    NumValidFrames = 0;
+}
+
+int32 FItemBoundsHistory::AddSlot()
+{
+    if (FreeSlots.Num() > 0)
+        return FreeSlots.Pop(false);
+
+    return NumSlots++;
+}
+
+void FItemBoundsHistory::RemoveSlot(int32 Slot)
+{
+    for (FFrame& Frame : Frames)
+    {
+        if (Frame.Bounds.IsValidIndex(Slot))
+            Frame.Bounds[Slot].Init();
+    }
+
+    FreeSlots.Add(Slot);
+}
+
+void FItemBoundsHistory::BeginFrame(float Time)
+{
+    Head = (Head + 1) % Frames.Num();
+    NumValidFrames = FMath::Min(NumValidFrames + 1, Frames.Num());
+
+    // The reused frame keeps its allocation, we only reset the boxes
+    FFrame& Frame = Frames[Head];
+    Frame.Time = Time;
+    Frame.Bounds.SetNumUninitialized(NumSlots, false);
+
+    for (FBox& Box : Frame.Bounds)
+        Box.Init();
+}
+
+void FItemBoundsHistory::SetBounds(int32 Slot, const FBox& Bounds)
+{
+    Frames[Head].Bounds[Slot] = Bounds;
+}
+
+bool FItemBoundsHistory::FindFrames(float Time, const FFrame*& OutOlder, const FFrame*& OutNewer, float& OutAlpha) const
+{
+    if (NumValidFrames == 0)
+        return false;
+
+    // Requests outside the history are clamped to its ends
+    if (Time >= GetFrame(0).Time || NumValidFrames == 1)
+    {
+        OutOlder = OutNewer = &GetFrame(0);
+        OutAlpha = 0.f;
+        return true;
+    }
+
+    for (int32 Age = 1; Age < NumValidFrames; Age++)
+    {
+        const FFrame& Older = GetFrame(Age);
+
+        if (Older.Time <= Time)
+        {
+            OutOlder = &Older;
+            OutNewer = &GetFrame(Age - 1);
+            OutAlpha = (Time - Older.Time) / FMath::Max(OutNewer->Time - Older.Time, KINDA_SMALL_NUMBER);
+            return true;
+        }
+    }
+
+    OutOlder = OutNewer = &GetFrame(NumValidFrames - 1);
+    OutAlpha = 0.f;
+    return true;
+}
+
+bool FItemBoundsHistory::GetBoundsAtTime(int32 Slot, float Time, FBox& OutBounds) const
+{
+    const FFrame* Older;
+    const FFrame* Newer;
+    float Alpha;
+
+    return FindFrames(Time, Older, Newer, Alpha) && InterpolateBounds(*Older, *Newer, Alpha, Slot, OutBounds);
+}
+
+bool FItemBoundsHistory::InterpolateBounds(const FFrame& Older, const FFrame& Newer, float Alpha, int32 Slot,
+                                           FBox& OutBounds)
+{
+    if (!Older.Bounds.IsValidIndex(Slot))
+        return false;
+
+    const FBox& OlderBox = Older.Bounds[Slot];
+    const FBox& NewerBox = Newer.Bounds.IsValidIndex(Slot) ? Newer.Bounds[Slot] : OlderBox;
+
+    if (!OlderBox.IsValid || !NewerBox.IsValid)
+    {
+        // Appeared or disappeared between the two snapshots: use whichever side it existed on
+        OutBounds = Alpha < .5f ? OlderBox : NewerBox;
+        return OutBounds.IsValid != 0;
+    }
+
+    OutBounds = FBox(FMath::Lerp(OlderBox.Min, NewerBox.Min, Alpha), FMath::Lerp(OlderBox.Max, NewerBox.Max, Alpha));
+    return true;
+}
+
+int32 FItemBoundsHistory::Raycast(const FVector& Start, const FVector& End, float Time) const
+{
+    const FFrame* Older;
+    const FFrame* Newer;
+    float Alpha;
+
+    if (!FindFrames(Time, Older, Newer, Alpha))
+        return INDEX_NONE;
+
+    const FBox SegmentBounds = FBox(Start, Start) + End;
+    int32 BestSlot = INDEX_NONE;
+    float BestTime = TNumericLimits<float>::Max();
+
+    for (int32 Slot = 0; Slot < Older->Bounds.Num(); Slot++)
+    {
+        FBox Bounds;
+
+        if (!InterpolateBounds(*Older, *Newer, Alpha, Slot, Bounds) || !Bounds.Intersect(SegmentBounds))
+            continue;
+
+        FVector HitLocation;
+        FVector HitNormal;
+        float HitTime;
+
+        if (FMath::LineExtentBoxIntersection(Bounds, Start, End, FVector::ZeroVector, HitLocation, HitNormal, HitTime)
+            && HitTime < BestTime)
+        {
+            BestTime = HitTime;
+            BestSlot = Slot;
+        }
+    }
+
+    return BestSlot;
+}
+
+float FItemBoundsHistory::GetOldestTime() const
+{
+    return NumValidFrames > 0 ? GetFrame(NumValidFrames - 1).Time : 0.f;
+}
+
+float FItemBoundsHistory::GetNewestTime() const
+{
+    return NumValidFrames > 0 ? GetFrame(0).Time : 0.f;
+}
+
+int64 FItemBoundsHistory::GetAllocatedSize() const
+{
+    int64 Size = Frames.GetAllocatedSize() + FreeSlots.GetAllocatedSize();
+
+    for (const FFrame& Frame : Frames)
+        Size += Frame.Bounds.GetAllocatedSize();
+
+    return Size;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// UItemLagCompensationSubsystem
+
+void UItemLagCompensationSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+    Super::Initialize(Collection);
+
+    MaxRewindSeconds = .5f;
+    SampleRate = 30.f;
+    NumValidated = 0;
+    NumRejected = 0;
+    LastSampleTime = -1.f;
+
+    History.Init(FMath::CeilToInt(MaxRewindSeconds * SampleRate) + 1);
+}
+
+void UItemLagCompensationSubsystem::RegisterItem(AItem* Item)
+{
+    if (Item != nullptr && !SlotByItem.Contains(Item))
+    {
+        const int32 Slot = History.AddSlot();
+        SlotByItem.Add(Item, Slot);
+
+        if (ItemBySlot.Num() <= Slot)
+            ItemBySlot.SetNum(Slot + 1);
+
+        ItemBySlot[Slot] = Item;
+    }
+}
+
+void UItemLagCompensationSubsystem::UnregisterItem(AItem* Item)
+{
+    int32 Slot;
+
+    if (SlotByItem.RemoveAndCopyValue(Item, Slot))
+    {
+        ItemBySlot[Slot] = nullptr;
+        History.RemoveSlot(Slot);
+    }
+}
+
+bool UItemLagCompensationSubsystem::ValidateTrace(const AItem* Item, const FVector& Start, const FVector& End,
+                                                  float RewindSeconds)
+{
+    const float Now = GetWorld()->GetTimeSeconds();
+    const float ViewTime = Now - FMath::Clamp(RewindSeconds, 0.f, MaxRewindSeconds);
+    const int32 HitSlot = History.Raycast(Start, End, ViewTime);
+    const bool bValid = HitSlot != INDEX_NONE && ItemBySlot[HitSlot].Get() == Item;
+
+    if (bValid)
+    {
+        NumValidated++;
+    }
+    else
+    {
+        NumRejected++;
+        UE_LOG(LogLagCompensation, Verbose, TEXT("Rejected trace at %s rewound %.3fs"),
+               Item ? *Item->GetName() : TEXT("None"), Now - ViewTime);
+    }
+
+    return bValid;
+}
+
+void UItemLagCompensationSubsystem::Tick(float DeltaTime)
+{
+    const float Now = GetWorld()->GetTimeSeconds();
+
+    if (Now - LastSampleTime >= 1.f / SampleRate)
+    {
+        Sample(Now);
+        LastSampleTime = Now;
+    }
+}
+
+void UItemLagCompensationSubsystem::Sample(float Now)
+{
+    History.BeginFrame(Now);
+
+    for (int32 Slot = 0; Slot < ItemBySlot.Num(); Slot++)
+    {
+        const AItem* Item = ItemBySlot[Slot].Get();
+
+        // Items in someone's hands can't be interacted with
+        if (Item != nullptr && Item->GetAttachParentActor() == nullptr)
+            History.SetBounds(Slot, Item->GetComponentsBoundingBox());
+    }
+}
+
+bool UItemLagCompensationSubsystem::IsTickable() const
+{
+    const UWorld* World = GetWorld();
+    return World != nullptr && World->GetNetMode() != NM_Client && !IsTemplate() && SlotByItem.Num() > 0;
+}
+
+TStatId UItemLagCompensationSubsystem::GetStatId() const
+{
+    RETURN_QUICK_DECLARE_CYCLE_STAT(UItemLagCompensationSubsystem, STATGROUP_Tickables);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// Console commands
+
+static FAutoConsoleCommandWithWorldArgsAndOutputDevice LagCompensationStatsCommand(
+    TEXT("DarkestFear.LagCompStats"),
+    TEXT("Prints item lag compensation hit validation results and history memory"),
+    FConsoleCommandWithWorldArgsAndOutputDeviceDelegate::CreateLambda(
+        [](const TArray<FString>& Args, UWorld* World, FOutputDevice& Ar)
+        {
+            UItemLagCompensationSubsystem* LagCompensation = World ? World->GetSubsystem<UItemLagCompensationSubsystem>() : nullptr;
+
+            if (LagCompensation == nullptr)
+                return;
+
+            const int32 Total = LagCompensation->NumValidated + LagCompensation->NumRejected;
+            Ar.Logf(TEXT("Validated %d/%d (%.1f%%), history %.2fs, %.1f KB"),
+                    LagCompensation->NumValidated, Total,
+                    Total > 0 ? 100.f * LagCompensation->NumValidated / Total : 0.f,
+                    LagCompensation->GetHistory().GetNewestTime() - LagCompensation->GetHistory().GetOldestTime(),
+                    LagCompensation->GetHistory().GetAllocatedSize() / 1024.0);
+        }));
+
+static FAutoConsoleCommandWithWorldArgsAndOutputDevice LagCompensationBenchCommand(
+    TEXT("DarkestFear.LagCompBench"),
+    TEXT("DarkestFear.LagCompBench [Items=5000] [Queries=1000]: times bounds history inserts and rewound queries"),
+    FConsoleCommandWithWorldArgsAndOutputDeviceDelegate::CreateLambda(
+        [](const TArray<FString>& Args, UWorld* World, FOutputDevice& Ar)
+        {
+            const int32 NumItems = Args.Num() > 0 ? FMath::Max(FCString::Atoi(*Args[0]), 1) : 5000;
+            const int32 NumQueries = Args.Num() > 1 ? FMath::Max(FCString::Atoi(*Args[1]), 1) : 1000;
+            const int32 NumFrames = 16;
+
+            FItemBoundsHistory History;
+            History.Init(NumFrames);
+
+            for (int32 Index = 0; Index < NumItems; Index++)
+                History.AddSlot();
+
+            FRandomStream Random(1234);
+            const double InsertStart = FPlatformTime::Seconds();
+
+            for (int32 Frame = 0; Frame < NumFrames; Frame++)
+            {
+                History.BeginFrame(Frame / 30.f);
+
+                for (int32 Slot = 0; Slot < NumItems; Slot++)
+                {
+                    const FVector Center(Slot % 100 * 100.f + Frame, Slot / 100 * 100.f, 0.f);
+                    History.SetBounds(Slot, FBox::BuildAABB(Center, FVector(10.f)));
+                }
+            }
+
+            const double InsertSeconds = FPlatformTime::Seconds() - InsertStart;
+            int32 Hits = 0;
+            const double QueryStart = FPlatformTime::Seconds();
+
+            for (int32 Query = 0; Query < NumQueries; Query++)
+            {
+                const FVector Start(Random.FRandRange(0.f, 10000.f), Random.FRandRange(0.f, 10000.f), 100.f);
+                const float Time = Random.FRandRange(0.f, (NumFrames - 1) / 30.f);
+
+                if (History.Raycast(Start, Start - FVector(0.f, 0.f, 200.f), Time) != INDEX_NONE)
+                    Hits++;
+            }
+
+            const double QuerySeconds = FPlatformTime::Seconds() - QueryStart;
+
+            Ar.Logf(TEXT("%d items x %d frames: insert %.3f us/item/frame, query %.3f us (%d hits), %.1f KB"),
+                    NumItems, NumFrames, InsertSeconds * 1e6 / (NumItems * NumFrames),
+                    QuerySeconds * 1e6 / NumQueries, Hits, History.GetAllocatedSize() / 1024.0);
+        }));
@@ -0,0 +1,107 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Tickable.h"
+
+#include "ItemLagCompensation.generated.h"
+
+/**
+ * Fixed-size ring buffer of item bounds. Each tracked item owns a slot, each frame stores one box per slot.
+ * Memory is NumFrames * NumSlots boxes and never grows while the number of items stays the same.
+ */
+class DARKESTFEAR_API FItemBoundsHistory
+{
+public:
+    FItemBoundsHistory();
+
+    void Init(int32 InNumFrames);
+
+    int32 AddSlot();
+    void RemoveSlot(int32 Slot);
+
+    /** Starts a new snapshot at Time, overwriting the oldest one when the buffer is full */
+    void BeginFrame(float Time);
+
+    /** Stores Slot's bounds in the latest snapshot. Slots left unset in a frame count as not interactable */
+    void SetBounds(int32 Slot, const FBox& Bounds);
+
+    /** Interpolated bounds of Slot at Time, if the history covers it */
+    bool GetBoundsAtTime(int32 Slot, float Time, FBox& OutBounds) const;
+
+    /** Returns the slot whose bounds at Time are hit first by the segment, or INDEX_NONE */
+    int32 Raycast(const FVector& Start, const FVector& End, float Time) const;
+
+    float GetOldestTime() const;
+    float GetNewestTime() const;
+    int64 GetAllocatedSize() const;
+
+private:
+    struct FFrame
+    {
+        float Time;
+        TArray<FBox> Bounds;
+    };
+
+    TArray<FFrame> Frames;
+    int32 Head;
+    int32 NumValidFrames;
+    int32 NumSlots;
+    TArray<int32> FreeSlots;
+
+    const FFrame& GetFrame(int32 Age) const { return Frames[(Head - Age + Frames.Num()) % Frames.Num()]; }
+
+    /** Finds the snapshots around Time and how far between them it is */
+    bool FindFrames(float Time, const FFrame*& OutOlder, const FFrame*& OutNewer, float& OutAlpha) const;
+
+    static bool InterpolateBounds(const FFrame& Older, const FFrame& Newer, float Alpha, int32 Slot, FBox& OutBounds);
+};
+
+/**
+ * Server-side history of interactable item bounds, used to judge a client's pickup/use traces against the world
+ * it actually saw instead of the server's present. Items register themselves on BeginPlay while they have
+ * authority. Only items that are lying in the world (not attached to a player) are interactable.
+ */
+UCLASS()
+class DARKESTFEAR_API UItemLagCompensationSubsystem : public UWorldSubsystem, public FTickableGameObject
+{
+    GENERATED_BODY()
+
+public:
+    virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+
+    void RegisterItem(class AItem* Item);
+    void UnregisterItem(class AItem* Item);
+
+    /**
+     * Checks that the segment hits Item first, with item bounds rewound by RewindSeconds.
+     * The rewind is clamped to the history we keep.
+     */
+    bool ValidateTrace(const class AItem* Item, const FVector& Start, const FVector& End, float RewindSeconds);
+
+    /** Longest rewind we accept, also sizes the history */
+    float MaxRewindSeconds;
+
+    /** Snapshots recorded per second */
+    float SampleRate;
+
+    int32 NumValidated;
+    int32 NumRejected;
+
+    const FItemBoundsHistory& GetHistory() const { return History; }
+
+    // FTickableGameObject
+    virtual void Tick(float DeltaTime) override;
+    virtual bool IsTickable() const override;
+    virtual TStatId GetStatId() const override;
+
+private:
+    FItemBoundsHistory History;
+    TMap<TWeakObjectPtr<class AItem>, int32> SlotByItem;
+    TArray<TWeakObjectPtr<class AItem>> ItemBySlot;
+    float LastSampleTime;
+
+    void Sample(float Now);
+};
@@ -3,25 +3,49 @@
 
 #include "Flashlight.h"
 
+#include "DarkestFear/DarkestFearIllumination.h"
+#include "DarkestFear/DarkestFearMemory.h"
+#include "DarkestFear/DarkestFearScalability.h"
+#include "Net/UnrealNetwork.h"
+
 // Sets default values
 AFlashlight::AFlashlight()
 {
+    DARKESTFEAR_LLM_SCOPE(STAT_DarkestFearItemsLLM);
+    DARKESTFEAR_LLM_SCOPE_CLASS(GetClass());
+
+    bIsOn = true;
+    BatteryLife = 1800.f;
+    BatteryCharge = 1.f;
+    SpotLight = nullptr;
+
+    IlluminationBrightness = 1000.f;
+    IlluminationRange = 1500.f;
+    IlluminationInnerConeAngle = 15.f;
+    IlluminationOuterConeAngle = 30.f;
+
     /*
      * Add flashlight's spotlight without offset. Offset must be done manually.
      * Assuming the flashlight's position makes no sense at all
     */
-    SpotLight = CreateDefaultSubobject<USpotLightComponent>(TEXT("Spotlight"));
-    SpotLight->SetupAttachment(Super::MeshComponent);
-    SpotLight->SetRelativeLocation(FVector(0.0f, 0.0f, 0.0f));
-
-    // Flashlight's default values don't override it here. Change in blueprints!
-    SpotLight->InnerConeAngle = 15.f;
-    SpotLight->OuterConeAngle = 30.f;
-    SpotLight->Intensity = 1000.f;
-    SpotLight->AttenuationRadius = 1500.f;
-    SpotLight->SourceRadius = 5.f;
-    SpotLight->SoftSourceRadius = 3.f;
-    SpotLight->Temperature = 6500.f;
+    // Every build creates it, so the class default is the same for Blueprints and cooked data everywhere.
+    // Dedicated servers drop it in PreRegisterAllComponents
+    SpotLight = CreateOptionalDefaultSubobject<USpotLightComponent>(TEXT("Spotlight"));
+
+    if (SpotLight)
+    {
+        SpotLight->SetupAttachment(Super::MeshComponent);
+        SpotLight->SetRelativeLocation(FVector(0.0f, 0.0f, 0.0f));
+
+        // Flashlight's default values don't override it here. Change in blueprints!
+        SpotLight->InnerConeAngle = 15.f;
+        SpotLight->OuterConeAngle = 30.f;
+        SpotLight->Intensity = 1000.f;
+        SpotLight->AttenuationRadius = 1500.f;
+        SpotLight->SourceRadius = 5.f;
+        SpotLight->SoftSourceRadius = 3.f;
+        SpotLight->Temperature = 6500.f;
+    }
 
     // Add and attach any components below this line:
 }
@@ -30,15 +54,168 @@ AFlashlight::AFlashlight()
 void AFlashlight::BeginPlay()
 {
     Super::BeginPlay();
+
+    UpdateLight();
+
+    if (UDarkestFearIlluminationSubsystem* Illumination = GetWorld()->GetSubsystem<UDarkestFearIlluminationSubsystem>())
+        Illumination->RegisterFlashlight(this);
+
+    RegisterSimulation();
+}
+
+void AFlashlight::PreRegisterAllComponents()
+{
+    // Dedicated servers never render, so they only keep the gameplay side of the flashlight
+    if (IsRunningDedicatedServer() && SpotLight)
+    {
+        SpotLight->DestroyComponent();
+        SpotLight = nullptr;
+    }
+
+    Super::PreRegisterAllComponents();
+}
+
+void AFlashlight::OnSeamlessTravelled()
+{
+    Super::OnSeamlessTravelled();
+
+    if (UDarkestFearIlluminationSubsystem* Illumination = GetWorld()->GetSubsystem<UDarkestFearIlluminationSubsystem>())
+        Illumination->RegisterFlashlight(this);
+
+    RegisterSimulation();
+}
+
+void AFlashlight::RegisterSimulation()
+{
+    if (UDarkestFearItemSimulationSubsystem* Simulation = GetWorld()->GetSubsystem<UDarkestFearItemSimulationSubsystem>())
+        Simulation->Register(this, FFlashlightSimState{BatteryCharge, 1.f / FMath::Max(BatteryLife, 1.f), bIsOn});
+}
+
+void AFlashlight::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+    if (UDarkestFearIlluminationSubsystem* Illumination = GetWorld()->GetSubsystem<UDarkestFearIlluminationSubsystem>())
+        Illumination->UnregisterFlashlight(this);
+
+    if (UDarkestFearItemSimulationSubsystem* Simulation = GetWorld()->GetSubsystem<UDarkestFearItemSimulationSubsystem>())
+        Simulation->Unregister<FFlashlightSimState>(this);
+
+    Super::EndPlay(EndPlayReason);
+}
+
+void AFlashlight::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
+{
+    Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+    DOREPLIFETIME(AFlashlight, bIsOn);
+}
+
+void AFlashlight::OnRep_IsOn()
+{
+    // The simulated state has to follow too, or it would keep draining, or stop, on its own
+    SetOn(bIsOn);
 }
 
 void AFlashlight::Use(class ADarkestFearCharacter* DarkestFearCharacter)
 {
-    SpotLight->ToggleVisibility();
+    SetOn(!bIsOn);
     // todo: play click sound
 }
 
+void AFlashlight::UndoUse(ADarkestFearCharacter* DarkestFearCharacter)
+{
+    // Use is a toggle, so it is its own inverse
+    SetOn(!bIsOn);
+}
+
+FDarkestFearItemSimChanges FFlashlightSimState::Simulate(FFlashlightSimState& State, float DeltaTime)
+{
+    if (!State.bIsOn)
+        return 0;
+
+    State.Charge -= State.DrainPerSecond * DeltaTime;
+
+    if (State.Charge > 0.f)
+        return 0;
+
+    State.Charge = 0.f;
+    State.bIsOn = false;
+
+    return BatteryEmpty;
+}
+
+float AFlashlight::GetBatteryCharge() const
+{
+    UDarkestFearItemSimulationSubsystem* Simulation = GetWorld() ? GetWorld()->GetSubsystem<UDarkestFearItemSimulationSubsystem>() : nullptr;
+    const FFlashlightSimState* State = Simulation ? Simulation->GetState<FFlashlightSimState>(this) : nullptr;
+
+    return State ? State->Charge : BatteryCharge;
+}
+
+void AFlashlight::SetOn(bool bOn)
+{
+    UDarkestFearItemSimulationSubsystem* Simulation = GetWorld() ? GetWorld()->GetSubsystem<UDarkestFearItemSimulationSubsystem>() : nullptr;
+    FFlashlightSimState* State = Simulation ? Simulation->GetState<FFlashlightSimState>(this) : nullptr;
+
+    bIsOn = bOn && (State ? State->Charge : BatteryCharge) > 0.f;
+
+    if (State)
+        State->bIsOn = bIsOn;
+
+    UpdateLight();
+}
+
+void AFlashlight::ReleaseSimulation(const FFlashlightSimState& State)
+{
+    BatteryCharge = State.Charge;
+}
+
+void AFlashlight::CommitSimulation(const FFlashlightSimState& State, FDarkestFearItemSimChanges Changes)
+{
+    if (Changes & FFlashlightSimState::BatteryEmpty)
+    {
+        bIsOn = false;
+        UpdateLight();
+    }
+}
+
+float AFlashlight::GetIlluminationAt(const FVector& Location) const
+{
+    // Items in the inventory but not in the hand are hidden, and so is their light
+    if (!bIsOn || IsHidden())
+        return 0.f;
+
+    // The spot light sits on the mesh without offset, and the mesh exists on servers too
+    const FVector ToLocation = Location - MeshComponent->GetComponentLocation();
+    const float Distance = ToLocation.Size();
+
+    if (Distance >= IlluminationRange)
+        return 0.f;
+
+    const float CosAngle = FVector::DotProduct(ToLocation.GetSafeNormal(), MeshComponent->GetForwardVector());
+    const float Cone = FDarkestFearIllumination::ConeFalloff(CosAngle, FMath::Cos(FMath::DegreesToRadians(IlluminationInnerConeAngle)),
+                                                             FMath::Cos(FMath::DegreesToRadians(IlluminationOuterConeAngle)));
+
+    return IlluminationBrightness * Cone * FDarkestFearIllumination::DistanceFalloff(Distance, IlluminationRange);
+}
+
+void AFlashlight::UpdateLight()
+{
+    if (SpotLight)
+        SpotLight->SetVisibility(bIsOn);
+}
+
 void AFlashlight::AlternateUse(ADarkestFearCharacter* DarkestFearCharacter)
 {
     
 }
+
+void AFlashlight::ApplyQuality(const FDarkestFearQualityPreset& Quality)
+{
+    Super::ApplyQuality(Quality);
+
+    if (SpotLight == nullptr)
+        return;
+
+    SpotLight->SetCastShadows(Quality.bFlashlightShadows);
+    SpotLight->SetAttenuationRadius(Quality.FlashlightAttenuationRadius);
+}
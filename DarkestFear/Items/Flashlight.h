@@ -6,9 +6,26 @@
 
 
 #include "Components/SpotLightComponent.h"
+#include "DarkestFear/DarkestFearItemSimulation.h"
 #include "DarkestFear/Item.h"
 #include "Flashlight.generated.h"
 
+/** Simulated part of a flashlight, see UDarkestFearItemSimulationSubsystem */
+struct FFlashlightSimState
+{
+    // Battery charge, 0 to 1
+    float Charge;
+    float DrainPerSecond;
+    bool bIsOn;
+
+    enum : FDarkestFearItemSimChanges
+    {
+        BatteryEmpty = 1 << 0
+    };
+
+    static FDarkestFearItemSimChanges Simulate(FFlashlightSimState& State, float DeltaTime);
+};
+
 UCLASS()
 class DARKESTFEAR_API AFlashlight : public AItem
 {
@@ -18,15 +35,69 @@ public:
     // Sets default values for this actor's properties
     AFlashlight();
 
+    // Presentation only: destroyed before registering on dedicated servers, and subclasses may opt out of it with
+    // DoNotCreateDefaultSubobject. Always check before use
     UPROPERTY(VisibleAnywhere, Instanced, BlueprintReadWrite, Category="General")
     class USpotLightComponent* SpotLight;
 
+    // Gameplay state of the flashlight, exists everywhere and replicates from the server. SpotLight just follows it
+    UPROPERTY(ReplicatedUsing=OnRep_IsOn, EditAnywhere, BlueprintReadOnly, Category="State")
+    bool bIsOn;
+
+    // Seconds a full battery lasts with the light on
+    UPROPERTY(EditAnywhere, BlueprintReadOnly, Category="State")
+    float BatteryLife;
+
+    // How the flashlight lights up the world for gameplay (darkness queries), independent of the rendered SpotLight
+    UPROPERTY(EditAnywhere, BlueprintReadOnly, Category="Illumination")
+    float IlluminationBrightness;
+
+    UPROPERTY(EditAnywhere, BlueprintReadOnly, Category="Illumination")
+    float IlluminationRange;
+
+    UPROPERTY(EditAnywhere, BlueprintReadOnly, Category="Illumination")
+    float IlluminationInnerConeAngle;
+
+    UPROPERTY(EditAnywhere, BlueprintReadOnly, Category="Illumination")
+    float IlluminationOuterConeAngle;
+
 protected:
     // Called when the game starts or when spawned
     virtual void BeginPlay() override;
+    virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+    virtual void PreRegisterAllComponents() override;
+
+    UFUNCTION()
+    void OnRep_IsOn();
 
 public:
     // Declaration of actor's functions
     virtual void Use(class ADarkestFearCharacter* DarkestFearCharacter) override;
     virtual void AlternateUse(ADarkestFearCharacter* DarkestFearCharacter) override;
+    virtual void UndoUse(ADarkestFearCharacter* DarkestFearCharacter) override;
+    virtual void ApplyQuality(const FDarkestFearQualityPreset& Quality) override;
+    virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
+
+    // Light this flashlight adds at Location, ignoring occlusion. See UDarkestFearIlluminationSubsystem
+    float GetIlluminationAt(const FVector& Location) const;
+
+    // Battery left, 0 to 1
+    float GetBatteryCharge() const;
+
+    // Switches the light, on only if the battery has charge left
+    void SetOn(bool bOn);
+
+    void CommitSimulation(const FFlashlightSimState& State, FDarkestFearItemSimChanges Changes);
+    void ReleaseSimulation(const FFlashlightSimState& State);
+
+    virtual void OnSeamlessTravelled() override;
+
+private:
+    // Charge while the flashlight has no simulated state: before BeginPlay and during seamless travel
+    float BatteryCharge;
+
+    // Makes SpotLight match bIsOn, where there is a SpotLight
+    void UpdateLight();
+
+    void RegisterSimulation();
 };
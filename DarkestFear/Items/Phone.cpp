@@ -3,40 +3,212 @@
 
 #include "Phone.h"
 
+#include "DarkestFear/DarkestFearMemory.h"
+#include "DarkestFear/DarkestFearScalability.h"
+#include "DarkestFear/DarkestFearSnapshots.h"
+#include "Engine/GameInstance.h"
+#include "Engine/TextureRenderTarget2D.h"
+#include "TimerManager.h"
+
 // Sets default values
 APhone::APhone()
 {
+    DARKESTFEAR_LLM_SCOPE(STAT_DarkestFearItemsLLM);
+    DARKESTFEAR_LLM_SCOPE_CLASS(GetClass());
+
     // Set this actor to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
     PrimaryActorTick.bCanEverTick = false;
 
+    RealTimeCamera = nullptr;
+    PhoneScreen = nullptr;
+    BatteryLife = 14400.f;
+    BatteryCharge = 1.f;
+
+    // Created on every build so the class default is the same everywhere, dedicated servers drop them in
+    // PreRegisterAllComponents
+
     // This is the realtime render target camera
-    RealTimeCamera = CreateDefaultSubobject<USceneCaptureComponent2D>(TEXT("Phone Camera"));
-    RealTimeCamera->SetupAttachment(Super::MeshComponent);
-    RealTimeCamera->SetWorldScale3D(FVector(.15f, .15f, .15f));
+    {
+        DARKESTFEAR_LLM_SCOPE(STAT_DarkestFearPhoneCaptureLLM);
+        RealTimeCamera = CreateOptionalDefaultSubobject<USceneCaptureComponent2D>(TEXT("Phone Camera"));
+
+        if (RealTimeCamera)
+        {
+            RealTimeCamera->SetupAttachment(Super::MeshComponent);
+            RealTimeCamera->SetWorldScale3D(FVector(.15f, .15f, .15f));
+        }
+    }
 
     // This is the plane in which our render target camera will render the camera FOV
-    PhoneScreen = CreateDefaultSubobject<UStaticMeshComponent>(TEXT("Phone Screen"));
-    PhoneScreen->SetupAttachment(Super::MeshComponent);
-    PhoneScreen->SetCastShadow(false);
+    PhoneScreen = CreateOptionalDefaultSubobject<UStaticMeshComponent>(TEXT("Phone Screen"));
+
+    if (PhoneScreen)
+    {
+        PhoneScreen->SetupAttachment(Super::MeshComponent);
+        PhoneScreen->SetCastShadow(false);
+    }
 }
 
 // Called when the game starts or when spawned
 void APhone::BeginPlay()
 {
     Super::BeginPlay();
+
+    RegisterSimulation();
+}
+
+void APhone::PreRegisterAllComponents()
+{
+    // Dedicated servers never render: no capture, no screen, only the item's mesh for collision
+    if (IsRunningDedicatedServer())
+    {
+        if (RealTimeCamera)
+        {
+            RealTimeCamera->DestroyComponent();
+            RealTimeCamera = nullptr;
+        }
+
+        if (PhoneScreen)
+        {
+            PhoneScreen->DestroyComponent();
+            PhoneScreen = nullptr;
+        }
+    }
+
+    Super::PreRegisterAllComponents();
+}
+
+void APhone::OnSeamlessTravelled()
+{
+    Super::OnSeamlessTravelled();
+
+    RegisterSimulation();
+}
+
+void APhone::RegisterSimulation()
+{
+    if (UDarkestFearItemSimulationSubsystem* Simulation = GetWorld()->GetSubsystem<UDarkestFearItemSimulationSubsystem>())
+        Simulation->Register(this, FPhoneSimState{BatteryCharge, 1.f / FMath::Max(BatteryLife, 1.f)});
+}
+
+void APhone::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+    if (UDarkestFearItemSimulationSubsystem* Simulation = GetWorld()->GetSubsystem<UDarkestFearItemSimulationSubsystem>())
+        Simulation->Unregister<FPhoneSimState>(this);
+
+    Super::EndPlay(EndPlayReason);
+}
+
+FDarkestFearItemSimChanges FPhoneSimState::Simulate(FPhoneSimState& State, float DeltaTime)
+{
+    if (State.Charge <= 0.f)
+        return 0;
+
+    State.Charge -= State.DrainPerSecond * DeltaTime;
+
+    if (State.Charge > 0.f)
+        return 0;
+
+    State.Charge = 0.f;
+    return BatteryEmpty;
+}
+
+float APhone::GetBatteryCharge() const
+{
+    UDarkestFearItemSimulationSubsystem* Simulation = GetWorld() ? GetWorld()->GetSubsystem<UDarkestFearItemSimulationSubsystem>() : nullptr;
+    const FPhoneSimState* State = Simulation ? Simulation->GetState<FPhoneSimState>(this) : nullptr;
+
+    return State ? State->Charge : BatteryCharge;
+}
+
+void APhone::ReleaseSimulation(const FPhoneSimState& State)
+{
+    BatteryCharge = State.Charge;
 }
 
-// Called every frame
-void APhone::Tick(float DeltaTime)
+void APhone::CommitSimulation(const FPhoneSimState& State, FDarkestFearItemSimChanges Changes)
 {
-    Super::Tick(DeltaTime);
+    if (!(Changes & FPhoneSimState::BatteryEmpty))
+        return;
+
+    // A dead phone neither films nor shows anything
+    GetWorldTimerManager().ClearTimer(CaptureTimerHandle);
+
+    if (RealTimeCamera)
+        RealTimeCamera->bCaptureEveryFrame = false;
+
+    if (PhoneScreen)
+        PhoneScreen->SetVisibility(false);
 }
 
 void APhone::Use(ADarkestFearCharacter* DarkestFearCharacter)
 {
+    // Takes a photo, saved on the machine of whoever holds the phone
+    if (RealTimeCamera == nullptr || DarkestFearCharacter == nullptr || !DarkestFearCharacter->IsLocallyControlled() ||
+        GetBatteryCharge() <= 0.f)
+        return;
+
+    UGameInstance* GameInstance = GetGameInstance();
+    UDarkestFearSnapshotSubsystem* Snapshots = GameInstance ? GameInstance->GetSubsystem<UDarkestFearSnapshotSubsystem>() : nullptr;
+
+    if (Snapshots == nullptr || RealTimeCamera->TextureTarget == nullptr)
+        return;
+
+    // A capture rate cap may have left the target a few frames old
+    if (!RealTimeCamera->bCaptureEveryFrame)
+        RealTimeCamera->CaptureScene();
+
+    Snapshots->Capture(RealTimeCamera->TextureTarget);
 }
 
 void APhone::AlternateUse(ADarkestFearCharacter* DarkestFearCharacter)
 {
     
 }
+
+void APhone::ApplyQuality(const FDarkestFearQualityPreset& Quality)
+{
+    Super::ApplyQuality(Quality);
+
+    if (RealTimeCamera == nullptr || GetBatteryCharge() <= 0.f)
+        return;
+
+    UTextureRenderTarget2D* Target = RealTimeCamera->TextureTarget;
+
+    if (Target != nullptr && Target->SizeX != Quality.PhoneCaptureResolution)
+    {
+        Target->ResizeTarget(Quality.PhoneCaptureResolution, Quality.PhoneCaptureResolution);
+    }
+
+    UWorld* World = GetWorld();
+
+    if (World == nullptr)
+        return;
+
+    World->GetTimerManager().ClearTimer(CaptureTimerHandle);
+
+    // A zero rate captures every frame, anything else captures on a timer instead
+    RealTimeCamera->bCaptureEveryFrame = Quality.PhoneCaptureRate <= 0.f;
+
+    if (!RealTimeCamera->bCaptureEveryFrame)
+    {
+        World->GetTimerManager().SetTimer(CaptureTimerHandle, this, &APhone::CaptureScene,
+                                          1.f / Quality.PhoneCaptureRate, true);
+    }
+}
+
+float APhone::GetCaptureRate() const
+{
+    const UWorld* World = GetWorld();
+
+    if (World == nullptr || !World->GetTimerManager().IsTimerActive(CaptureTimerHandle))
+        return 0.f;
+
+    return 1.f / World->GetTimerManager().GetTimerRate(CaptureTimerHandle);
+}
+
+void APhone::CaptureScene()
+{
+    if (RealTimeCamera && !IsHidden())
+        RealTimeCamera->CaptureScene();
+}
@@ -5,9 +5,25 @@
 #include "CoreMinimal.h"
 
 #include "Components/SceneCaptureComponent2D.h"
+#include "DarkestFear/DarkestFearItemSimulation.h"
 #include "DarkestFear/Item.h"
 #include "Phone.generated.h"
 
+/** Simulated part of a phone, see UDarkestFearItemSimulationSubsystem */
+struct FPhoneSimState
+{
+    // Battery charge, 0 to 1. The screen is always on, so it always drains
+    float Charge;
+    float DrainPerSecond;
+
+    enum : FDarkestFearItemSimChanges
+    {
+        BatteryEmpty = 1 << 0
+    };
+
+    static FDarkestFearItemSimChanges Simulate(FPhoneSimState& State, float DeltaTime);
+};
+
 UCLASS()
 class DARKESTFEAR_API APhone : public AItem
 {
@@ -17,7 +33,8 @@ public:
     // Sets default values for this actor's properties
     APhone();
 
-    // The phone must have a render target camera so we can film what happens
+    // The phone must have a render target camera so we can film what happens. Presentation only, like PhoneScreen:
+    // destroyed before registering on dedicated servers, and optional for subclasses
     UPROPERTY(VisibleAnywhere, Instanced, BlueprintReadWrite, Category="General")
     class USceneCaptureComponent2D* RealTimeCamera;
 
@@ -25,14 +42,40 @@ public:
     UPROPERTY(VisibleAnywhere, Instanced, BlueprintReadWrite, Category="General")
     class UStaticMeshComponent* PhoneScreen;
 
+    // Seconds a full battery lasts
+    UPROPERTY(EditAnywhere, BlueprintReadOnly, Category="State")
+    float BatteryLife;
+
 protected:
     // Called when the game starts or when spawned
     virtual void BeginPlay() override;
+    virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+    virtual void PreRegisterAllComponents() override;
 
 public:
-    // Called every frame
-    virtual void Tick(float DeltaTime) override;
-
     virtual void Use(ADarkestFearCharacter* DarkestFearCharacter) override;
     virtual void AlternateUse(ADarkestFearCharacter* DarkestFearCharacter) override;
+    virtual void ApplyQuality(const FDarkestFearQualityPreset& Quality) override;
+
+    // Battery left, 0 to 1
+    float GetBatteryCharge() const;
+
+    // Scene captures per second of RealTimeCamera, 0 when it captures every frame
+    float GetCaptureRate() const;
+
+    void CommitSimulation(const FPhoneSimState& State, FDarkestFearItemSimChanges Changes);
+    void ReleaseSimulation(const FPhoneSimState& State);
+
+    virtual void OnSeamlessTravelled() override;
+
+private:
+    // Drives RealTimeCamera when the quality preset caps the capture rate
+    FTimerHandle CaptureTimerHandle;
+
+    // Charge while the phone has no simulated state: before BeginPlay and during seamless travel
+    float BatteryCharge;
+
+    void RegisterSimulation();
+
+    void CaptureScene();
 };
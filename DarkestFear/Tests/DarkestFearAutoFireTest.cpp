@@ -0,0 +1,190 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DarkestFear/DarkestFearAutoFire.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace DarkestFearAutoFireTest
+{
+    struct FResult
+    {
+        int32 NumShots = 0;
+        int32 NumExpected = 0;
+        int32 MaxShotsInFrame = 0;
+
+        /** Largest difference between the spacing of two shots and 1 / FireRate, while held */
+        double MaxSpacingError = 0.0;
+
+        /** Closest two shots ever were */
+        double MinSpacing = MAX_dbl;
+
+        /** Every age was within the frame that fired it */
+        bool bAgesValid = true;
+
+        /** Shots a server's FDarkestFearShotBudget turned down, receiving each frame's batch at its end */
+        int32 NumBudgetRejected = 0;
+    };
+
+    /** Seconds two shots may be off their exact spacing, float time steps round a little */
+    static constexpr double SpacingTolerance = 1e-5;
+
+    static const float FrameRates[] = {30.f, 60.f, 144.f};
+
+    /**
+     * Fires for 2 seconds at FPS, each frame time off by up to Jitter of it. Holds the trigger from the start, or
+     * taps it every frame
+     */
+    static FResult Run(float FireRate, float FPS, float Jitter, bool bTap)
+    {
+        constexpr double Duration = 2.0;
+
+        FRandomStream Random(7);
+        FDarkestFearAutoFire AutoFire;
+        AutoFire.FireRate = FireRate;
+
+        FDarkestFearShotBudget Budget;
+
+        TArray<float> Ages;
+        TArray<double> ShotTimes;
+        FResult Result;
+
+        double Now = 0.0;
+        double FirstFrameEnd = 0.0;
+
+        AutoFire.PullTrigger();
+
+        while (Now < Duration)
+        {
+            const float DeltaTime = (1.f + Jitter * Random.FRandRange(-1.f, 1.f)) / FPS;
+
+            if (bTap)
+            {
+                AutoFire.PullTrigger();
+                AutoFire.ReleaseTrigger();
+            }
+
+            Ages.Reset();
+            const int32 NumShots = AutoFire.Advance(DeltaTime, Ages);
+
+            Now += DeltaTime;
+
+            if (FirstFrameEnd == 0.0)
+                FirstFrameEnd = Now;
+
+            Result.MaxShotsInFrame = FMath::Max(Result.MaxShotsInFrame, NumShots);
+
+            if (NumShots > 0)
+                Result.NumBudgetRejected += NumShots - Budget.Consume(Now, FireRate, NumShots);
+
+            for (const float Age : Ages)
+            {
+                Result.bAgesValid &= Age >= 0.f && Age <= DeltaTime;
+                ShotTimes.Add(Now - Age);
+            }
+        }
+
+        Result.NumShots = ShotTimes.Num();
+
+        // Held, the first shot is at the end of the first frame and every 1 / FireRate after it
+        Result.NumExpected = FMath::FloorToInt((Now - FirstFrameEnd) * FireRate + 1e-6) + 1;
+
+        for (int32 Index = 1; Index < ShotTimes.Num(); Index++)
+        {
+            const double Spacing = ShotTimes[Index] - ShotTimes[Index - 1];
+
+            Result.MinSpacing = FMath::Min(Result.MinSpacing, Spacing);
+            Result.MaxSpacingError = FMath::Max(Result.MaxSpacingError, FMath::Abs(Spacing - 1.0 / FireRate));
+        }
+
+        return Result;
+    }
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDarkestFearAutoFireHeldTest, "DarkestFear.AutoFire.Held",
+                                 EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FDarkestFearAutoFireHeldTest::RunTest(const FString& Parameters)
+{
+    using namespace DarkestFearAutoFireTest;
+
+    for (const float Jitter : {0.f, .5f})
+    {
+        for (const float FPS : FrameRates)
+        {
+            for (const float FireRate : {20.f, 50.f, 100.f, 250.f})
+            {
+                const FResult Result = Run(FireRate, FPS, Jitter, false);
+                const FString Context = FString::Printf(TEXT("Held, %.0f fps%s, %.0f shots/s: "), FPS,
+                                                        Jitter > 0.f ? TEXT(" jittered") : TEXT(""), FireRate);
+
+                // A shot due right at the end of the run may round into either side of it
+                TestTrue(Context + FString::Printf(TEXT("%d shots, %d expected"), Result.NumShots, Result.NumExpected),
+                         FMath::Abs(Result.NumShots - Result.NumExpected) <= 1);
+                TestTrue(Context + FString::Printf(TEXT("spacing off by %.2f us"), Result.MaxSpacingError * 1e6),
+                         Result.MaxSpacingError <= SpacingTolerance);
+                TestTrue(Context + TEXT("shot ages within their frame"), Result.bAgesValid);
+                TestTrue(Context + FString::Printf(TEXT("%d shots in one frame"), Result.MaxShotsInFrame),
+                         Result.MaxShotsInFrame < FDarkestFearAutoFire::MaxShotsPerFrame);
+                TestEqual(Context + TEXT("shots over the server's budget"), Result.NumBudgetRejected, 0);
+            }
+        }
+    }
+
+    return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDarkestFearAutoFireTappedTest, "DarkestFear.AutoFire.Tapped",
+                                 EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FDarkestFearAutoFireTappedTest::RunTest(const FString& Parameters)
+{
+    using namespace DarkestFearAutoFireTest;
+
+    // Tapping every frame must never beat the fire rate
+    for (const float FPS : FrameRates)
+    {
+        constexpr float FireRate = 10.f;
+        const FResult Result = Run(FireRate, FPS, 0.f, true);
+        const FString Context = FString::Printf(TEXT("Tapped, %.0f fps, %.0f shots/s: "), FPS, FireRate);
+
+        TestTrue(Context + TEXT("fires more than once"), Result.NumShots > 1);
+        TestTrue(Context + FString::Printf(TEXT("closest shots %.2f ms apart"), Result.MinSpacing * 1000.0),
+                 Result.MinSpacing >= 1.0 / FireRate - SpacingTolerance);
+        TestTrue(Context + TEXT("shot ages within their frame"), Result.bAgesValid);
+    }
+
+    return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDarkestFearAutoFireFloodedTest, "DarkestFear.AutoFire.Flooded",
+                                 EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FDarkestFearAutoFireFloodedTest::RunTest(const FString& Parameters)
+{
+    using namespace DarkestFearAutoFireTest;
+
+    // A modified client sending full batches every frame gets no more than the rate plus one burst
+    for (const float FPS : FrameRates)
+    {
+        constexpr float FireRate = 20.f;
+        constexpr double Duration = 2.0;
+
+        FDarkestFearShotBudget Budget;
+        int32 NumAccepted = 0;
+
+        for (int32 Frame = 1; Frame <= FMath::RoundToInt(Duration * FPS); Frame++)
+            NumAccepted += Budget.Consume(Frame / FPS, FireRate, FDarkestFearAutoFire::MaxShotsPerFrame);
+
+        const int32 MaxAccepted = FMath::FloorToInt((Duration + FDarkestFearShotBudget::BurstSeconds) * FireRate) + 1;
+
+        TestTrue(FString::Printf(TEXT("Flooded, %.0f fps, %.0f shots/s: %d shots accepted, %d allowed"), FPS, FireRate,
+                                 NumAccepted, MaxAccepted),
+                 NumAccepted <= MaxAccepted);
+    }
+
+    return true;
+}
+
+#endif
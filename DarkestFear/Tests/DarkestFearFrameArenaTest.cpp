@@ -0,0 +1,128 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DarkestFear/DarkestFearFrameArena.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDarkestFearFrameArenaAllocateTest, "DarkestFear.FrameArena.Allocate",
+                                 EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FDarkestFearFrameArenaAllocateTest::RunTest(const FString& Parameters)
+{
+    FDarkestFearFrameArena& Arena = FDarkestFearFrameArena::Get();
+
+    // Whatever the current frame put in the arena stays where it is
+    const FDarkestFearFrameArena::FMark Mark = Arena.GetMark();
+    const SIZE_T BytesBefore = Arena.GetBytesUsed();
+
+    for (const uint32 Alignment : {uint32(DEFAULT_ALIGNMENT), 1u, 4u, 16u, 64u, 256u})
+    {
+        const uint32 Expected = Alignment == DEFAULT_ALIGNMENT ? FDarkestFearFrameArena::DefaultAlignment : Alignment;
+
+        // An odd sized allocation first, so the next one has to be aligned
+        Arena.Allocate(3, 1);
+        const void* Data = Arena.Allocate(24, Alignment);
+
+        TestTrue(FString::Printf(TEXT("Allocation aligned to %u"), Expected), IsAligned(Data, Expected));
+    }
+
+    // Bigger than a block, it gets one of its own
+    const SIZE_T LargeSize = FDarkestFearFrameArena::BlockSize * 2;
+    uint8* Large = static_cast<uint8*>(Arena.Allocate(LargeSize));
+
+    if (TestNotNull(TEXT("Allocation larger than a block"), Large))
+    {
+        Large[0] = 1;
+        Large[LargeSize - 1] = 1;
+    }
+
+    TestTrue(TEXT("Capacity holds the large allocation"), Arena.GetCapacity() >= LargeSize);
+
+    const TCHAR* Text = Arena.Printf(TEXT("%d items at %s"), 42, TEXT("rest"));
+    TestEqual(TEXT("Printf"), FString(Text), FString(TEXT("42 items at rest")));
+
+    // Only the string itself is kept, so the next allocation follows right after it
+    const SIZE_T BytesAfterPrintf = Arena.GetBytesUsed();
+    Arena.Allocate(1, 1);
+    TestEqual(TEXT("Printf gives back its unused buffer"), int64(Arena.GetBytesUsed() - BytesAfterPrintf), int64(1));
+
+    TArray<int32, FDarkestFearFrameAllocator> Numbers;
+
+    for (int32 Index = 0; Index < 1000; Index++)
+        Numbers.Add(Index);
+
+    bool bNumbersKept = true;
+
+    for (int32 Index = 0; Index < Numbers.Num(); Index++)
+        bNumbersKept &= Numbers[Index] == Index;
+
+    TestTrue(TEXT("Arena array keeps its elements while growing"), bNumbersKept);
+    TestTrue(TEXT("Peak covers what is in use"), Arena.GetPeakBytesUsed() >= Arena.GetBytesUsed());
+
+    Numbers.Empty();
+    Arena.PopMark(Mark);
+
+    TestEqual(TEXT("PopMark releases everything after the mark"), int64(Arena.GetBytesUsed()), int64(BytesBefore));
+
+    return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDarkestFearFrameArenaNoHeapTest, "DarkestFear.FrameArena.NoHeapAllocations",
+                                 EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FDarkestFearFrameArenaNoHeapTest::RunTest(const FString& Parameters)
+{
+    if (!FDarkestFearAllocCounter::IsEnabled())
+    {
+        AddWarning(TEXT("Allocation counting is off, run with -DarkestFearCountAllocs"));
+        return true;
+    }
+
+    FDarkestFearFrameArena& Arena = FDarkestFearFrameArena::Get();
+    const FVector Location(1234.5f, -678.9f, 42.f);
+
+    // What a placement frame builds. The first run may still add blocks, later ones must never touch the heap
+    auto PlacementFrame = [&Arena, &Location]()
+    {
+        const FDarkestFearFrameArena::FMark Mark = Arena.GetMark();
+
+        const TCHAR* Message = Arena.Printf(TEXT("You are facing: X: %d, Y: %d, Z: %d"), FMath::TruncToInt(Location.X),
+                                            FMath::TruncToInt(Location.Y), FMath::TruncToInt(Location.Z));
+
+        TArray<FVector, FDarkestFearFrameAllocator> Points;
+
+        for (int32 Index = 0; Index < 64; Index++)
+            Points.Add(Location + FVector(Index));
+
+        const int32 Checksum = FCString::Strlen(Message) + Points.Num();
+
+        Points.Empty();
+        Arena.PopMark(Mark);
+
+        return Checksum;
+    };
+
+    PlacementFrame();
+
+    const int64 AllocationsBefore = FDarkestFearAllocCounter::GetTotalAllocations();
+
+    for (int32 Frame = 0; Frame < 100; Frame++)
+        PlacementFrame();
+
+    TestEqual(TEXT("Heap allocations of 100 arena placement frames"),
+              FDarkestFearAllocCounter::GetTotalAllocations() - AllocationsBefore, int64(0));
+
+    // And the counter does see the heap
+    const int64 HeapBefore = FDarkestFearAllocCounter::GetTotalAllocations();
+    {
+        TArray<FVector> Points;
+        Points.Add(Location);
+    }
+    TestTrue(TEXT("A heap array is counted"), FDarkestFearAllocCounter::GetTotalAllocations() > HeapBefore);
+
+    return true;
+}
+
+#endif
@@ -0,0 +1,148 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DarkestFearTestWorld.h"
+#include "DarkestFear/DarkestFearItemSimulation.h"
+#include "DarkestFear/Items/Flashlight.h"
+#include "Async/ParallelFor.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace DarkestFearItemSimulationTest
+{
+    /** Just what a pool needs of an item */
+    struct FItem
+    {
+        int32 SimulationIndex = INDEX_NONE;
+        int32 NumChanges = 0;
+
+        void CommitSimulation(const FDarkestFearItemSimBenchState& State, FDarkestFearItemSimChanges Changes) { NumChanges++; }
+        void ReleaseSimulation(const FDarkestFearItemSimBenchState& State) {}
+    };
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDarkestFearItemSimulationParallelTest, "DarkestFear.ItemSimulation.ParallelMatchesSerial",
+                                 EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FDarkestFearItemSimulationParallelTest::RunTest(const FString& Parameters)
+{
+    using namespace DarkestFearItemSimulationTest;
+
+    constexpr int32 Count = 5000;
+    constexpr int32 NumFrames = 200;
+    constexpr float DeltaTime = 1.f / 60.f;
+    constexpr int32 StatesPerTask = UDarkestFearItemSimulationSubsystem::StatesPerTask;
+
+    // Batteries running out all along the run, and all of them before it ends
+    FRandomStream Random(3);
+    TArray<FItem> SerialItems;
+    TArray<FItem> ParallelItems;
+    SerialItems.SetNum(Count);
+    ParallelItems.SetNum(Count);
+
+    TDarkestFearItemSimPool<FDarkestFearItemSimBenchState, FItem> SerialPool;
+    TDarkestFearItemSimPool<FDarkestFearItemSimBenchState, FItem> ParallelPool;
+
+    for (int32 Index = 0; Index < Count; Index++)
+    {
+        const FDarkestFearItemSimBenchState State{Random.FRandRange(0.f, 2.f), 1.f, true};
+
+        SerialItems[Index].SimulationIndex = SerialPool.Add(&SerialItems[Index], State);
+        ParallelItems[Index].SimulationIndex = ParallelPool.Add(&ParallelItems[Index], State);
+    }
+
+    for (int32 Frame = 0; Frame < NumFrames; Frame++)
+    {
+        SerialPool.Update(0, Count, DeltaTime);
+        SerialPool.Commit();
+
+        ParallelFor(FMath::DivideAndRoundUp(Count, StatesPerTask), [&ParallelPool](int32 Task)
+        {
+            const int32 First = Task * StatesPerTask;
+            ParallelPool.Update(First, FMath::Min(First + StatesPerTask, Count), DeltaTime);
+        });
+
+        ParallelPool.Commit();
+    }
+
+    int32 NumMismatched = 0;
+    int32 NumNotRunOut = 0;
+
+    for (int32 Index = 0; Index < Count; Index++)
+    {
+        const FDarkestFearItemSimBenchState& Serial = SerialPool.GetState(Index);
+        const FDarkestFearItemSimBenchState& Parallel = ParallelPool.GetState(Index);
+
+        NumMismatched += Serial.Charge != Parallel.Charge || Serial.bIsOn != Parallel.bIsOn ||
+            SerialItems[Index].NumChanges != ParallelItems[Index].NumChanges;
+
+        // Exactly one commit, when the battery ran out
+        NumNotRunOut += Parallel.bIsOn || ParallelItems[Index].NumChanges != 1;
+    }
+
+    TestEqual(TEXT("States differing between serial and parallel updates"), NumMismatched, 0);
+    TestEqual(TEXT("Batteries not run out with exactly one commit"), NumNotRunOut, 0);
+
+    return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDarkestFearItemSimulationFlashlightTest, "DarkestFear.ItemSimulation.Flashlight",
+                                 EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FDarkestFearItemSimulationFlashlightTest::RunTest(const FString& Parameters)
+{
+    FDarkestFearTestWorld World;
+    UDarkestFearItemSimulationSubsystem* Simulation = World.Get()->GetSubsystem<UDarkestFearItemSimulationSubsystem>();
+
+    if (!TestNotNull(TEXT("Item simulation subsystem"), Simulation))
+        return false;
+
+    AFlashlight* Flashlights[3];
+    const float Charges[3] = {.5f, .8f, .3f};
+
+    for (int32 Index = 0; Index < 3; Index++)
+    {
+        Flashlights[Index] = World.Spawn<AFlashlight>();
+
+        if (!TestNotNull(TEXT("Flashlight"), Flashlights[Index]))
+            return false;
+
+        FFlashlightSimState* State = Simulation->GetState<FFlashlightSimState>(Flashlights[Index]);
+
+        if (!TestNotNull(TEXT("Flashlight registered on BeginPlay"), State))
+            return false;
+
+        State->Charge = Charges[Index];
+        State->DrainPerSecond = 1.f;
+    }
+
+    TestEqual(TEXT("Simulated states"), Simulation->GetNumStates(), 3);
+
+    // The last state moves into the slot of the one leaving, its flashlight has to follow it
+    Flashlights[0]->Destroy();
+
+    TestEqual(TEXT("Simulated states after EndPlay"), Simulation->GetNumStates(), 2);
+    TestEqual(TEXT("Second flashlight keeps its charge"), Flashlights[1]->GetBatteryCharge(), Charges[1]);
+    TestEqual(TEXT("Third flashlight keeps its charge"), Flashlights[2]->GetBatteryCharge(), Charges[2]);
+
+    // .5 seconds drain the third flashlight, but not the second
+    for (int32 Frame = 0; Frame < 5; Frame++)
+        Simulation->Simulate(.1f);
+
+    TestFalse(TEXT("Empty flashlight switched off"), Flashlights[2]->bIsOn);
+    TestEqual(TEXT("Empty flashlight charge"), Flashlights[2]->GetBatteryCharge(), 0.f);
+    TestTrue(TEXT("Charged flashlight still on"), Flashlights[1]->bIsOn);
+    TestEqual(TEXT("Charged flashlight charge"), Flashlights[1]->GetBatteryCharge(), .3f, 1e-4f);
+
+    if (Flashlights[2]->SpotLight != nullptr)
+        TestFalse(TEXT("Empty flashlight's light hidden"), Flashlights[2]->SpotLight->IsVisible());
+
+    // No charge, no light
+    Flashlights[2]->SetOn(true);
+    TestFalse(TEXT("Empty flashlight switched on"), Flashlights[2]->bIsOn);
+
+    return true;
+}
+
+#endif
@@ -0,0 +1,72 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DarkestFearTestWorld.h"
+#include "DarkestFear/DarkestFearScalability.h"
+#include "DarkestFear/Items/Flashlight.h"
+#include "DarkestFear/Items/Phone.h"
+#include "Components/SpotLightComponent.h"
+#include "Engine/TextureRenderTarget2D.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDarkestFearScalabilityApplyTest, "DarkestFear.Scalability.ApplyPresets",
+                                 EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FDarkestFearScalabilityApplyTest::RunTest(const FString& Parameters)
+{
+    IConsoleVariable* Quality = IConsoleManager::Get().FindConsoleVariable(TEXT("sg.DarkestFearQuality"));
+
+    if (!TestNotNull(TEXT("sg.DarkestFearQuality"), Quality))
+        return false;
+
+    FDarkestFearTestWorld World;
+    AFlashlight* Flashlight = World.Spawn<AFlashlight>();
+    APhone* Phone = World.Spawn<APhone>();
+
+    if (!TestNotNull(TEXT("Flashlight"), Flashlight) || !TestNotNull(TEXT("Phone"), Phone) ||
+        !TestNotNull(TEXT("Flashlight spot light"), Flashlight->SpotLight) ||
+        !TestNotNull(TEXT("Phone camera"), Phone->RealTimeCamera))
+    {
+        return false;
+    }
+
+    // The render target comes from content, the test brings its own
+    UTextureRenderTarget2D* Target = NewObject<UTextureRenderTarget2D>(Phone);
+    Target->InitAutoFormat(64, 64);
+    Phone->RealTimeCamera->TextureTarget = Target;
+
+    const int32 PreviousLevel = Quality->GetInt();
+    const UDarkestFearScalabilitySettings* Settings = GetDefault<UDarkestFearScalabilitySettings>();
+
+    for (int32 Level = 0; Level <= 3; Level++)
+    {
+        // Through the cvar, like the console, device profiles and user settings set it
+        Quality->Set(Level, ECVF_SetByConsole);
+
+        const FDarkestFearQualityPreset& Preset = Settings->GetPreset(Level);
+        const FString Context = FString::Printf(TEXT("Level %d: "), Level);
+
+        TestEqual(Context + TEXT("quality level"), FDarkestFearScalability::GetQualityLevel(), Level);
+        TestTrue(Context + TEXT("flashlight shadows"), bool(Flashlight->SpotLight->CastShadows) == Preset.bFlashlightShadows);
+        TestEqual(Context + TEXT("flashlight attenuation radius"), Flashlight->SpotLight->AttenuationRadius,
+                  Preset.FlashlightAttenuationRadius);
+        TestEqual(Context + TEXT("phone capture size"), int32(Target->SizeX), Preset.PhoneCaptureResolution);
+        TestTrue(Context + TEXT("phone capture every frame"),
+                 bool(Phone->RealTimeCamera->bCaptureEveryFrame) == (Preset.PhoneCaptureRate <= 0.f));
+        TestEqual(Context + TEXT("phone capture rate"), Phone->GetCaptureRate(), FMath::Max(Preset.PhoneCaptureRate, 0.f),
+                  KINDA_SMALL_NUMBER);
+        TestEqual(Context + TEXT("flashlight cull distance"), Flashlight->MeshComponent->LDMaxDrawDistance,
+                  Preset.PlacedItemCullDistance);
+        TestEqual(Context + TEXT("phone cull distance"), Phone->MeshComponent->LDMaxDrawDistance,
+                  Preset.PlacedItemCullDistance);
+    }
+
+    Quality->Set(PreviousLevel, ECVF_SetByConsole);
+
+    return true;
+}
+
+#endif
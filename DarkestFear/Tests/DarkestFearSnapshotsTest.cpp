@@ -0,0 +1,224 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DarkestFear/DarkestFearSnapshots.h"
+#include "IImageWrapper.h"
+#include "IImageWrapperModule.h"
+#include "HAL/FileManager.h"
+#include "Misc/AutomationTest.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Modules/ModuleManager.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace DarkestFearSnapshotsTest
+{
+    /** A gradient that is different for every Seed */
+    static FDarkestFearSnapshot MakeSnapshot(int32 Size, int32 Seed)
+    {
+        FDarkestFearSnapshot Snapshot;
+        Snapshot.Width = Size;
+        Snapshot.Height = Size;
+        Snapshot.CaptureTime = FDateTime::Now();
+        Snapshot.CaptureSeconds = FPlatformTime::Seconds();
+        Snapshot.Pixels.SetNumUninitialized(Size * Size);
+
+        for (int32 Y = 0; Y < Size; Y++)
+        {
+            for (int32 X = 0; X < Size; X++)
+                Snapshot.Pixels[Y * Size + X] = FColor(uint8(X * 4 + Seed), uint8(Y * 4), uint8(Seed * 16), 255);
+        }
+
+        return Snapshot;
+    }
+
+    /** An empty gallery directory of the test's own */
+    static FString MakeDirectory(const TCHAR* Name)
+    {
+        const FString Directory = FPaths::AutomationTransientDir() / TEXT("DarkestFear") / Name;
+        IFileManager::Get().DeleteDirectory(*Directory, false, true);
+
+        return Directory;
+    }
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDarkestFearSnapshotsWriteTest, "DarkestFear.Snapshots.Write",
+                                 EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FDarkestFearSnapshotsWriteTest::RunTest(const FString& Parameters)
+{
+    using namespace DarkestFearSnapshotsTest;
+
+    constexpr int32 Count = 6;
+    constexpr int32 Size = 64;
+
+    const FString Directory = MakeDirectory(TEXT("SnapshotsWrite"));
+    TArray<FDarkestFearSnapshot> Expected;
+
+    {
+        FDarkestFearSnapshotPipeline Pipeline(Directory, FDarkestFearSnapshotPipeline::EFormat::Png);
+
+        for (int32 Index = 0; Index < Count; Index++)
+        {
+            Expected.Add(MakeSnapshot(Size, Index));
+            TestTrue(FString::Printf(TEXT("Snapshot %d accepted"), Index), Pipeline.Submit(MakeSnapshot(Size, Index)));
+        }
+
+        Pipeline.Flush();
+
+        const FDarkestFearSnapshotStats Stats = Pipeline.GetStats();
+
+        TestEqual(TEXT("Submitted"), Stats.Submitted, Count);
+        TestEqual(TEXT("Written"), Stats.Written, Count);
+        TestEqual(TEXT("Dropped"), Stats.Dropped, 0);
+        TestEqual(TEXT("Failed"), Stats.Failed, 0);
+        TestTrue(TEXT("Idle after Flush"), Pipeline.IsIdle());
+    }
+
+    // A new pipeline on the same directory finds the photos through the index
+    FDarkestFearSnapshotPipeline Reopened(Directory, FDarkestFearSnapshotPipeline::EFormat::Png);
+    const TArray<FDarkestFearGalleryEntry> Gallery = Reopened.GetGallery();
+
+    if (!TestEqual(TEXT("Gallery entries"), Gallery.Num(), Count))
+        return false;
+
+    IImageWrapperModule& ImageWrapperModule = FModuleManager::LoadModuleChecked<IImageWrapperModule>(TEXT("ImageWrapper"));
+
+    // One encoder at a time would keep submission order, two may swap neighbours, so match by content
+    TArray<bool> Found;
+    Found.SetNumZeroed(Count);
+
+    for (const FDarkestFearGalleryEntry& Entry : Gallery)
+    {
+        TestEqual(Entry.File + TEXT(" width"), Entry.Width, Size);
+        TestEqual(Entry.File + TEXT(" height"), Entry.Height, Size);
+
+        TArray<uint8> Compressed;
+
+        if (!TestTrue(Entry.File + TEXT(" on disk"), FFileHelper::LoadFileToArray(Compressed, *(Directory / Entry.File))))
+            continue;
+
+        TestEqual(Entry.File + TEXT(" size in the index"), Entry.Bytes, int64(Compressed.Num()));
+
+        const TSharedPtr<IImageWrapper> ImageWrapper = ImageWrapperModule.CreateImageWrapper(EImageFormat::PNG);
+        TArray64<uint8> Raw;
+
+        if (!TestTrue(Entry.File + TEXT(" decodes"), ImageWrapper.IsValid() &&
+                      ImageWrapper->SetCompressed(Compressed.GetData(), Compressed.Num()) &&
+                      ImageWrapper->GetRaw(ERGBFormat::BGRA, 8, Raw) && Raw.Num() == Size * Size * sizeof(FColor)))
+        {
+            continue;
+        }
+
+        // PNG is lossless, the file holds exactly the submitted pixels
+        for (int32 Index = 0; Index < Count; Index++)
+        {
+            if (!Found[Index] && FMemory::Memcmp(Raw.GetData(), Expected[Index].Pixels.GetData(), Raw.Num()) == 0)
+            {
+                Found[Index] = true;
+                break;
+            }
+        }
+    }
+
+    for (int32 Index = 0; Index < Count; Index++)
+        TestTrue(FString::Printf(TEXT("Pixels of snapshot %d on disk"), Index), Found[Index]);
+
+    return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDarkestFearSnapshotsHalfFloatTest, "DarkestFear.Snapshots.HalfFloat",
+                                 EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FDarkestFearSnapshotsHalfFloatTest::RunTest(const FString& Parameters)
+{
+    using namespace DarkestFearSnapshotsTest;
+
+    constexpr int32 Size = 32;
+
+    const FString Directory = MakeDirectory(TEXT("SnapshotsHalfFloat"));
+    FDarkestFearSnapshotPipeline Pipeline(Directory, FDarkestFearSnapshotPipeline::EFormat::Png);
+
+    // Linear ramps, with values above 1 as HDR scene color has
+    FDarkestFearSnapshot Snapshot;
+    Snapshot.Width = Size;
+    Snapshot.Height = Size;
+    Snapshot.CaptureTime = FDateTime::Now();
+    Snapshot.HalfPixels.SetNumUninitialized(Size * Size);
+
+    TArray<FColor> Expected;
+    Expected.SetNumUninitialized(Size * Size);
+
+    for (int32 Index = 0; Index < Size * Size; Index++)
+    {
+        const FLinearColor Color(float(Index % Size) / Size, float(Index / Size) / Size, Index % 3 == 0 ? 4.f : .5f, 0.f);
+
+        Snapshot.HalfPixels[Index] = FFloat16Color(Color);
+        Expected[Index] = FLinearColor(Snapshot.HalfPixels[Index]).ToFColor(true);
+        Expected[Index].A = 255;
+    }
+
+    TestTrue(TEXT("Half float snapshot accepted"), Pipeline.Submit(MoveTemp(Snapshot)));
+    Pipeline.Flush();
+
+    const TArray<FDarkestFearGalleryEntry> Gallery = Pipeline.GetGallery();
+
+    if (!TestEqual(TEXT("Gallery entries"), Gallery.Num(), 1))
+        return false;
+
+    TArray<uint8> Compressed;
+    TArray64<uint8> Raw;
+
+    IImageWrapperModule& ImageWrapperModule = FModuleManager::LoadModuleChecked<IImageWrapperModule>(TEXT("ImageWrapper"));
+    const TSharedPtr<IImageWrapper> ImageWrapper = ImageWrapperModule.CreateImageWrapper(EImageFormat::PNG);
+
+    if (!TestTrue(TEXT("Snapshot decodes"), FFileHelper::LoadFileToArray(Compressed, *(Directory / Gallery[0].File)) &&
+                  ImageWrapper.IsValid() && ImageWrapper->SetCompressed(Compressed.GetData(), Compressed.Num()) &&
+                  ImageWrapper->GetRaw(ERGBFormat::BGRA, 8, Raw) && Raw.Num() == Size * Size * sizeof(FColor)))
+    {
+        return false;
+    }
+
+    TestTrue(TEXT("Pixels converted to opaque sRGB"), FMemory::Memcmp(Raw.GetData(), Expected.GetData(), Raw.Num()) == 0);
+
+    return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDarkestFearSnapshotsMemoryCapTest, "DarkestFear.Snapshots.MemoryCap",
+                                 EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FDarkestFearSnapshotsMemoryCapTest::RunTest(const FString& Parameters)
+{
+    using namespace DarkestFearSnapshotsTest;
+
+    constexpr int32 Count = 32;
+    constexpr int32 Size = 128;
+    constexpr int64 SnapshotBytes = int64(Size) * Size * sizeof(FColor);
+
+    FDarkestFearSnapshotPipeline Pipeline(MakeDirectory(TEXT("SnapshotsMemoryCap")), FDarkestFearSnapshotPipeline::EFormat::Jpeg);
+    Pipeline.MaxBytesInFlight = SnapshotBytes * 2;
+
+    // Bigger than the whole cap, never accepted
+    TestFalse(TEXT("Snapshot over the memory cap accepted"), Pipeline.Submit(MakeSnapshot(Size * 2, 0)));
+
+    int32 NumAccepted = 0;
+
+    for (int32 Index = 0; Index < Count; Index++)
+        NumAccepted += Pipeline.Submit(MakeSnapshot(Size, Index));
+
+    Pipeline.Flush();
+
+    const FDarkestFearSnapshotStats Stats = Pipeline.GetStats();
+
+    TestEqual(TEXT("Submitted"), Stats.Submitted, Count + 1);
+    TestEqual(TEXT("Every submission written or dropped"), Stats.Written + Stats.Dropped + Stats.Failed, Stats.Submitted);
+    TestEqual(TEXT("Accepted ones written"), Stats.Written, NumAccepted);
+    TestTrue(FString::Printf(TEXT("Peak memory in flight %lld of %lld bytes"), Stats.PeakBytesInFlight, Pipeline.MaxBytesInFlight),
+             Stats.PeakBytesInFlight <= Pipeline.MaxBytesInFlight);
+    TestEqual(TEXT("Gallery entries"), Pipeline.GetGallery().Num(), NumAccepted);
+
+    return true;
+}
+
+#endif
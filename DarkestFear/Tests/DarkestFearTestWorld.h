@@ -0,0 +1,52 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+/**
+ * A game world of its own for automation tests, playing from construction and torn down with the scope. It has
+ * no map, no game mode and no players, only what the test spawns into it, so tests run headless (-nullrhi) the same
+ * as in the editor.
+ */
+class FDarkestFearTestWorld
+{
+public:
+    FDarkestFearTestWorld()
+    {
+        World = UWorld::CreateWorld(EWorldType::Game, false);
+
+        FWorldContext& Context = GEngine->CreateNewWorldContext(EWorldType::Game);
+        Context.SetCurrentWorld(World);
+
+        World->InitializeActorsForPlay(FURL());
+        World->BeginPlay();
+    }
+
+    ~FDarkestFearTestWorld()
+    {
+        GEngine->DestroyWorldContext(World);
+        World->DestroyWorld(false);
+        CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS);
+    }
+
+    UWorld* Get() const { return World; }
+
+    template <typename ActorType>
+    ActorType* Spawn(const FVector& Location = FVector::ZeroVector)
+    {
+        FActorSpawnParameters SpawnParams;
+        SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+        return World->SpawnActor<ActorType>(Location, FRotator::ZeroRotator, SpawnParams);
+    }
+
+private:
+    UWorld* World;
+};
+
+#endif